@@ -13,6 +13,10 @@
 ///    .data      -- initialized data
 ///    .bss/.sbss -- uninitialized data (should be zeroed on program startup)
 ///
+/// With `-p`, the output is page-aligned (`NOFF_MAGIC_PAGED`): segments are
+/// padded to `NOFF_PAGE_SIZE` in the file and their permissions recorded.
+/// The linker must already have placed each segment on its own pages.
+///
 /// Copyright (c) 1992-1993 The Regents of the University of California.
 ///               2016-2021 Docentes de la Universidad Nacional de Rosario.
 /// All rights reserved.  See `copyright.h` for copyright notice and
@@ -80,6 +84,24 @@ WriteOrDie(FILE *f, const char *buffer, size_t numBytes)
     }
 }
 
+/// In page-aligned mode, check that a segment starts on a page, and pad the
+/// output file up to the next page.
+static void
+AlignOrDie(FILE *f, int *inNoffFile, size_t addr, const char *name)
+{
+    assert(f != NULL);
+    assert(inNoffFile != NULL);
+
+    if (addr % NOFF_PAGE_SIZE != 0) {
+        Die("Section `%s` at 0x%X is not page aligned; link with sections "
+            "aligned to %u bytes", name, (unsigned) addr, NOFF_PAGE_SIZE);
+    }
+    while (*inNoffFile % NOFF_PAGE_SIZE != 0) {
+        WriteOrDie(f, "", 1);
+        (*inNoffFile)++;
+    }
+}
+
 void
 main(int argc, char *argv[])
 {
@@ -88,9 +110,16 @@ main(int argc, char *argv[])
     unsigned   numSections, i;
     char      *buffer;
     noffHeader noffH;
+    noffPagedHeader pagedH;
+    int        paged = 0;
 
-    if (argc < 2) {
-        fprintf(stderr, "Usage: %s <coffFileName> <noffFileName>\n",
+    if (argc > 1 && !strcmp(argv[1], "-p")) {
+        paged = 1;
+        argc--;
+        argv++;
+    }
+    if (argc < 3) {
+        fprintf(stderr, "Usage: %s [-p] <coffFileName> <noffFileName>\n",
                 argv[0]);
         exit(1);
     }
@@ -119,14 +148,18 @@ main(int argc, char *argv[])
 
     /// Initialize the NOFF header, in case not all the segments are defined
     /// in the COFF file.
-    noffH.noffMagic       = NOFF_MAGIC;
+    noffH.noffMagic       = paged ? NOFF_MAGIC_PAGED : NOFF_MAGIC;
     noffH.code.size       = 0;
     noffH.initData.size   = 0;
     noffH.uninitData.size = 0;
+    pagedH.pageSize        = NOFF_PAGE_SIZE;
+    pagedH.codeFlags       = NOFF_READ | NOFF_EXEC;
+    pagedH.initDataFlags   = NOFF_READ | NOFF_WRITE;
+    pagedH.uninitDataFlags = NOFF_READ | NOFF_WRITE;
 
     /// Copy the segments in.
     CoffSection *sc;
-    inNoffFile = sizeof noffH;
+    inNoffFile = sizeof noffH + (paged ? sizeof pagedH : 0);
     fseek(out, inNoffFile, SEEK_SET);
     printf("Translating COFF sections into NOFF:\n");
     while ((sc = CoffReaderNextSection(&d)) != NULL) {
@@ -141,6 +174,9 @@ main(int argc, char *argv[])
         size_t size = CoffSectionSize(sc);
 
         if (!strcmp(name, ".text")) {
+            if (paged) {
+                AlignOrDie(out, &inNoffFile, addr, name);
+            }
             noffH.code.virtualAddr = addr;
             noffH.code.inFileAddr  = inNoffFile;
             noffH.code.size        = size;
@@ -157,6 +193,9 @@ main(int argc, char *argv[])
             if (noffH.initData.size != 0) {
                 Die("Cannot handle both data and rdata");
             }
+            if (paged) {
+                AlignOrDie(out, &inNoffFile, addr, name);
+            }
             noffH.initData.virtualAddr = addr;
             noffH.initData.inFileAddr  = inNoffFile;
             noffH.initData.size        = size;
@@ -176,6 +215,10 @@ main(int argc, char *argv[])
                 }
                 noffH.uninitData.size += size;
             } else {
+                if (paged && addr % NOFF_PAGE_SIZE != 0) {
+                    Die("Section `%s` at 0x%X is not page aligned",
+                        name, (unsigned) addr);
+                }
                 noffH.uninitData.virtualAddr = addr;
                 noffH.uninitData.size        = size;
             }
@@ -207,6 +250,9 @@ main(int argc, char *argv[])
 
     fseek(out, 0, SEEK_SET);
     WriteOrDie(out, (const char *) &noffH, sizeof noffH);
+    if (paged) {
+        WriteOrDie(out, (const char *) &pagedH, sizeof pagedH);
+    }
     fclose(in);
     fclose(out);
     exit(0);
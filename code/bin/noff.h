@@ -17,6 +17,16 @@
 
 #define NOFF_MAGIC  0xBADFAD  // Magic number denoting Nachos object code
                               // file.
+#define NOFF_MAGIC_PAGED  0xBADFAE  // Same, with page-aligned segments and a
+                                    // `noffPagedHeader`.
+
+#define NOFF_PAGE_SIZE  128  // Segment alignment in page-aligned files; the
+                             // same as `PAGE_SIZE` in the simulated machine.
+
+// Segment permissions.
+#define NOFF_READ   0x1
+#define NOFF_WRITE  0x2
+#define NOFF_EXEC   0x4
 
 typedef struct noffSegment {
     uint32_t virtualAddr;  // Location of segment in virtual address space.
@@ -32,5 +42,18 @@ typedef struct noffHeader {
                              // zeroed before use.
 } noffHeader;
 
+// In files starting with `NOFF_MAGIC_PAGED`, right after `noffHeader`.
+//
+// Every segment starts on a page boundary, both in the virtual address space
+// and in the file, and no two segments share a page.  So every page holds
+// the contents of one segment only, can be read from the file at once, and
+// can be protected according to the segment's permissions.
+typedef struct noffPagedHeader {
+    uint32_t pageSize;         // Alignment of the segments.
+    uint32_t codeFlags;        // Permissions of each segment: `NOFF_READ`,
+    uint32_t initDataFlags;    // `NOFF_WRITE` and `NOFF_EXEC` combined.
+    uint32_t uninitDataFlags;
+} noffPagedHeader;
+
 
 #endif
@@ -24,6 +24,20 @@ PrintSegment(noffSegment *s, const char *description)
            s->size);
 }
 
+static const char *
+FlagsToString(uint32_t flags)
+{
+    static char s[4][4];
+    static unsigned next = 0;
+
+    char *r = s[next++ % 4];
+    r[0] = flags & NOFF_READ  ? 'r' : '-';
+    r[1] = flags & NOFF_WRITE ? 'w' : '-';
+    r[2] = flags & NOFF_EXEC  ? 'x' : '-';
+    r[3] = '\0';
+    return r;
+}
+
 int
 main(int argc, char *argv[])
 {
@@ -50,10 +64,21 @@ main(int argc, char *argv[])
     }
 
     // Analyze the header and print the results.
+    noffPagedHeader p;
     if (h.noffMagic == NOFF_MAGIC) {
         printf("%s: NOFF file\n"
                "    Magic: 0x%X\n",
                path, h.noffMagic);
+    } else if (h.noffMagic == NOFF_MAGIC_PAGED
+                 && fread(&p, sizeof p, 1, f) == 1) {
+        printf("%s: page-aligned NOFF file\n"
+               "    Magic: 0x%X\n"
+               "    Page size: %u bytes\n"
+               "    Permissions: code %s, initialized data %s, "
+               "uninitialized data %s\n",
+               path, h.noffMagic, p.pageSize,
+               FlagsToString(p.codeFlags), FlagsToString(p.initDataFlags),
+               FlagsToString(p.uninitDataFlags));
     } else {
         printf("%s: not a NOFF file\n"
                "    Magic: 0x%X (should be 0x%X)\n",
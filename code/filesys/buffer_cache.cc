@@ -0,0 +1,343 @@
+/// Copyright (c) 2019-2021 Docentes de la Universidad Nacional de Rosario.
+/// All rights reserved.  See `copyright.h` for copyright notice and
+/// limitation of liability and disclaimer of warranty provisions.
+
+
+#include "buffer_cache.hh"
+#include "threads/system.hh"
+
+#include <string.h>
+
+
+BufferCache::BufferCache(unsigned aNumBlocks, unsigned anInterval)
+{
+    ASSERT(aNumBlocks > 0);
+
+    numBlocks = aNumBlocks;
+    blocks    = new Block [numBlocks];
+    for (unsigned i = 0; i < numBlocks; i++) {
+        blocks[i].valid = false;
+        blocks[i].dirty = false;
+        blocks[i].use   = false;
+        blocks[i].pins  = 0;
+        blocks[i].lock  = new Lock("buffer cache block");
+    }
+    hand     = 0;
+    lock     = new Lock("buffer cache");
+    unpinned = new Condition("buffer cache unpinned", lock);
+
+    interval = anInterval;
+    waiting  = false;
+    wakeUp   = new Semaphore("buffer flusher", 0);
+    if (interval > 0) {
+        Thread *t = new Thread("buffer flusher", false);
+        t->Fork(Run, this);
+        // A timer interrupt does not keep an otherwise idle machine
+        // running.
+        interrupt->Schedule(Tick, this, interval, TIMER_INT);
+    }
+}
+
+BufferCache::~BufferCache()
+{
+    for (unsigned i = 0; i < numBlocks; i++) {
+        delete blocks[i].lock;
+    }
+    delete [] blocks;
+    delete unpinned;
+    delete lock;
+    delete wakeUp;
+}
+
+BufferCache::Block *
+BufferCache::Lookup(unsigned sector) const
+{
+    for (unsigned i = 0; i < numBlocks; i++) {
+        if (blocks[i].valid && blocks[i].sector == sector) {
+            return &blocks[i];
+        }
+    }
+    return nullptr;
+}
+
+BufferCache::Block *
+BufferCache::ChooseVictim()
+{
+    // After a full turn, every block not pinned has its use bit clear.
+    for (unsigned i = 0; i < 2 * numBlocks; i++) {
+        Block *b = &blocks[hand];
+        hand = (hand + 1) % numBlocks;
+        if (b->pins > 0) {
+            continue;
+        }
+        if (b->valid && b->use) {
+            b->use = false;
+            continue;
+        }
+        return b;
+    }
+    return nullptr;
+}
+
+void
+BufferCache::WriteBack(Block *b)
+{
+    ASSERT(b != nullptr);
+    ASSERT(b->lock->IsHeldByCurrentThread());
+
+    if (b->dirty) {
+        DEBUG('f', "Buffer cache writing back sector %u\n", b->sector);
+        synchDisk->WriteSector(b->sector, b->data);
+        b->dirty = false;
+        stats->numBufferCacheWritebacks++;
+    }
+}
+
+void
+BufferCache::Claim(Block *b, unsigned sector)
+{
+    ASSERT(b != nullptr);
+    ASSERT(b->pins == 0 && !(b->valid && b->dirty));
+
+    // Nobody holds the lock of a block not pinned.
+    b->sector = sector;
+    b->valid  = true;
+    b->dirty  = false;
+    b->use    = true;
+    b->pins   = 1;
+    b->lock->Acquire();
+    stats->numBufferCacheMisses++;
+}
+
+BufferCache::Block *
+BufferCache::Get(unsigned sector, bool *hit)
+{
+    ASSERT(sector < NUM_SECTORS);
+    ASSERT(hit != nullptr);
+
+    lock->Acquire();
+    for (;;) {
+        Block *b = Lookup(sector);
+        if (b != nullptr) {
+            b->pins++;
+            b->use = true;
+            lock->Release();
+            b->lock->Acquire();  // Until read in, if it is just being.
+            stats->numBufferCacheHits++;
+            *hit = true;
+            return b;
+        }
+
+        b = ChooseVictim();
+        if (b == nullptr) {
+            unpinned->Wait();
+            continue;
+        }
+        if (b->valid && b->dirty) {
+            // The block keeps its sector until written back, so that
+            // nobody reads the old contents from the disk meanwhile.  It
+            // may be used again by then, so look everything up again.
+            b->pins++;
+            lock->Release();
+            b->lock->Acquire();
+            WriteBack(b);
+            Put(b);
+            lock->Acquire();
+            continue;
+        }
+
+        Claim(b, sector);
+        lock->Release();
+        *hit = false;
+        return b;
+    }
+}
+
+BufferCache::Block *
+BufferCache::TryClaim(unsigned sector)
+{
+    ASSERT(sector < NUM_SECTORS);
+
+    lock->Acquire();
+    Block *b = nullptr;
+    if (Lookup(sector) == nullptr) {
+        b = ChooseVictim();
+        if (b != nullptr && b->valid && b->dirty) {
+            b = nullptr;
+        }
+        if (b != nullptr) {
+            Claim(b, sector);
+        }
+    }
+    lock->Release();
+    return b;
+}
+
+void
+BufferCache::Put(Block *b)
+{
+    ASSERT(b != nullptr);
+
+    b->lock->Release();
+    lock->Acquire();
+    ASSERT(b->pins > 0);
+    if (--b->pins == 0) {
+        unpinned->Broadcast();
+    }
+    lock->Release();
+}
+
+void
+BufferCache::ReadSector(unsigned sector, char *data)
+{
+    ReadSectors(sector, 1, data);
+}
+
+void
+BufferCache::WriteSector(unsigned sector, const char *data)
+{
+    WriteSectors(sector, 1, data);
+}
+
+void
+BufferCache::ReadSectors(unsigned first, unsigned numSectors, char *data)
+{
+    ASSERT(data != nullptr);
+
+    for (unsigned i = 0; i < numSectors; ) {
+        Block *run[SECTORS_PER_TRACK];
+        bool hit;
+        run[0] = Get(first + i, &hit);
+        if (hit) {
+            memcpy(&data[i * SECTOR_SIZE], run[0]->data, SECTOR_SIZE);
+            Put(run[0]);
+            i++;
+            continue;
+        }
+
+        // Read the following sectors missing along with this one, as long
+        // as they are in the same track.  Only blocks that can be had
+        // without waiting are taken, since we hold the locks of the
+        // previous ones.
+        unsigned count = 1;
+        while (i + count < numSectors
+                 && (first + i + count) % SECTORS_PER_TRACK != 0) {
+            run[count] = TryClaim(first + i + count);
+            if (run[count] == nullptr) {
+                break;
+            }
+            count++;
+        }
+
+        char *into = &data[i * SECTOR_SIZE];
+        synchDisk->ReadSectors(first + i, count, into);
+        for (unsigned k = 0; k < count; k++) {
+            memcpy(run[k]->data, &into[k * SECTOR_SIZE], SECTOR_SIZE);
+            Put(run[k]);
+        }
+        i += count;
+    }
+}
+
+void
+BufferCache::WriteSectors(unsigned first, unsigned numSectors,
+                          const char *data)
+{
+    ASSERT(data != nullptr);
+
+    for (unsigned i = 0; i < numSectors; i++) {
+        bool hit;
+        Block *b = Get(first + i, &hit);
+        memcpy(b->data, &data[i * SECTOR_SIZE], SECTOR_SIZE);
+        b->dirty = true;
+        Put(b);
+    }
+}
+
+void
+BufferCache::Flush()
+{
+    DEBUG('f', "Flushing the buffer cache\n");
+
+    // Pin every dirty block at once, in order of sector, so that they
+    // stay where they are while written back.
+    Block **dirty = new Block *[numBlocks];
+    unsigned numDirty = 0;
+    lock->Acquire();
+    for (unsigned i = 0; i < numBlocks; i++) {
+        Block *b = &blocks[i];
+        if (!b->valid || !b->dirty) {
+            continue;
+        }
+        b->pins++;
+        unsigned j = numDirty++;
+        for (; j > 0 && dirty[j - 1]->sector > b->sector; j--) {
+            dirty[j] = dirty[j - 1];
+        }
+        dirty[j] = b;
+    }
+    lock->Release();
+
+    char run[SECTORS_PER_TRACK * SECTOR_SIZE];
+    for (unsigned i = 0; i < numDirty; ) {
+        unsigned first = dirty[i]->sector;
+        unsigned count = 0;
+        do {
+            Block *b = dirty[i + count];
+            b->lock->Acquire();
+            memcpy(&run[count * SECTOR_SIZE], b->data, SECTOR_SIZE);
+            b->dirty = false;
+            count++;
+        } while (i + count < numDirty
+                   && dirty[i + count]->sector == first + count
+                   && (first + count) % SECTORS_PER_TRACK != 0);
+
+        DEBUG('f', "Buffer cache writing back sectors %u to %u\n",
+              first, first + count - 1);
+        synchDisk->WriteSectors(first, count, run);
+        stats->numBufferCacheWritebacks += count;
+        for (unsigned k = 0; k < count; k++) {
+            Put(dirty[i + k]);
+        }
+        i += count;
+    }
+    delete [] dirty;
+}
+
+void
+BufferCache::Invalidate()
+{
+    Flush();
+    lock->Acquire();
+    for (unsigned i = 0; i < numBlocks; i++) {
+        ASSERT(blocks[i].pins == 0);
+        blocks[i].valid = false;
+    }
+    lock->Release();
+}
+
+void
+BufferCache::Tick(void *arg)
+{
+    ASSERT(arg != nullptr);
+
+    BufferCache *c = (BufferCache *) arg;
+    interrupt->Schedule(Tick, c, c->interval, TIMER_INT);
+    if (c->waiting) {
+        c->waiting = false;
+        c->wakeUp->V();
+    }
+}
+
+void
+BufferCache::Run(void *arg)
+{
+    ASSERT(arg != nullptr);
+
+    BufferCache *c = (BufferCache *) arg;
+    for (;;) {
+        c->waiting = true;
+        c->wakeUp->P();
+        c->Flush();
+    }
+}
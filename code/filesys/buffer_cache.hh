@@ -0,0 +1,121 @@
+/// Cache of disk sectors, in front of the synchronous disk.
+///
+/// File headers, directories and the free map are read over and over, and
+/// every access to the disk pays for a seek and a rotation.  All sector
+/// reads and writes of the file system go through this cache instead, which
+/// keeps a fixed number of sectors in memory, replaced by the clock
+/// algorithm.
+///
+/// Writes only reach the disk when a dirty sector is replaced, when a
+/// kernel thread wakes up periodically to flush every dirty sector, or when
+/// Nachos halts.  As on a real system, a crash loses the writes of the
+/// last interval.
+///
+/// Copyright (c) 2019-2021 Docentes de la Universidad Nacional de Rosario.
+/// All rights reserved.  See `copyright.h` for copyright notice and
+/// limitation of liability and disclaimer of warranty provisions.
+
+#ifndef NACHOS_FILESYS_BUFFERCACHE__HH
+#define NACHOS_FILESYS_BUFFERCACHE__HH
+
+
+#include "machine/disk.hh"
+#include "threads/condition.hh"
+#include "threads/lock.hh"
+#include "threads/semaphore.hh"
+
+
+/// Several threads may use the cache at the same time.  A lock on the whole
+/// cache protects which sector each block holds, and is never held across
+/// disk operations; each block has a lock of its own, held while its
+/// contents are read, written or transferred.  A block is pinned while some
+/// thread is using it, so that it is not replaced meanwhile.
+class BufferCache {
+public:
+
+    /// Cache `numBlocks` sectors, writing the dirty ones back every
+    /// `interval` ticks; zero disables the periodic flush.
+    BufferCache(unsigned numBlocks, unsigned interval);
+
+    /// Dirty blocks are not written back; call `Flush` first.
+    ~BufferCache();
+
+    /// Read sector `sector` into `data`.
+    void ReadSector(unsigned sector, char *data);
+
+    /// Write `data` into sector `sector`, on the disk some time later.
+    void WriteSector(unsigned sector, const char *data);
+
+    /// Read `numSectors` consecutive sectors from `first` into `data`.
+    /// Runs of them missing in the same track are read from the disk with
+    /// a single request each.
+    void ReadSectors(unsigned first, unsigned numSectors, char *data);
+
+    /// Write `data` into `numSectors` consecutive sectors from `first`.
+    void WriteSectors(unsigned first, unsigned numSectors, const char *data);
+
+    /// Write every dirty block back to the disk, dirty blocks of
+    /// consecutive sectors in the same track with a single request.
+    void Flush();
+
+    /// Write every dirty block back, and forget what every block holds, so
+    /// that it is read from the disk again.  No block may be in use.
+    void Invalidate();
+
+private:
+
+    struct Block {
+        unsigned sector;
+        bool valid;     ///< Whether `sector` and `data` mean anything.
+        bool dirty;
+        bool use;       ///< Reference bit for the clock algorithm.
+        unsigned pins;  ///< Threads using the block.
+        Lock *lock;
+        char data[SECTOR_SIZE];
+    };
+
+    /// Pin the block holding `sector` and acquire its lock.  On a miss,
+    /// `hit` is set to false, and it is up to the caller to fill the block
+    /// in.
+    Block *Get(unsigned sector, bool *hit);
+
+    /// Like `Get` on a miss, but give up and return null if `sector` is
+    /// cached already or no block can be replaced without waiting.
+    Block *TryClaim(unsigned sector);
+
+    /// Give the block the clock hand chose to `sector`.  `lock` must be
+    /// held, and the block must be clean and not pinned.
+    void Claim(Block *b, unsigned sector);
+
+    /// Release the lock of a block returned by `Get`, and unpin it.
+    void Put(Block *b);
+
+    /// Block holding `sector`, or null.  `lock` must be held.
+    Block *Lookup(unsigned sector) const;
+
+    /// Next block the clock hand finds not pinned nor recently used, or
+    /// null if all of them are pinned.  `lock` must be held.
+    Block *ChooseVictim();
+
+    /// Write `b` back, if dirty.  The lock of the block must be held.
+    void WriteBack(Block *b);
+
+    /// Interrupt handler, waking the flusher up.
+    static void Tick(void *arg);
+
+    /// Body of the flusher thread.
+    static void Run(void *arg);
+
+    Block *blocks;
+    unsigned numBlocks;
+    unsigned hand;        ///< Position of the clock hand.
+    Lock *lock;
+    Condition *unpinned;  ///< Signalled when a block stops being pinned.
+
+    Semaphore *wakeUp;
+    bool waiting;         ///< Whether the flusher is waiting on `wakeUp`.
+    unsigned interval;
+};
+
+
+#endif
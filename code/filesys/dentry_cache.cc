@@ -0,0 +1,84 @@
+/// Copyright (c) 2019-2021 Docentes de la Universidad Nacional de Rosario.
+/// All rights reserved.  See `copyright.h` for copyright notice and
+/// limitation of liability and disclaimer of warranty provisions.
+
+
+#include "dentry_cache.hh"
+#include "threads/system.hh"
+
+
+DentryCache::DentryCache(unsigned aCapacity)
+{
+    ASSERT(aCapacity > 0);
+
+    capacity   = aCapacity;
+    generation = 0;
+}
+
+bool
+DentryCache::Lookup(unsigned parent, const std::string &name,
+                    DirectoryEntry *entry)
+{
+    ASSERT(entry != nullptr);
+
+    auto it = entries.find(Key(parent, name));
+    if (it == entries.end()) {
+        stats->numDentryCacheMisses++;
+        return false;
+    }
+    lru.splice(lru.begin(), lru, it->second.age);
+    *entry = it->second.entry;
+    stats->numDentryCacheHits++;
+    return true;
+}
+
+unsigned
+DentryCache::Generation() const
+{
+    return generation;
+}
+
+void
+DentryCache::Enter(const Key &key, const DirectoryEntry &entry)
+{
+    auto it = entries.find(key);
+    if (it != entries.end()) {
+        lru.splice(lru.begin(), lru, it->second.age);
+        it->second.entry = entry;
+        return;
+    }
+    if (entries.size() == capacity) {
+        entries.erase(lru.back());
+        lru.pop_back();
+    }
+    lru.push_front(key);
+    entries[key] = { entry, lru.begin() };
+}
+
+void
+DentryCache::Fill(unsigned parent, const std::string &name,
+                  const DirectoryEntry &entry, unsigned aGeneration)
+{
+    if (aGeneration == generation) {
+        Enter(Key(parent, name), entry);
+    }
+}
+
+void
+DentryCache::Update(unsigned parent, const std::string &name,
+                    const DirectoryEntry &entry)
+{
+    generation++;
+    Enter(Key(parent, name), entry);
+}
+
+void
+DentryCache::Forget(unsigned parent)
+{
+    generation++;
+    auto it = entries.lower_bound(Key(parent, std::string()));
+    while (it != entries.end() && it->first.first == parent) {
+        lru.erase(it->second.age);
+        it = entries.erase(it);
+    }
+}
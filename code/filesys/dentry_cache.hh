@@ -0,0 +1,79 @@
+/// Cache of directory entries.
+///
+/// Resolving a path used to read every directory along it from the disk,
+/// header and contents, one component after the other, on each `Open`,
+/// `Create` or `Remove`.  The result of looking a name up in a directory is
+/// kept here instead, keyed by the sector of the directory header and the
+/// name, so that paths used again are resolved without touching the disk.
+/// Names found missing are kept as well, as negative entries, since
+/// looking up a file about to be created is just as common.
+///
+/// The file system updates the entries of a directory right after it
+/// writes the directory back with a name added or removed.  The cache is
+/// bounded, dropping the least recently used entries first.
+///
+/// Copyright (c) 2019-2021 Docentes de la Universidad Nacional de Rosario.
+/// All rights reserved.  See `copyright.h` for copyright notice and
+/// limitation of liability and disclaimer of warranty provisions.
+
+#ifndef NACHOS_FILESYS_DENTRYCACHE__HH
+#define NACHOS_FILESYS_DENTRYCACHE__HH
+
+
+#include "directory_entry.hh"
+
+#include <list>
+#include <map>
+#include <string>
+
+
+/// Entries are only touched in memory, and nothing below blocks, so no
+/// lock is needed.  A thread filling an entry in after reading a directory
+/// may have been overtaken by a change to it, however; `Fill` is told the
+/// generation seen before the read, and drops stale results.
+class DentryCache {
+public:
+
+    /// Keep at most `capacity` entries.
+    DentryCache(unsigned capacity);
+
+    /// Look `name` up in the directory whose header is at sector `parent`.
+    /// Return false if it is not cached; otherwise set `entry`, whose
+    /// `inUse` is false if the name is known not to be there.
+    bool Lookup(unsigned parent, const std::string &name,
+                DirectoryEntry *entry);
+
+    /// Current generation, to be passed to `Fill`.
+    unsigned Generation() const;
+
+    /// Cache `entry` as read from the disk, unless some entry changed since
+    /// generation `generation`.
+    void Fill(unsigned parent, const std::string &name,
+              const DirectoryEntry &entry, unsigned generation);
+
+    /// Record that `name` was just added to or removed from `parent`.
+    void Update(unsigned parent, const std::string &name,
+                const DirectoryEntry &entry);
+
+    /// Drop every entry under `parent`, whose sector is being freed.
+    void Forget(unsigned parent);
+
+private:
+
+    typedef std::pair<unsigned, std::string> Key;
+
+    struct Dentry {
+        DirectoryEntry entry;
+        std::list<Key>::iterator age;  ///< Position in `lru`.
+    };
+
+    void Enter(const Key &key, const DirectoryEntry &entry);
+
+    std::map<Key, Dentry> entries;
+    std::list<Key> lru;  ///< Most recently used first.
+    unsigned capacity;
+    unsigned generation;
+};
+
+
+#endif
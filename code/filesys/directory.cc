@@ -1,18 +1,17 @@
 /// Routines to manage a directory of file names.
 ///
-/// The directory is a table of fixed length entries; each entry represents a
-/// single file, and contains the file name, and the location of the file
-/// header on disk.  The fixed size of each directory entry means that we
-/// have the restriction of a fixed maximum size for file names.
+/// Each file is represented by a record holding its name, and the location
+/// of the file header on disk.  Records are of variable length, kept in
+/// leaves of one sector, and a B-tree of index blocks above them is keyed
+/// by a hash of the names.  A leaf that fills up is split
+/// in two by hash, which adds a key to its parent, which may split in turn;
+/// when the root splits, a new root is added above it.  Leaves are not
+/// merged back when names are removed.
 ///
-/// The constructor initializes an empty directory of a certain size; we use
-/// ReadFrom/WriteBack to fetch the contents of the directory from disk, and
-/// to write back any modifications back to disk.
-///
-/// Also, this implementation has the restriction that the size of the
-/// directory cannot expand.  In other words, once all the entries in the
-/// directory are used, no more files can be created.  Fixing this is one of
-/// the parts to the assignment.
+/// Disks formatted before directories were indexed have flat ones instead:
+/// a table of fixed length entries, read whole and searched linearly.
+/// Those are still read as they are, and turned into a tree when a name is
+/// first added to them.
 ///
 /// Copyright (c) 1992-1993 The Regents of the University of California.
 ///               2016-2021 Docentes de la Universidad Nacional de Rosario.
@@ -21,43 +20,111 @@
 
 
 #include "directory.hh"
-#include "directory_entry.hh"
 #include "file_header.hh"
 #include "lib/utility.hh"
 
+#include <algorithm>
 #include <stdio.h>
 #include <string.h>
 
 
+/// Bytes taken in a leaf by a record with a name of `length` characters.
+static unsigned
+RecordSize(unsigned length)
+{
+    return DivRoundUp(unsigned (sizeof (RawDirectoryRecord) + length), 4u) * 4;
+}
+
+/// Bytes taken by the longest record.
+static const unsigned MAX_RECORD_SIZE
+  = (sizeof (RawDirectoryRecord) + FILE_NAME_MAX_LEN + 3) / 4 * 4;
+static_assert(MAX_RECORD_SIZE <= DIRECTORY_LEAF_BYTES,
+              "a leaf must hold any one record");
+
+static const char *
+RecordName(const RawDirectoryRecord *r)
+{
+    return (const char *) (r + 1);
+}
+
+/// Record at byte `offset` of `leaf`.
+static RawDirectoryRecord *
+RecordAt(RawDirectoryLeaf *leaf, unsigned offset)
+{
+    return (RawDirectoryRecord *) &leaf->records[offset];
+}
+
+/// Position of the key in `index` whose block holds names hashing to
+/// `hash`.
+static unsigned
+Route(const RawDirectoryIndex *index, unsigned hash)
+{
+    unsigned lo = 0, hi = index->numKeys;
+    while (hi - lo > 1) {
+        unsigned mid = (lo + hi) / 2;
+        if (index->keys[mid].hash <= hash) {
+            lo = mid;
+        } else {
+            hi = mid;
+        }
+    }
+    return lo;
+}
+
 /// Initialize a directory; initially, the directory is completely empty.  If
-/// the disk is being formatted, an empty directory is all we need, but
-/// otherwise, we need to call FetchFrom in order to initialize it from disk.
-///
-/// * `size` is the number of entries in the directory.
+/// the disk is being formatted, call `Initialize` to get an empty directory,
+/// but otherwise, we need to call FetchFrom in order to initialize it from
+/// disk.
 Directory::Directory()
 {
+    indexed = false;
     raw.table = nullptr;
     raw.tableSize = 0;
+    file = nullptr;
+    headerDirty = false;
 }
 
 /// De-allocate directory data structure.
 Directory::~Directory()
 {
-    if (raw.tableSize > 0)
-        delete [] raw.table;
+    delete [] raw.table;
+}
+
+void
+Directory::Initialize()
+{
+    indexed = true;
+    header.magic      = DIRECTORY_MAGIC;
+    header.numBlocks  = 1;
+    header.numEntries = 0;
+    header.depth      = 0;
+    header.root       = NewBlock();
 }
 
 /// Read the contents of the directory from disk.
 ///
 /// * `file` is file containing the directory contents.
 void
-Directory::FetchFrom(OpenFile *file)
+Directory::FetchFrom(OpenFile *aFile)
 {
-    ASSERT(file != nullptr);
-    file->ReadAt((char *) &raw.tableSize, sizeof (unsigned), 0);
+    ASSERT(aFile != nullptr);
+
+    file = aFile;
+    file->ReadAt((char *) &header, sizeof header, 0);
+    if (header.magic == DIRECTORY_MAGIC) {
+        indexed = true;
+        return;
+    }
+
+    // A flat directory: what was read as the magic is its number of
+    // entries.
+    indexed = false;
+    raw.tableSize = header.magic;
     if (raw.tableSize > 0) {
         raw.table = new DirectoryEntry[raw.tableSize];
-        file->ReadAt((char *) raw.table, raw.tableSize * sizeof (DirectoryEntry), sizeof (unsigned));
+        file->ReadAt((char *) raw.table,
+                     raw.tableSize * sizeof (DirectoryEntry),
+                     sizeof (unsigned));
     }
 }
 
@@ -65,17 +132,107 @@ Directory::FetchFrom(OpenFile *file)
 ///
 /// * `file` is a file to contain the new directory contents.
 void
-Directory::WriteBack(OpenFile *file)
+Directory::WriteBack(OpenFile *aFile)
+{
+    ASSERT(aFile != nullptr);
+
+    if (!indexed) {
+        // Only ever changed in place, by `Remove`.
+        aFile->WriteAt((char *) &raw.tableSize, sizeof (unsigned), 0);
+        if (raw.tableSize > 0) {
+            aFile->WriteAt((char *) raw.table,
+                           raw.tableSize * sizeof (DirectoryEntry),
+                           sizeof (unsigned));
+        }
+        return;
+    }
+
+    if (headerDirty) {
+        aFile->WriteAt((char *) &header, sizeof header, 0);
+        headerDirty = false;
+    }
+    for (unsigned b : dirtyBlocks) {
+        aFile->WriteAt((char *) &blocks.at(b), SECTOR_SIZE, b * SECTOR_SIZE);
+    }
+    dirtyBlocks.clear();
+}
+
+unsigned
+Directory::Size() const
+{
+    if (!indexed) {
+        return sizeof (unsigned) + raw.tableSize * sizeof (DirectoryEntry);
+    }
+    return header.numBlocks * SECTOR_SIZE;
+}
+
+/// FNV-1a.
+unsigned
+Directory::Hash(const char *name, unsigned length)
 {
+    unsigned h = 2166136261u;
+    for (unsigned i = 0; i < length; i++) {
+        h = (h ^ (unsigned char) name[i]) * 16777619u;
+    }
+    return h;
+}
+
+RawDirectoryBlock *
+Directory::LoadBlock(unsigned block)
+{
+    ASSERT(indexed);
+    ASSERT(block > 0 && block < header.numBlocks);
+
+    auto it = blocks.find(block);
+    if (it != blocks.end()) {
+        return &it->second;
+    }
     ASSERT(file != nullptr);
-    file->WriteAt((char *) &raw.tableSize, sizeof (unsigned), 0);
-    
-    if (raw.tableSize > 0)
-        file->WriteAt((char *) raw.table, raw.tableSize * sizeof (DirectoryEntry), sizeof (unsigned));
+    RawDirectoryBlock *b = &blocks[block];
+    file->ReadAt((char *) b, SECTOR_SIZE, block * SECTOR_SIZE);
+    return b;
 }
 
-/// Look up file name in directory, and return its location in the table of
-/// directory entries.  Return -1 if the name is not in the directory.
+unsigned
+Directory::NewBlock()
+{
+    unsigned block = header.numBlocks++;
+    headerDirty = true;
+    RawDirectoryBlock *b = &blocks[block];
+    memset(b, 0, sizeof *b);
+    dirtyBlocks.insert(block);
+    return block;
+}
+
+unsigned
+Directory::FindLeaf(unsigned hash)
+{
+    unsigned block = header.root;
+    for (unsigned depth = header.depth; depth > 0; depth--) {
+        const RawDirectoryIndex *index = &LoadBlock(block)->index;
+        block = index->keys[Route(index, hash)].block;
+    }
+    return block;
+}
+
+RawDirectoryRecord *
+Directory::FindRecord(RawDirectoryLeaf *leaf, const char *name,
+                      unsigned length, unsigned hash)
+{
+    for (unsigned offset = 0; offset < leaf->used; ) {
+        RawDirectoryRecord *r = RecordAt(leaf, offset);
+        if (r->hash == hash && r->nameLength == length
+              && !memcmp(RecordName(r), name, length)) {
+            return r;
+        }
+        offset += RecordSize(r->nameLength);
+    }
+    return nullptr;
+}
+
+/// Look up file name in a flat directory, and return its location in the
+/// table of directory entries.  Return -1 if the name is not in the
+/// directory.
 ///
 /// * `name` is the file name to look up.
 int
@@ -92,6 +249,57 @@ Directory::FindIndex(const char *name)
     return -1;  // name not in directory
 }
 
+void
+Directory::ConvertFlat()
+{
+    ASSERT(!indexed);
+
+    DirectoryEntry *table = raw.table;
+    unsigned tableSize    = raw.tableSize;
+    raw.table     = nullptr;
+    raw.tableSize = 0;
+
+    // The tree is written over the table, from the start of the file.
+    Initialize();
+    for (unsigned i = 0; i < tableSize; i++) {
+        if (table[i].inUse) {
+            bool added = Add(table[i].name, table[i].sector, table[i].isDir);
+            ASSERT(added);
+        }
+    }
+    delete [] table;
+}
+
+bool
+Directory::FindEntry(const char *name, DirectoryEntry *entry)
+{
+    ASSERT(name != nullptr);
+    ASSERT(entry != nullptr);
+
+    if (!indexed) {
+        int i = FindIndex(name);
+        if (i == -1) {
+            return false;
+        }
+        *entry = raw.table[i];
+        return true;
+    }
+
+    unsigned length = strnlen(name, FILE_NAME_MAX_LEN);
+    unsigned hash   = Hash(name, length);
+    const RawDirectoryRecord *r
+      = FindRecord(&LoadBlock(FindLeaf(hash))->leaf, name, length, hash);
+    if (r == nullptr) {
+        return false;
+    }
+    entry->inUse  = true;
+    entry->isDir  = r->isDir;
+    entry->sector = r->sector;
+    memcpy(entry->name, RecordName(r), r->nameLength);
+    entry->name[r->nameLength] = '\0';
+    return true;
+}
+
 /// Look up file name in directory, and return the disk sector number where
 /// the file's header is stored.  Return -1 if the name is not in the
 /// directory.
@@ -102,16 +310,127 @@ Directory::Find(const char *name)
 {
     ASSERT(name != nullptr);
 
-    int i = FindIndex(name);
-    if (i != -1) {
-        return raw.table[i].sector;
+    DirectoryEntry entry;
+    if (FindEntry(name, &entry)) {
+        return entry.sector;
     }
     return -1;
 }
 
+bool
+Directory::InsertInLeaf(unsigned block, const RawDirectoryRecord *record,
+                        unsigned *splitHash, unsigned *splitBlock)
+{
+    RawDirectoryLeaf *leaf = &LoadBlock(block)->leaf;
+    unsigned size = RecordSize(record->nameLength);
+    *splitBlock = 0;
+    if (leaf->used + size <= DIRECTORY_LEAF_BYTES) {
+        memcpy(&leaf->records[leaf->used], record, size);
+        leaf->used += size;
+        dirtyBlocks.insert(block);
+        return true;
+    }
+
+    // Sort the records by hash, and cut where both halves fit, as evenly
+    // as possible.  Names hashing the same must stay in the same leaf.
+    std::vector<const RawDirectoryRecord *> all;
+    for (unsigned offset = 0; offset < leaf->used; ) {
+        const RawDirectoryRecord *r = RecordAt(leaf, offset);
+        all.push_back(r);
+        offset += RecordSize(r->nameLength);
+    }
+    all.push_back(record);
+    std::stable_sort(all.begin(), all.end(),
+                     [](const RawDirectoryRecord *a,
+                        const RawDirectoryRecord *b) {
+        return a->hash < b->hash;
+    });
+
+    unsigned total = leaf->used + size;
+    unsigned cut = 0, best = 0, before = 0;
+    for (unsigned k = 1; k < all.size(); k++) {
+        before += RecordSize(all[k - 1]->nameLength);
+        unsigned after = total - before;
+        if (all[k - 1]->hash == all[k]->hash
+              || before > DIRECTORY_LEAF_BYTES
+              || after > DIRECTORY_LEAF_BYTES) {
+            continue;
+        }
+        unsigned diff = before > after ? before - after : after - before;
+        if (cut == 0 || diff < best) {
+            cut  = k;
+            best = diff;
+        }
+    }
+    if (cut == 0) {
+        return false;
+    }
+
+    // The records point into the leaf, so build both halves apart first.
+    RawDirectoryLeaf halves[2];
+    memset(halves, 0, sizeof halves);
+    for (unsigned k = 0; k < all.size(); k++) {
+        RawDirectoryLeaf *half = &halves[k < cut ? 0 : 1];
+        unsigned rsize = RecordSize(all[k]->nameLength);
+        memcpy(&half->records[half->used], all[k], rsize);
+        half->used += rsize;
+    }
+    *splitHash  = all[cut]->hash;
+    *splitBlock = NewBlock();
+    *leaf = halves[0];
+    blocks[*splitBlock].leaf = halves[1];
+    dirtyBlocks.insert(block);
+    return true;
+}
+
+bool
+Directory::Insert(unsigned block, unsigned depth,
+                  const RawDirectoryRecord *record,
+                  unsigned *splitHash, unsigned *splitBlock)
+{
+    if (depth == 0) {
+        return InsertInLeaf(block, record, splitHash, splitBlock);
+    }
+
+    RawDirectoryIndex *index = &LoadBlock(block)->index;
+    unsigned i = Route(index, record->hash);
+    unsigned childHash, childBlock;
+    if (!Insert(index->keys[i].block, depth - 1, record,
+                &childHash, &childBlock)) {
+        return false;
+    }
+    *splitBlock = 0;
+    if (childBlock == 0) {
+        return true;
+    }
+
+    // Add a key for the new child right after the one that split.
+    RawDirectoryKey keys[NUM_DIRECTORY_KEYS + 1];
+    unsigned numKeys = index->numKeys + 1;
+    memcpy(keys, index->keys, (i + 1) * sizeof *keys);
+    keys[i + 1] = { childHash, childBlock };
+    memcpy(&keys[i + 2], &index->keys[i + 1],
+           (index->numKeys - i - 1) * sizeof *keys);
+    dirtyBlocks.insert(block);
+
+    unsigned keep = numKeys;
+    if (numKeys > NUM_DIRECTORY_KEYS) {
+        keep = numKeys / 2;
+        *splitBlock = NewBlock();
+        *splitHash  = keys[keep].hash;
+        RawDirectoryIndex *right = &blocks[*splitBlock].index;
+        right->numKeys = numKeys - keep;
+        memcpy(right->keys, &keys[keep], right->numKeys * sizeof *keys);
+    }
+    index->numKeys = keep;
+    memcpy(index->keys, keys, keep * sizeof *keys);
+    return true;
+}
+
 /// Add a file into the directory.  Return true if successful; return false
-/// if the file name is already in the directory, or if the directory is
-/// completely full, and has no more space for additional file names.
+/// if the file name is already in the directory, or if there is no room
+/// for it.  The file may have to be extended to `Size` afterwards, which a
+/// flat directory, turned into a tree here, always needs.
 ///
 /// * `name` is the name of the file being added.
 /// * `newSector` is the disk sector containing the added file's header.
@@ -119,35 +438,39 @@ bool
 Directory::Add(const char *name, int newSector, bool isDir)
 {
     ASSERT(name != nullptr);
-    bool shouldExtend = false;
 
-    if (FindIndex(name) != -1) {
+    if (Find(name) != -1) {
         return false;
     }
-
-    unsigned i = 0;
-    for (; i < raw.tableSize; i++) {
-        if (!raw.table[i].inUse) 
-            break;
+    if (!indexed) {
+        ConvertFlat();
     }
 
-    if (i == raw.tableSize) {
-        shouldExtend = true;
-        DirectoryEntry* newTable = new DirectoryEntry[raw.tableSize + 1];
-        if (raw.tableSize > 0) {
-            memcpy(newTable, raw.table, raw.tableSize * sizeof (DirectoryEntry));
-            delete[] raw.table;
-        }
-        raw.table = newTable;
-        raw.tableSize++;
-    }
-
-    raw.table[i].isDir = isDir;
-    raw.table[i].inUse = true;
-    strncpy(raw.table[i].name, name, FILE_NAME_MAX_LEN);
-    raw.table[i].sector = newSector;
+    unsigned buffer[MAX_RECORD_SIZE / sizeof (unsigned)];
+    RawDirectoryRecord *record = (RawDirectoryRecord *) buffer;
+    memset(buffer, 0, sizeof buffer);
+    record->nameLength = strnlen(name, FILE_NAME_MAX_LEN);
+    record->hash       = Hash(name, record->nameLength);
+    record->sector     = newSector;
+    record->isDir      = isDir;
+    memcpy(record + 1, name, record->nameLength);
 
-    return shouldExtend;
+    unsigned splitHash, splitBlock;
+    if (!Insert(header.root, header.depth, record, &splitHash, &splitBlock)) {
+        return false;
+    }
+    if (splitBlock != 0) {
+        unsigned root = NewBlock();
+        RawDirectoryIndex *index = &blocks[root].index;
+        index->numKeys = 2;
+        index->keys[0] = { 0, header.root };
+        index->keys[1] = { splitHash, splitBlock };
+        header.root = root;
+        header.depth++;
+    }
+    header.numEntries++;
+    headerDirty = true;
+    return true;
 }
 
 /// Remove a file name from the directory.   Return true if successful;
@@ -159,58 +482,125 @@ Directory::Remove(const char *name)
 {
     ASSERT(name != nullptr);
 
-    int i = FindIndex(name);
-    if (i == -1) {
-        return false;  // name not in directory
+    if (!indexed) {
+        // Kept flat: clearing the entry takes no room, unlike the tree.
+        int i = FindIndex(name);
+        if (i == -1) {
+            return false;  // name not in directory
+        }
+        raw.table[i].inUse = false;
+        return true;
+    }
+
+    unsigned length = strnlen(name, FILE_NAME_MAX_LEN);
+    unsigned hash   = Hash(name, length);
+    unsigned block  = FindLeaf(hash);
+    RawDirectoryLeaf *leaf = &LoadBlock(block)->leaf;
+    RawDirectoryRecord *r = FindRecord(leaf, name, length, hash);
+    if (r == nullptr) {
+        return false;
     }
-    raw.table[i].inUse = false;
+    unsigned offset = (char *) r - leaf->records;
+    unsigned size   = RecordSize(r->nameLength);
+    memmove(r, &leaf->records[offset + size], leaf->used - offset - size);
+    leaf->used -= size;
+    dirtyBlocks.insert(block);
+    header.numEntries--;
+    headerDirty = true;
     return true;
 }
 
-/// List all the file names in the directory.
-void
-Directory::List() const
+bool
+Directory::IsEmpty()
 {
+    if (indexed) {
+        return header.numEntries == 0;
+    }
     for (unsigned i = 0; i < raw.tableSize; i++) {
         if (raw.table[i].inUse) {
-            printf("%s\n", raw.table[i].name);
+            return false;
         }
     }
+    return true;
 }
 
-/// List all the file names in the directory, their `FileHeader` locations,
-/// and the contents of each file.  For debugging.
 void
-Directory::Print() const
+Directory::GetEntries(std::vector<DirectoryEntry> *entries)
 {
-    FileHeader *hdr = new FileHeader;
+    ASSERT(entries != nullptr);
 
-    printf("Directory contents:\n");
+    if (indexed) {
+        GetEntries(header.root, header.depth, entries);
+        return;
+    }
     for (unsigned i = 0; i < raw.tableSize; i++) {
         if (raw.table[i].inUse) {
-            printf("\nDirectory entry:\n"
-                   "    name: %s\n"
-                   "    sector: %u\n",
-                   raw.table[i].name, raw.table[i].sector);
-            hdr->FetchFrom(raw.table[i].sector);
-            hdr->Print(nullptr);
+            entries->push_back(raw.table[i]);
         }
     }
-    printf("\n");
-    delete hdr;
 }
 
-const RawDirectory *
-Directory::GetRaw() const
+void
+Directory::GetEntries(unsigned block, unsigned depth,
+                      std::vector<DirectoryEntry> *entries)
+{
+    RawDirectoryBlock *b = LoadBlock(block);
+    if (depth > 0) {
+        // Copied, since loading the children may read more blocks in.
+        RawDirectoryIndex index = b->index;
+        for (unsigned i = 0; i < index.numKeys; i++) {
+            GetEntries(index.keys[i].block, depth - 1, entries);
+        }
+        return;
+    }
+    for (unsigned offset = 0; offset < b->leaf.used; ) {
+        const RawDirectoryRecord *r = RecordAt(&b->leaf, offset);
+        DirectoryEntry e;
+        e.inUse  = true;
+        e.isDir  = r->isDir;
+        e.sector = r->sector;
+        memcpy(e.name, RecordName(r), r->nameLength);
+        e.name[r->nameLength] = '\0';
+        entries->push_back(e);
+        offset += RecordSize(r->nameLength);
+    }
+}
+
+/// List all the file names in the directory.
+void
+Directory::List()
 {
-    return &raw;
+    std::vector<DirectoryEntry> entries;
+    GetEntries(&entries);
+    for (const DirectoryEntry &e : entries) {
+        printf("%s\n", e.name);
+    }
 }
 
+/// List all the file names in the directory, their `FileHeader` locations,
+/// and the contents of each file.  For debugging.
 void
-Directory::SetInitialValue(unsigned size) {
-    raw.tableSize = size;
-    raw.table = new DirectoryEntry[size];
-    for (unsigned i = size; i > 0; i--) {
-        raw.table[i-1].inUse = false;
+Directory::Print()
+{
+    FileHeader *hdr = new FileHeader;
+    std::vector<DirectoryEntry> entries;
+    GetEntries(&entries);
+
+    printf("Directory contents:\n");
+    if (indexed) {
+        printf("    indexed, %u names, %u blocks, depth %u\n",
+               header.numEntries, header.numBlocks, header.depth);
+    } else {
+        printf("    flat, %u entries\n", raw.tableSize);
     }
-}
\ No newline at end of file
+    for (const DirectoryEntry &e : entries) {
+        printf("\nDirectory entry:\n"
+               "    name: %s\n"
+               "    sector: %u\n",
+               e.name, e.sector);
+        hdr->FetchFrom(e.sector);
+        hdr->Print(nullptr);
+    }
+    printf("\n");
+    delete hdr;
+}
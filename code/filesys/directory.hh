@@ -16,8 +16,13 @@
 
 
 #include "raw_directory.hh"
+#include "directory_entry.hh"
 #include "open_file.hh"
 
+#include <map>
+#include <set>
+#include <vector>
+
 
 /// The following class defines a UNIX-like “directory”.  Each entry in the
 /// directory describes a file, and where to find it on disk.
@@ -28,51 +33,122 @@
 /// The constructor initializes a directory structure in memory; the
 /// `FetchFrom`/`WriteBack` operations shuffle the directory information
 /// from/to disk.
+///
+/// A directory is a B-tree keyed by a hash of the names: `FetchFrom` only
+/// reads the header, a lookup reads one block per level of the tree, and
+/// `WriteBack` only writes the blocks changed.  Flat directories, left by
+/// older versions, are a table read and written whole, and searched
+/// linearly; they keep their format until a name is added to them.
 class Directory {
 public:
 
-    /// Initialize an empty directory with space for `size` files.
+    /// Initialize an empty directory, to be fetched from disk.
     Directory();
 
     /// De-allocate the directory.
     ~Directory();
 
-    /// Initialize directory contents from disk.
+    /// Make this an empty directory, for a new one.
+    void Initialize();
+
+    /// Initialize directory contents from disk.  Blocks of an indexed
+    /// directory keep being read from `file` as needed, so it must stay
+    /// open.
     void FetchFrom(OpenFile *file);
 
     /// Write modifications to directory contents back to disk.
     void WriteBack(OpenFile *file);
 
+    /// Bytes the directory takes in its file, changes included.  The file
+    /// must be extended to that before writing back.
+    unsigned Size() const;
+
     /// Find the sector number of the `FileHeader` for file: `name`.
     int Find(const char *name);
 
+    /// Find the entry for `name`, and copy it into `entry`.  Return false
+    /// if there is none.
+    bool FindEntry(const char *name, DirectoryEntry *entry);
+
     /// Add a file name into the directory.
     bool Add(const char *name, int newSector, bool isDir = false);
 
     /// Remove a file from the directory.
     bool Remove(const char *name);
 
+    /// Whether the directory has no files in it.
+    bool IsEmpty();
+
+    /// Append every entry in use to `entries`.
+    void GetEntries(std::vector<DirectoryEntry> *entries);
+
     /// Print the names of all the files in the directory.
-    void List() const;
+    void List();
 
     /// Verbose print of the contents of the directory -- all the file names
     /// and their contents.
-    void Print() const;
-
-    /// Get the raw directory structure.
-    ///
-    /// NOTE: this should only be used by routines that operating on the file
-    /// system at a low level.
-    const RawDirectory *GetRaw() const;
-    
-    /// Find the index into the directory table corresponding to `name`.
+    void Print();
+
+private:
+
+    /// Find the index into the table of a flat directory corresponding to
+    /// `name`.
     int FindIndex(const char *name);
 
-    void SetInitialValue(unsigned size);
+    /// Turn a flat directory into an indexed one with the same entries.
+    void ConvertFlat();
 
-private:
+    /// Hash of the first `length` characters of `name`.
+    static unsigned Hash(const char *name, unsigned length);
+
+    /// Block `block` of an indexed directory, read if it was not yet.
+    RawDirectoryBlock *LoadBlock(unsigned block);
 
+    /// Add a block at the end of the file, and mark it changed.
+    unsigned NewBlock();
+
+    /// Leaf where names hashing to `hash` belong.
+    unsigned FindLeaf(unsigned hash);
+
+    /// Record for `name`, of length `length` and hash `hash`, in leaf
+    /// `leaf`, or null.
+    RawDirectoryRecord *FindRecord(RawDirectoryLeaf *leaf, const char *name,
+                                   unsigned length, unsigned hash);
+
+    /// Insert `record` under block `block`, `depth` levels above the
+    /// leaves.  If the block splits, `splitBlock` is set to the new one,
+    /// holding hashes from `splitHash` on; otherwise it is set to 0.
+    /// Return false, changing nothing, if a full leaf cannot be split
+    /// because all of its names hash the same.
+    bool Insert(unsigned block, unsigned depth,
+                const RawDirectoryRecord *record,
+                unsigned *splitHash, unsigned *splitBlock);
+
+    /// Add `record` to `leaf`, splitting it if it does not fit.
+    bool InsertInLeaf(unsigned leaf, const RawDirectoryRecord *record,
+                      unsigned *splitHash, unsigned *splitBlock);
+
+    /// Append the entries under block `block` to `entries`.
+    void GetEntries(unsigned block, unsigned depth,
+                    std::vector<DirectoryEntry> *entries);
+
+    bool indexed;
+
+    /// Flat directory.
     RawDirectory raw;
+
+    /// Indexed directory.
+    RawDirectoryHeader header;
+    OpenFile *file;  ///< Where blocks are read from.
+
+    /// Blocks read or added so far, by number.
+    std::map<unsigned, RawDirectoryBlock> blocks;
+
+    /// Whether `header` changed since it was read or written.
+    bool headerDirty;
+
+    /// Blocks changed since they were read or written.
+    std::set<unsigned> dirtyBlocks;
 };
 
 
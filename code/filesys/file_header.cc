@@ -2,11 +2,18 @@
 /// the i-node).
 ///
 /// The file header is used to locate where on disk the file's data is
-/// stored.  We implement this as a fixed size table of pointers -- each
-/// entry in the table points to the disk sector containing that portion of
-/// the file data (in other words, there are no indirect or doubly indirect
-/// blocks). The table size is chosen so that the file header will be just
-/// big enough to fit in one disk sector,
+/// stored.  We implement this as a tree of extents -- each extent says that
+/// a run of sectors of the file is stored in as many consecutive sectors on
+/// disk.  The root of the tree is in the file header, which is just big
+/// enough to fit in one disk sector; only files in many pieces need more
+/// levels, in sectors of their own.
+///
+/// When allocating, the sectors right after the last extent of the file are
+/// preferred, so that the extent just grows; otherwise the first run of
+/// free sectors long enough for all of them, or else for half of them, and
+/// so on.  Data
+/// written sequentially thus ends up in consecutive sectors, and even large
+/// files take a handful of extents.
 ///
 /// Unlike in a real system, we do not keep track of file permissions,
 /// ownership, last modification date, etc., in the file header.
@@ -35,68 +42,20 @@
 /// there are not enough free blocks to accomodate the new file.
 ///
 /// * `freeMap` is the bit map of free disk sectors.
-/// * `fileSize` is the bit map of free disk sectors.
+/// * `fileSize` is the size of the file in bytes.
 bool
 FileHeader::Allocate(Bitmap *freeMap, unsigned fileSize)
 {
     ASSERT(freeMap != nullptr);
 
-    if (fileSize > MAX_FILE_SIZE) {
-        return false;
-    }
-
-    // Calculamos la cantidad de sectores que vamos a necesitar para el file header
-    raw.numBytes = fileSize;
-    raw.numSectors = DivRoundUp(fileSize, SECTOR_SIZE);
-
-    unsigned fhSectorsToAllocate = 0;
-    int remainingSectors = raw.numSectors - NUM_DIRECT;
-    if (remainingSectors > 0) {
-        fhSectorsToAllocate++;
-        raw.fiQuantity = std::min((unsigned)remainingSectors, NUM_DIRECT2);
-        remainingSectors -= NUM_DIRECT2;
-        if (remainingSectors > 0) {
-            fhSectorsToAllocate++;
-            raw.siQuantity = remainingSectors;
-            fhSectorsToAllocate += DivRoundUp((unsigned)remainingSectors, NUM_DIRECT2);
-        }
-    }
-
-    if (freeMap->CountClear() < raw.numSectors + fhSectorsToAllocate) {
-        return false;  // Not enough space.
-    }
-
-    // Asignamos los sectores del file header
-    remainingSectors = raw.numSectors;
-    unsigned min = std::min((unsigned)remainingSectors, NUM_DIRECT);
-    for (unsigned i = 0; i < min; i++) {
-        raw.dataSectors[i] = freeMap->Find();
-    }
-    remainingSectors -= NUM_DIRECT;
-    if (remainingSectors > 0) {
-        raw.firstIndirection = freeMap->Find();
-        for (unsigned i = 0; i < raw.fiQuantity; i++) {
-            firstInd.dataSectors[i] = freeMap->Find();
-        }
-        remainingSectors -= NUM_DIRECT2;
-
-        if (remainingSectors > 0) {
-            raw.secondIndirection = freeMap->Find();
-            unsigned i = 0;
-            while (remainingSectors > 0) {
-                secondInd.dataSectors[i] = freeMap->Find();
-                RawFileIndirection aux;
-                min = std::min((unsigned)remainingSectors, NUM_DIRECT2);
-                for (unsigned j = 0; j < min; j++) {
-                    aux.dataSectors[j] = freeMap->Find();
-                }
-                secondIndArray.push_back(aux);
-                remainingSectors -= NUM_DIRECT2;
-                i++;
-            }
-        }
-    }
-    return true;
+    raw.numBytes   = 0;
+    raw.numSectors = 0;
+    raw.numExtents = 0;
+    raw.depth      = 0;
+    nodes.clear();
+    rawDirty = true;
+    dirtyNodes.clear();
+    return Extend(freeMap, fileSize);
 }
 
 bool
@@ -110,88 +69,182 @@ FileHeader::Extend(Bitmap *freeMap, unsigned extendSize)
         return false;
     }
 
-    // si el espacio sobrante del ultimo sector es menor al que queremos agregar
-    if (extendSize <= (raw.numSectors * SECTOR_SIZE - raw.numBytes)) {
-        raw.numBytes += extendSize;
-        return true;
+    unsigned numSectors = DivRoundUp(raw.numBytes + extendSize, SECTOR_SIZE);
+    if (numSectors > raw.numSectors) {
+        if (freeMap->CountClear() < numSectors - raw.numSectors) {
+            return false;  // Not enough space.
+        }
+
+        // The nodes of the tree may still not fit; then put everything
+        // back as it was.
+        RawFileHeader oldRaw = raw;
+        std::map<unsigned, RawExtentNode> oldNodes = nodes;
+        std::set<unsigned> oldDirtyNodes = dirtyNodes;
+        std::vector<unsigned> taken;
+        if (!Grow(freeMap, numSectors - raw.numSectors, &taken)) {
+            for (unsigned s : taken) {
+                freeMap->Clear(s);
+            }
+            raw        = oldRaw;
+            nodes      = oldNodes;
+            dirtyNodes = oldDirtyNodes;
+            return false;
+        }
     }
+    raw.numBytes += extendSize;
+    rawDirty = true;
+    return true;
+}
 
-    // Calculamos la cantidad de sectores que vamos a necesitar para el file header
-    unsigned sectorsToAllocate = DivRoundUp(raw.numBytes + extendSize, SECTOR_SIZE) - raw.numSectors;
-    unsigned totalSectors = sectorsToAllocate + raw.numSectors;
-    unsigned headerSectorsToAllocate = 0;
-
-    if (raw.firstIndirection == -1 && totalSectors > NUM_DIRECT) {
-        headerSectorsToAllocate++;
-    } 
-    if (totalSectors > NUM_DIRECT + NUM_DIRECT2) {
-        if (raw.secondIndirection == -1) {
-            headerSectorsToAllocate += DivRoundUp(totalSectors - (NUM_DIRECT + NUM_DIRECT2), NUM_DIRECT2) + 1;
-        } else {
-            headerSectorsToAllocate += (DivRoundUp(totalSectors - (NUM_DIRECT + NUM_DIRECT2), NUM_DIRECT2) - DivRoundUp(raw.siQuantity, NUM_DIRECT2));
+bool
+FileHeader::Grow(Bitmap *freeMap, unsigned length,
+                 std::vector<unsigned> *taken)
+{
+    ASSERT(freeMap != nullptr);
+    ASSERT(taken != nullptr);
+
+    while (length > 0) {
+        RawExtent run = { raw.numSectors, 0, 0 };
+        if (raw.numSectors > 0) {
+            const RawExtent *last = FindExtent(raw.numSectors - 1);
+            run.start = last->start + last->length;
+            for (unsigned s = run.start; run.length < length
+                                           && s < NUM_SECTORS
+                                           && !freeMap->Test(s); s++) {
+                freeMap->Mark(s);
+                taken->push_back(s);
+                run.length++;
+            }
+        }
+        if (run.length == 0) {
+            unsigned want = length;
+            int start;
+            while ((start = freeMap->FindRun(want)) == -1 && want > 1) {
+                want /= 2;
+            }
+            if (start == -1) {
+                return false;
+            }
+            run.start  = start;
+            run.length = want;
+            for (unsigned s = start; s < start + want; s++) {
+                taken->push_back(s);
+            }
+        }
+        if (!AppendRun(freeMap, run, taken)) {
+            return false;
         }
+        raw.numSectors += run.length;
+        length -= run.length;
     }
+    return true;
+}
 
-    if (freeMap->CountClear() < sectorsToAllocate + headerSectorsToAllocate) {
+bool
+FileHeader::AppendRun(Bitmap *freeMap, const RawExtent &run,
+                      std::vector<unsigned> *taken)
+{
+    ASSERT(run.first == raw.numSectors);
+
+    // Unless the last extent just grows, this may take a new root and a
+    // new path of nodes under it.
+    bool merges = false;
+    if (raw.numSectors > 0) {
+        const RawExtent *last = FindExtent(raw.numSectors - 1);
+        merges = last->start + last->length == run.start;
+    }
+    if (!merges && freeMap->CountClear() < raw.depth + 2) {
         return false;
     }
 
-    // Direct allocation
-    if (raw.numSectors < NUM_DIRECT) {
-        for (unsigned i = raw.numSectors; i < NUM_DIRECT && sectorsToAllocate != 0; i++) {
-            raw.dataSectors[i] = freeMap->Find();
-            sectorsToAllocate--;
-        }
+    if (AppendTo(raw.extents, &raw.numExtents, NUM_ROOT_EXTENTS, raw.depth,
+                 run, freeMap, taken)) {
+        return true;
     }
 
-    // First indirection allocation
-    if (sectorsToAllocate != 0 && raw.numSectors < NUM_DIRECT + NUM_DIRECT2) {
-        if (raw.firstIndirection == -1)
-            raw.firstIndirection = freeMap->Find();
-        for (unsigned i = raw.fiQuantity; i < NUM_DIRECT2 && sectorsToAllocate != 0; i++) {
-            firstInd.dataSectors[i] = freeMap->Find();
-            sectorsToAllocate--;
-            raw.fiQuantity++;
-        }
+    // The tree is full: move the entries of the root to a node of their
+    // own, one level down.
+    int sector = freeMap->Find();
+    ASSERT(sector != -1);
+    taken->push_back(sector);
+    RawExtentNode *node = &nodes[sector];
+    dirtyNodes.insert(sector);
+    node->numExtents = raw.numExtents;
+    node->depth      = raw.depth;
+    for (unsigned i = 0; i < raw.numExtents; i++) {
+        node->extents[i] = raw.extents[i];
     }
+    raw.numExtents = 1;
+    raw.depth++;
+    raw.extents[0] = { 0, raw.numSectors, (unsigned) sector };
 
-    // Second indirection prep
-    if (sectorsToAllocate != 0) {
-        if (raw.secondIndirection == -1)
-            raw.secondIndirection = freeMap->Find();
-        
-        unsigned index = DivRoundDown(raw.siQuantity, NUM_DIRECT2);
-
-        if (secondIndArray.size() == index + 1) {
-            for (unsigned i = raw.siQuantity % NUM_DIRECT2; i < NUM_DIRECT2 && sectorsToAllocate != 0; i++) {
-                secondIndArray[index].dataSectors[i] = freeMap->Find();
-                raw.siQuantity++;
-                sectorsToAllocate--;
+    bool appended = AppendTo(raw.extents, &raw.numExtents, NUM_ROOT_EXTENTS,
+                             raw.depth, run, freeMap, taken);
+    ASSERT(appended);
+    return true;
+}
+
+bool
+FileHeader::AppendTo(RawExtent *extents, unsigned *num, unsigned capacity,
+                     unsigned depth, const RawExtent &run, Bitmap *freeMap,
+                     std::vector<unsigned> *taken)
+{
+    ASSERT(extents != nullptr);
+    ASSERT(num != nullptr);
+
+    if (depth == 0) {
+        if (*num > 0) {
+            RawExtent *last = &extents[*num - 1];
+            if (last->start + last->length == run.start) {
+                last->length += run.length;
+                return true;
             }
-            index++;
         }
-        
-        // Second indirection allocation
-        while (sectorsToAllocate > 0) {
-            RawFileIndirection aux;
-            secondInd.dataSectors[index] = freeMap->Find();
-            unsigned min = std::min((unsigned)sectorsToAllocate, NUM_DIRECT2);
-            for (unsigned i = 0; i < min; i++) {
-                aux.dataSectors[i] = freeMap->Find();
-                raw.siQuantity++;
-            }
-            secondIndArray.push_back(aux);
-            sectorsToAllocate -= min;
-            index++;
+        if (*num == capacity) {
+            return false;
         }
+        extents[(*num)++] = run;
+        return true;
     }
 
-    raw.numBytes += extendSize;
-    raw.numSectors = DivRoundUp(raw.numBytes, SECTOR_SIZE);
+    ASSERT(*num > 0);
+    RawExtent *last = &extents[*num - 1];
+    RawExtentNode *child = LoadNode(last->start);
+    if (AppendTo(child->extents, &child->numExtents, NUM_NODE_EXTENTS,
+                 depth - 1, run, freeMap, taken)) {
+        dirtyNodes.insert(last->start);
+        last->length += run.length;
+        return true;
+    }
+    if (*num == capacity) {
+        return false;
+    }
+    extents[(*num)++] = { run.first, run.length,
+                          NewPath(depth - 1, run, freeMap, taken) };
     return true;
 }
 
-/// De-allocate all the space allocated for data blocks for this file.
+unsigned
+FileHeader::NewPath(unsigned depth, const RawExtent &run, Bitmap *freeMap,
+                    std::vector<unsigned> *taken)
+{
+    int sector = freeMap->Find();
+    ASSERT(sector != -1);  // `AppendRun` made sure there is room.
+    taken->push_back(sector);
+
+    RawExtentNode *node = &nodes[sector];
+    dirtyNodes.insert(sector);
+    node->numExtents = 1;
+    node->depth      = depth;
+    node->extents[0] = run;
+    if (depth > 0) {
+        node->extents[0].start = NewPath(depth - 1, run, freeMap, taken);
+    }
+    return sector;
+}
+
+/// De-allocate all the space allocated for data blocks for this file, and
+/// for the nodes of its extent tree.
 ///
 /// * `freeMap` is the bit map of free disk sectors.
 void
@@ -199,86 +252,57 @@ FileHeader::Deallocate(Bitmap *freeMap)
 {
     ASSERT(freeMap != nullptr);
 
-    unsigned min = std::min(raw.numSectors, NUM_DIRECT);
-    for (unsigned i = 0; i < min; i++) {
-        ASSERT(freeMap->Test(raw.dataSectors[i]));  // ought to be marked!
-        freeMap->Clear(raw.dataSectors[i]);
-    }
-    
-    if (raw.firstIndirection != -1) {
-        for (unsigned i = 0; i < raw.fiQuantity; i++) {
-            ASSERT(freeMap->Test(firstInd.dataSectors[i]));  // ought to be marked!
-            freeMap->Clear(firstInd.dataSectors[i]);
-        }
-
-        ASSERT(freeMap->Test(raw.firstIndirection));  // ought to be marked!
-        freeMap->Clear(raw.firstIndirection);   
-    }
+    DeallocateExtents(raw.extents, raw.numExtents, raw.depth, freeMap);
+}
 
-    if (raw.secondIndirection != -1) {
-        unsigned index = 0;
-        for (unsigned i = 0; i < raw.siQuantity; i++) {
-            unsigned pos = i%NUM_DIRECT2;
-            ASSERT(freeMap->Test(secondIndArray[index].dataSectors[pos]));  // ought to be marked!
-            freeMap->Clear(secondIndArray[index].dataSectors[pos]);
-            if ((i+1)%NUM_DIRECT2 == 0) {
-                ASSERT(freeMap->Test(secondInd.dataSectors[index]));  // ought to be marked!
-                freeMap->Clear(secondInd.dataSectors[index]);   
-                index++;
-            }
+void
+FileHeader::DeallocateExtents(const RawExtent *extents, unsigned num,
+                              unsigned depth, Bitmap *freeMap)
+{
+    for (unsigned i = 0; i < num; i++) {
+        const RawExtent *e = &extents[i];
+        unsigned length = e->length;
+        if (depth > 0) {
+            const RawExtentNode *node = GetNode(e->start);
+            DeallocateExtents(node->extents, node->numExtents, depth - 1,
+                              freeMap);
+            length = 1;  // Just the node itself.
+        }
+        for (unsigned s = e->start; s < e->start + length; s++) {
+            ASSERT(freeMap->Test(s));  // ought to be marked!
+            freeMap->Clear(s);
         }
-        ASSERT(freeMap->Test(secondInd.dataSectors[index]));  // ought to be marked!
-        freeMap->Clear(secondInd.dataSectors[index]);  
-
-        ASSERT(freeMap->Test(raw.secondIndirection));  // ought to be marked!
-        freeMap->Clear(raw.secondIndirection);   
     }
 }
 
-/// Fetch contents of file header from disk.
+/// Fetch contents of file header from disk.  Nodes of the extent tree are
+/// read later on, as they are needed.
 ///
 /// * `sector` is the disk sector containing the file header.
 void
 FileHeader::FetchFrom(unsigned sector)
 {
-    synchDisk->ReadSector(sector, (char *) &raw);
-    if (raw.firstIndirection != -1) {
-        synchDisk->ReadSector(raw.firstIndirection, (char *) &firstInd);
-        if (raw.secondIndirection != -1) {
-            synchDisk->ReadSector(raw.secondIndirection, (char *) &secondInd);
-            secondIndArray.clear();
-            RawFileIndirection aux;
-            unsigned read = 0;
-            for (unsigned i = 0; read < raw.siQuantity; i++) {
-                synchDisk->ReadSector(secondInd.dataSectors[i], (char *) &aux);
-                secondIndArray.push_back(aux);
-                read += NUM_DIRECT2;
-            }
-        }
-    }
+    bufferCache->ReadSector(sector, (char *) &raw);
+    nodes.clear();
+    rawDirty = false;
+    dirtyNodes.clear();
 }
 
-/// Write the modified contents of the file header back to disk.
+/// Write the modified contents of the file header back to disk: the header
+/// itself, if it changed, and the nodes of the extent tree that changed.
 ///
 /// * `sector` is the disk sector to contain the file header.
 void
 FileHeader::WriteBack(unsigned sector)
 {
-    synchDisk->WriteSector(sector, (char *) &raw);
-    if (raw.firstIndirection != -1) {
-        synchDisk->WriteSector(raw.firstIndirection, (char *) &firstInd);
-        if (raw.secondIndirection != -1) {
-            synchDisk->WriteSector(raw.secondIndirection, (char *) &secondInd);
-
-            RawFileIndirection aux;
-            unsigned wrote = 0;
-            for (unsigned i = 0; wrote < raw.siQuantity; i++) {
-                aux = secondIndArray[i];
-                synchDisk->WriteSector(secondInd.dataSectors[i], (char *) &aux);
-                wrote += NUM_DIRECT2;
-            }
-        }
+    if (rawDirty) {
+        bufferCache->WriteSector(sector, (char *) &raw);
+        rawDirty = false;
+    }
+    for (unsigned s : dirtyNodes) {
+        bufferCache->WriteSector(s, (char *) &nodes.at(s));
     }
+    dirtyNodes.clear();
 }
 
 /// Return which disk sector is storing a particular byte within the file.
@@ -288,24 +312,38 @@ FileHeader::WriteBack(unsigned sector)
 ///
 /// * `offset` is the location within the file of the byte in question.
 unsigned
-FileHeader::ByteToSector(unsigned offset)   
+FileHeader::ByteToSector(unsigned offset)
 {
-    return *(GetSector(offset / SECTOR_SIZE));
+    unsigned index = offset / SECTOR_SIZE;
+    const RawExtent *e = FindExtent(index);
+    return e->start + (index - e->first);
 }
 
-unsigned*
-FileHeader::GetSector(unsigned index)
+const RawExtent *
+FileHeader::FindExtent(unsigned index)
 {
-    if (index < NUM_DIRECT)
-        return &(raw.dataSectors[index]);
-
-    index -= NUM_DIRECT;
-    if (index < NUM_DIRECT2)
-        return &(firstInd.dataSectors[index]);
-
-    index -= NUM_DIRECT2;
-    unsigned tabnum = index/NUM_DIRECT2;
-    return &(secondIndArray[tabnum].dataSectors[index%NUM_DIRECT2]);
+    ASSERT(index < raw.numSectors);
+
+    const RawExtent *extents = raw.extents;
+    unsigned num = raw.numExtents;
+    for (unsigned depth = raw.depth; ; depth--) {
+        // Binary search for the last entry starting at `index` or before.
+        unsigned low = 0, high = num;
+        while (high - low > 1) {
+            unsigned mid = (low + high) / 2;
+            if (extents[mid].first <= index) {
+                low = mid;
+            } else {
+                high = mid;
+            }
+        }
+        if (depth == 0) {
+            return &extents[low];
+        }
+        const RawExtentNode *node = GetNode(extents[low].start);
+        extents = node->extents;
+        num     = node->numExtents;
+    }
 }
 
 /// Return the number of bytes in the file.
@@ -328,31 +366,27 @@ FileHeader::Print(const char *title)
         printf("%s file header:\n", title);
     }
 
-    printf("    first indirection quantity: %u\n    second indirection quantity: %u\n", raw.fiQuantity, raw.siQuantity);
-    if (raw.firstIndirection != -1)
-        printf("    first indirection sector: %u\n", raw.firstIndirection);
-    if (raw.secondIndirection != -1) {
-        printf("    second indirection table sector: %u\n    second indirection sectors:\n", raw.secondIndirection);
-        unsigned index = 0;
-        for (unsigned i = 0; i < raw.siQuantity; i+=32)
-        {
-            printf("        %u\n", secondInd.dataSectors[index]);
-            index++;
-        }
-        
-    }
-    printf("\n");
     printf("    size: %u bytes\n"
-           "    block indexes: ",
+           "    extents:",
            raw.numBytes);
-
-    for (unsigned i = 0; i < raw.numSectors; i++) {
-        printf("%u ", *GetSector(i));
+    for (unsigned i = 0; i < raw.numSectors; ) {
+        const RawExtent *e = FindExtent(i);
+        printf(" %u-%u", e->start, e->start + e->length - 1);
+        i = e->first + e->length;
     }
     printf("\n");
+    if (raw.depth > 0) {
+        // All of them were just read, to go over the extents.
+        printf("    extent tree depth: %u, nodes:", raw.depth);
+        for (auto &n : nodes) {
+            printf(" %u", n.first);
+        }
+        printf("\n");
+    }
     for (unsigned i = 0, k = 0; i < raw.numSectors; i++) {
-        printf("    contents of block %u:\n", *GetSector(i));
-        synchDisk->ReadSector(*GetSector(i), data);
+        unsigned sector = ByteToSector(i * SECTOR_SIZE);
+        printf("    contents of block %u:\n", sector);
+        bufferCache->ReadSector(sector, data);
         for (unsigned j = 0; j < SECTOR_SIZE && k < raw.numBytes; j++, k++) {
             if (isprint(data[j])) {
                 printf("%c", data[j]);
@@ -370,3 +404,24 @@ FileHeader::GetRaw() const
 {
     return &raw;
 }
+
+const RawExtentNode *
+FileHeader::GetNode(unsigned sector)
+{
+    return LoadNode(sector);
+}
+
+RawExtentNode *
+FileHeader::LoadNode(unsigned sector)
+{
+    auto it = nodes.find(sector);
+    if (it != nodes.end()) {
+        return &it->second;
+    }
+    // The read may block, and readers share the header, so the node is
+    // only entered once it is complete.  If another thread loaded it in
+    // the meantime, that copy is kept, as it may have changed since.
+    RawExtentNode node;
+    bufferCache->ReadSector(sector, (char *) &node);
+    return &nodes.emplace(sector, node).first->second;
+}
@@ -15,17 +15,25 @@
 
 #include "raw_file_header.hh"
 #include "lib/bitmap.hh"
+
+#include <map>
+#include <set>
 #include <vector>
 
 
 /// The following class defines the Nachos "file header" (in UNIX terms, the
 /// “i-node”), describing where on disk to find all of the data in the file.
-/// The file header is organized as a simple table of pointers to data
-/// blocks.
+/// The file header is organized as a tree of extents, runs of consecutive
+/// sectors on disk.  The root of the tree is in the header itself; when it
+/// fills up, the extents move to nodes of their own, one per sector, and
+/// the root points to them.  Files only grow at the end, so only the
+/// rightmost path of the tree ever changes.
 ///
 /// The file header data structure can be stored in memory or on disk.  When
 /// it is on disk, it is stored in a single sector -- this means that we
 /// assume the size of this data structure to be the same as one disk sector.
+/// Nodes of the tree are only brought into memory when first needed, and
+/// only those changed since are written back.
 ///
 /// There is no constructor; rather the file header can be initialized
 /// by allocating blocks for the file (if it is a new file), or by
@@ -37,7 +45,9 @@ public:
     /// file data.
     bool Allocate(Bitmap *bitMap, unsigned fileSize);
 
-    bool Extend(Bitmap *bitMap, unsigned fileSize);
+    /// Grow the file by `extendSize` bytes, allocating space on disk for
+    /// them.  Nothing changes if there is not enough.
+    bool Extend(Bitmap *bitMap, unsigned extendSize);
 
     /// De-allocate this file's data blocks.
     void Deallocate(Bitmap *bitMap);
@@ -45,7 +55,7 @@ public:
     /// Initialize file header from disk.
     void FetchFrom(unsigned sectorNumber);
 
-    /// Write modifications to file header back to disk.
+    /// Write modifications to file header back to disk, if there are any.
     void WriteBack(unsigned sectorNumber);
 
     /// Convert a byte offset into the file to the disk sector containing the
@@ -64,13 +74,55 @@ public:
     /// system at a low level.
     const RawFileHeader *GetRaw() const;
 
+    /// Get the node of the extent tree stored in `sector`.
+    ///
+    /// NOTE: same as for `GetRaw`.
+    const RawExtentNode *GetNode(unsigned sector);
+
 private:
+
+    /// Node stored in `sector`, read from disk if it was not yet.
+    RawExtentNode *LoadNode(unsigned sector);
+
+    /// Extent holding sector `index` of the file.
+    const RawExtent *FindExtent(unsigned index);
+
+    /// Add `length` sectors at the end of the file, allocated from
+    /// `freeMap`, preferably right after the last ones.  Every sector
+    /// taken from the map is added to `taken`.
+    bool Grow(Bitmap *freeMap, unsigned length, std::vector<unsigned> *taken);
+
+    /// Append a run of data sectors to the extent tree, adding nodes from
+    /// `freeMap` as needed.  Return false if there is no room for them.
+    bool AppendRun(Bitmap *freeMap, const RawExtent &run,
+                   std::vector<unsigned> *taken);
+
+    /// Append `run` under the `num` entries at `extents`, with room for
+    /// `capacity`, `depth` levels above the leaves.  Return false if that
+    /// part of the tree is full.
+    bool AppendTo(RawExtent *extents, unsigned *num, unsigned capacity,
+                  unsigned depth, const RawExtent &run, Bitmap *freeMap,
+                  std::vector<unsigned> *taken);
+
+    /// Allocate a path of nodes from `depth` down to a leaf holding only
+    /// `run`, and return the sector of the top one.
+    unsigned NewPath(unsigned depth, const RawExtent &run, Bitmap *freeMap,
+                std::vector<unsigned> *taken);
+
+    /// Release the sectors under the `num` entries at `extents`.
+    void DeallocateExtents(const RawExtent *extents, unsigned num,
+                           unsigned depth, Bitmap *freeMap);
+
     RawFileHeader raw;
-    RawFileIndirection firstInd;
-    RawFileIndirection secondInd;
-    std::vector<RawFileIndirection> secondIndArray;
 
-    unsigned* GetSector(unsigned index);
+    /// Nodes of the extent tree read so far, by sector.
+    std::map<unsigned, RawExtentNode> nodes;
+
+    /// Whether `raw` changed since it was read or written.
+    bool rawDirty;
+
+    /// Sectors of the nodes changed since they were read or written.
+    std::set<unsigned> dirtyNodes;
 };
 
 
@@ -22,8 +22,12 @@
 /// directory and/or bitmap, if the operation succeeds, the changes are
 /// written immediately back to disk (the two files are kept open during all
 /// this time).  If the operation fails, and we have modified part of the
-/// directory and/or bitmap, we simply discard the changed version, without
-/// writing it back to disk.
+/// directory, we simply discard the changed version, without writing it
+/// back to disk.
+///
+/// The bitmap is kept in memory all along, and only the words of it that
+/// an operation changes are written back.  Operations that fail put back
+/// the bits they changed.
 ///
 /// Our implementation at this point has the following restrictions:
 ///
@@ -48,10 +52,12 @@
 #include "lib/bitmap.hh"
 #include "file_table.hh"
 #include "directory_table.hh"
+#include "dentry_cache.hh"
 #include "threads/lock.hh"
 #include "threads/system.hh"
 #include "path.hh"
 
+#include <set>
 #include <stdio.h>
 #include <string.h>
 
@@ -62,6 +68,9 @@
 static const unsigned FREE_MAP_SECTOR = 0;
 static const unsigned DIRECTORY_SECTOR = 1;
 
+/// Names kept in the dentry cache.
+static const unsigned NUM_DENTRIES = 128;
+
 /// Initialize the file system.  If `format == true`, the disk has nothing on
 /// it, and we need to initialize the disk to contain an empty directory, and
 /// a bitmap of free sectors (with almost but not all of the sectors marked
@@ -75,7 +84,7 @@ FileSystem::FileSystem(bool format)
 {
     DEBUG('f', "Initializing the file system.\n");
     if (format) {
-        Bitmap     *freeMap = new Bitmap(NUM_SECTORS);
+        freeMap = new Bitmap(NUM_SECTORS);
         Directory  *dir     = new Directory();
         FileHeader *mapH    = new FileHeader;
         FileHeader *dirH    = new FileHeader;
@@ -101,7 +110,7 @@ FileSystem::FileSystem(bool format)
         DEBUG('f', "Writing headers back to disk.\n");
         mapH->WriteBack(FREE_MAP_SECTOR);
         dirH->WriteBack(DIRECTORY_SECTOR);
-        dir->SetInitialValue(NUM_DIR_ENTRIES);
+        dir->Initialize();
         
         // OK to open the bitmap and directory files now.
         // The file system operations assume these two files are left open
@@ -124,7 +133,6 @@ FileSystem::FileSystem(bool format)
             freeMap->Print();
             dir->Print();
 
-            delete freeMap;
             delete dir;
             delete mapH;
             delete dirH;
@@ -135,19 +143,24 @@ FileSystem::FileSystem(bool format)
         // Nachos is running.
         freeMapFile   = new OpenFile(FREE_MAP_SECTOR);
         directoryFile = new OpenFile(DIRECTORY_SECTOR);
+        freeMap       = new Bitmap(NUM_SECTORS);
+        freeMap->FetchFrom(freeMapFile);
     }
     fileTable = new FileTable();
     dirTable = new DirectoryTable();
     freemapLock = new Lock("FreeMap Lock");
+    dentries = new DentryCache(NUM_DENTRIES);
 }
 
 FileSystem::~FileSystem()
 {
+    delete freeMap;
     delete freeMapFile;
     delete directoryFile;
     delete fileTable;
     delete dirTable;
     delete freemapLock;
+    delete dentries;
 }
 
 /// Create a file in the Nachos file system (similar to UNIX `create`).
@@ -208,39 +221,52 @@ FileSystem::Create(const char *name, unsigned initialSize, bool isDirectory)
         success = false;  // File is already in directory.
     } else {
         freemapLock->Acquire();
-        Bitmap *freeMap = new Bitmap(NUM_SECTORS);
-        freeMap->FetchFrom(freeMapFile);
         int sector = freeMap->Find();
           // Find a sector to hold the file header.
+        FileHeader *h = new FileHeader;
         if (sector == -1) {
             success = false;  // No free block for file header.
+        } else if (!h->Allocate(freeMap, initialSize)) {
+            success = false;  // No space on disk for data.
+            freeMap->Clear(sector);
+        } else if (!dir->Add(file.c_str(), sector, isDirectory)) {
+            success = false;  // No room for the name in the directory.
+            h->Deallocate(freeMap);
+            freeMap->Clear(sector);
+        } else if (dir->Size() > dirFile->Length()
+                     && !dirFile->hdr->Extend(freeMap, dir->Size()
+                                                - dirFile->Length())) {
+            success = false;  // No space on disk for the directory.
+            h->Deallocate(freeMap);
+            freeMap->Clear(sector);
         } else {
-            bool shouldExtend = dir->Add(file.c_str(), sector, isDirectory);
-            if (shouldExtend)
-                success = dirFile->hdr->Extend(freeMap, sizeof(DirectoryEntry));
-            if (success) {
-                FileHeader *h = new FileHeader;
-                success = h->Allocate(freeMap, initialSize);
-                // Fails if no space on disk for data.
-                if (success) {
-                    DEBUG('f', "Creating file success \n");
-                    // Everything worked, flush all changes back to disk.
-                    dirFile->hdr->WriteBack(dirFile->GetSector());
-                    h->WriteBack(sector);
-                    dir->WriteBack(dirFile);
-                    freeMap->WriteBack(freeMapFile);
-                    if (isDirectory) {
-                        Directory* newDir = new Directory();
-                        newDir->SetInitialValue(initialSize/sizeof(DirectoryEntry));
-                        OpenFile* newDirFile = new OpenFile(sector);
-                        newDir->WriteBack(newDirFile);
-                    }
-                }
-                delete h;
-            }
+            SyncFreeMap();
         }
         freemapLock->Release();
-        delete freeMap;
+
+        if (success) {
+            DEBUG('f', "Creating file success \n");
+            // Everything worked, flush all changes back to disk.  Paths are
+            // looked up holding only the table lock, so that is what keeps
+            // them from reading the directory halfway written, a leaf maybe
+            // split but its new key not there yet.
+            dirTable->LockAcquire();
+            dirFile->hdr->WriteBack(dirFile->GetSector());
+            h->WriteBack(sector);
+            dir->WriteBack(dirFile);
+            if (isDirectory) {
+                Directory* newDir = new Directory();
+                newDir->Initialize();
+                OpenFile* newDirFile = new OpenFile(sector);
+                newDir->WriteBack(newDirFile);
+                delete newDirFile;
+                delete newDir;
+            }
+            DirectoryEntry added = { true, isDirectory, (unsigned) sector };
+            dentries->Update(entry.sector, file, added);
+            dirTable->LockRelease();
+        }
+        delete h;
     }
     dirTable->LockAcquire();
     dirLock->Release();
@@ -255,20 +281,25 @@ bool
 FileSystem::Extend(FileHeader* hdr, int sector, unsigned extendSize)
 {
     freemapLock->Acquire();
-    Bitmap *freeMap = new Bitmap(NUM_SECTORS);
-    freeMap->FetchFrom(freeMapFile);
-
     if (!hdr->Extend(freeMap, extendSize)) {
         freemapLock->Release();
         return false;
     }
+    SyncFreeMap();
+    freemapLock->Release();
 
     hdr->WriteBack(sector);
-    freeMap->WriteBack(freeMapFile);
+    return true;
+}
 
-    freemapLock->Release();
+void
+FileSystem::SyncFreeMap()
+{
+    ASSERT(freemapLock->IsHeldByCurrentThread());
 
-    return true;
+    // This only reaches the buffer cache; the flusher writes the sectors
+    // changed by many operations to the disk at once.
+    freeMap->WriteChanges(freeMapFile);
 }
 
 /// Open a file for reading and writing.
@@ -303,7 +334,8 @@ FileSystem::Open(const char *name)
     int sector = entry.sector;
     if (sector >= 0) {
         fileTable->LockAcquire();
-        FileLock* fl = fileTable->OpenFile(sector);
+        FileHeader* hdr;
+        FileLock* fl = fileTable->OpenFile(sector, &hdr);
         fileTable->LockRelease();
         if (!fl) {
             dirTable->LockAcquire();
@@ -312,7 +344,7 @@ FileSystem::Open(const char *name)
             dirLock->Release();
             return nullptr;
         }
-        openFile = new OpenFile(sector, fl, path);  // `name` was found in directory.
+        openFile = new OpenFile(sector, fl, path, hdr);  // `name` was found in directory.
     }
     dirTable->LockAcquire();
     dirLock->Release();
@@ -366,18 +398,13 @@ FileSystem::Remove(const char *name)
         OpenFile *toRemoveFile = new OpenFile(dirEntry.sector);
         Directory *dirToRemove = new Directory();
         dirToRemove->FetchFrom(toRemoveFile);
-        const RawDirectory* raw = dirToRemove->GetRaw();
-        unsigned i;
-        for (i = 0; i < raw->tableSize; i++) {
-            if (raw->table[i].inUse) 
-                break;
-        }
+        bool empty = dirToRemove->IsEmpty();
+        delete dirToRemove;
+        delete toRemoveFile;
         dirTable->LockAcquire();
         dirToDeleteLock->Release();
         dirTable->CloseDirectory(dirEntry.sector);
-        if (i < raw->tableSize || !dirTable->CanRemove(dirEntry.sector)) {
-            delete toRemoveFile;
-            delete dirToRemove;
+        if (!empty || !dirTable->CanRemove(dirEntry.sector)) {
             success = false;
         }
         if (success)
@@ -385,8 +412,11 @@ FileSystem::Remove(const char *name)
         dirTable->LockRelease();
     } else {
         fileTable->LockAcquire();
-        if (fileTable->SetRemove(dirEntry.sector))
+        if (fileTable->SetRemove(dirEntry.sector)) {
+            dirTable->LockAcquire();
             DiskDelete(path);
+            dirTable->LockRelease();
+        }
         fileTable->LockRelease();
     }
     dirTable->LockAcquire();
@@ -409,8 +439,11 @@ FileSystem::Close(int sector, Path path)
 
     fileTable->LockAcquire();
     bool shouldRemove = fileTable->CloseFile(sector);
-    if (shouldRemove)
+    if (shouldRemove) {
+        dirTable->LockAcquire();
         DiskDelete(path);
+        dirTable->LockRelease();
+    }
     fileTable->LockRelease();
 
     dirLock->Release();
@@ -423,8 +456,6 @@ void
 FileSystem::DiskDelete(Path path) {
     std::string file = path.Split();
     int dirSector = FindPath(&path).sector;
-    
-    freemapLock->Acquire();
 
     OpenFile dirFile = OpenFile(dirSector);
     Directory dir;
@@ -432,17 +463,20 @@ FileSystem::DiskDelete(Path path) {
     int sector = dir.Find(file.c_str());
     dir.Remove(file.c_str());
     dir.WriteBack(&dirFile);
+    DirectoryEntry removed = { false, false, __UINT32_MAX__ };
+    dentries->Update(dirSector, file, removed);
+    dentries->Forget(sector);  // In case it was a directory.
 
     FileHeader fileH;
     fileH.FetchFrom(sector);
+#ifdef USER_PROGRAM
+    executableCache->Invalidate(sector);  // The sector may be reused.
+#endif
 
-    Bitmap freeMap(NUM_SECTORS);
-    freeMap.FetchFrom(freeMapFile);
-
-    fileH.Deallocate(&freeMap); 
-    freeMap.Clear(sector);    
-    
-    freeMap.WriteBack(freeMapFile); 
+    freemapLock->Acquire();
+    fileH.Deallocate(freeMap);
+    freeMap->Clear(sector);
+    SyncFreeMap();
     freemapLock->Release();
 }
 
@@ -467,6 +501,7 @@ FileSystem::chdir(const char *newPath)
     Path currentPath = currentThread->GetPath();
     DirectoryEntry currentDirEntry = FindPath(&currentPath);
     currentThread->currentDirLock = dirTable->OpenDirectory(entry.sector);
+    currentThread->currentDirSector = entry.sector;
     dirTable->CloseDirectory(currentDirEntry.sector);
     currentThread->SetPath(path);
     dirTable->LockRelease();
@@ -485,6 +520,7 @@ FileSystem::firstThreadStart()
         return;
     }
     currentThread->currentDirLock = dirTable->OpenDirectory(entry.sector);
+    currentThread->currentDirSector = entry.sector;
     dirTable->LockRelease();
 }
 
@@ -492,19 +528,49 @@ DirectoryEntry
 FileSystem::FindPath(Path* path)
 {
     DirectoryEntry entry = { true, true, DIRECTORY_SECTOR };
-    
-    Directory* dir = new Directory();
-    
-    for (auto& part : path->List()) {
-        OpenFile* file = new OpenFile(entry.sector);
-        dir->FetchFrom(file);
-        int index = dir->FindIndex(part.c_str());
-        if (index < 0) {
-            DEBUG('f', "Can't find file: %s\n", part.c_str());
+    std::list<std::string> &parts = path->List();
+    auto part = parts.begin();
+
+    // The working directory cannot be removed while it is open, so its
+    // sector stays good, and paths under it need not be walked from the
+    // root.
+    if (currentThread->currentDirLock != nullptr) {
+        Path cwd = currentThread->GetPath();
+        auto c = cwd.List().begin();
+        auto p = parts.begin();
+        while (c != cwd.List().end() && p != parts.end() && *c == *p) {
+            c++;
+            p++;
+        }
+        if (c == cwd.List().end()) {
+            entry.sector = currentThread->currentDirSector;
+            part = p;
+        }
+    }
+
+    for (; part != parts.end(); part++) {
+        if (!entry.isDir) {
+            DEBUG('f', "Not a directory on the way to: %s\n", part->c_str());
             entry.sector = __UINT32_MAX__;
             return entry;
         }
-        entry = dir->GetRaw()->table[index];
+        DirectoryEntry next;
+        if (!dentries->Lookup(entry.sector, *part, &next)) {
+            unsigned generation = dentries->Generation();
+            OpenFile file(entry.sector);
+            Directory dir;
+            dir.FetchFrom(&file);
+            if (!dir.FindEntry(part->c_str(), &next)) {
+                next = { false, false, __UINT32_MAX__ };
+            }
+            dentries->Fill(entry.sector, *part, next, generation);
+        }
+        if (!next.inUse) {
+            DEBUG('f', "Can't find file: %s\n", part->c_str());
+            entry.sector = __UINT32_MAX__;
+            return entry;
+        }
+        entry = next;
     }
 
     return entry;
@@ -515,10 +581,8 @@ void
 FileSystem::List()
 {
     DEBUG('f', "Listing Directory\n");
-    Path path = currentThread->GetPath();
     currentThread->currentDirLock->Acquire();
-    DirectoryEntry entry = FindPath(&path);
-    OpenFile* dirFile = new OpenFile(entry.sector);
+    OpenFile* dirFile = new OpenFile(currentThread->currentDirSector);
     Directory dir;
     dir.FetchFrom(dirFile);
     dir.List();
@@ -560,11 +624,58 @@ CheckSector(unsigned sector, Bitmap *shadowMap)
                          "sector number already used.");
 }
 
+/// Check the entries of a node of the extent tree of `h`, and the nodes
+/// below it.  `next` is the first file sector they should cover, and is
+/// moved past them.
 static bool
-CheckFileHeader(const RawFileHeader *rh, unsigned num, Bitmap *shadowMap)
+CheckExtents(FileHeader *h, const RawExtent *extents, unsigned num,
+             unsigned capacity, unsigned depth, unsigned *next,
+             Bitmap *shadowMap)
 {
-    ASSERT(rh != nullptr);
+    ASSERT(h != nullptr);
+    ASSERT(extents != nullptr);
+    ASSERT(next != nullptr);
+
+    if (CheckForError(num <= capacity, "too many extents.")) {
+        return true;
+    }
 
+    bool error = false;
+    for (unsigned i = 0; i < num; i++) {
+        const RawExtent *e = &extents[i];
+        error |= CheckForError(e->first == *next,
+                               "extents not in order or not contiguous.");
+        if (depth == 0) {
+            for (unsigned s = e->start; s < e->start + e->length; s++) {
+                error |= CheckSector(s, shadowMap);
+            }
+            *next = e->first + e->length;
+            continue;
+        }
+
+        if (CheckSector(e->start, shadowMap)) {
+            error = true;
+            *next = e->first + e->length;
+            continue;
+        }
+        const RawExtentNode *node = h->GetNode(e->start);
+        error |= CheckForError(node->depth == depth - 1,
+                               "wrong depth of extent tree node.");
+        unsigned first = *next;
+        error |= CheckExtents(h, node->extents, node->numExtents,
+                              NUM_NODE_EXTENTS, depth - 1, next, shadowMap);
+        error |= CheckForError(*next - first == e->length,
+                               "wrong length of extent tree node.");
+    }
+    return error;
+}
+
+static bool
+CheckFileHeader(FileHeader *h, unsigned num, Bitmap *shadowMap)
+{
+    ASSERT(h != nullptr);
+
+    const RawFileHeader *rh = h->GetRaw();
     bool error = false;
 
     DEBUG('f', "Checking file header %u.  File size: %u bytes, number of sectors: %u.\n",
@@ -572,12 +683,11 @@ CheckFileHeader(const RawFileHeader *rh, unsigned num, Bitmap *shadowMap)
     error |= CheckForError(rh->numSectors >= DivRoundUp(rh->numBytes,
                                                         SECTOR_SIZE),
                            "sector count not compatible with file size.");
-    error |= CheckForError(rh->numSectors < NUM_DIRECT,
-                           "too many blocks.");
-    for (unsigned i = 0; i < rh->numSectors; i++) {
-        unsigned s = rh->dataSectors[i];
-        error |= CheckSector(s, shadowMap);
-    }
+    unsigned next = 0;
+    error |= CheckExtents(h, rh->extents, rh->numExtents, NUM_ROOT_EXTENTS,
+                          rh->depth, &next, shadowMap);
+    error |= CheckForError(next == rh->numSectors,
+                           "extents do not match the sector count.");
     return error;
 }
 
@@ -595,54 +705,42 @@ CheckBitmaps(const Bitmap *freeMap, const Bitmap *shadowMap)
 }
 
 static bool
-CheckDirectory(const RawDirectory *rd, Bitmap *shadowMap)
+CheckDirectory(Directory *dir, Bitmap *shadowMap)
 {
-    ASSERT(rd != nullptr);
+    ASSERT(dir != nullptr);
     ASSERT(shadowMap != nullptr);
 
     bool error = false;
-    unsigned nameCount = 0;
-    const char *knownNames[NUM_DIR_ENTRIES];
+    std::vector<DirectoryEntry> entries;
+    dir->GetEntries(&entries);
+    std::set<std::string> knownNames;
 
-    for (unsigned i = 0; i < NUM_DIR_ENTRIES; i++) {
-        DEBUG('f', "Checking direntry: %u.\n", i);
-        const DirectoryEntry *e = &rd->table[i];
+    for (const DirectoryEntry &e : entries) {
+        DEBUG('f', "Checking direntry: %s.\n", e.name);
 
-        if (e->inUse) {
-            if (strlen(e->name) > FILE_NAME_MAX_LEN) {
-                DEBUG('f', "Filename too long.\n");
-                error = true;
-            }
+        if (strlen(e.name) > FILE_NAME_MAX_LEN) {
+            DEBUG('f', "Filename too long.\n");
+            error = true;
+        }
 
-            // Check for repeated filenames.
-            DEBUG('f', "Checking for repeated names.  Name count: %u.\n",
-                  nameCount);
-            bool repeated = false;
-            for (unsigned j = 0; j < nameCount; j++) {
-                DEBUG('f', "Comparing \"%s\" and \"%s\".\n",
-                      knownNames[j], e->name);
-                if (strcmp(knownNames[j], e->name) == 0) {
-                    DEBUG('f', "Repeated filename.\n");
-                    repeated = true;
-                    error = true;
-                }
-            }
-            if (!repeated) {
-                knownNames[nameCount] = e->name;
-                DEBUG('f', "Added \"%s\" at %u.\n", e->name, nameCount);
-                nameCount++;
-            }
+        // Check for repeated filenames.
+        if (!knownNames.insert(e.name).second) {
+            DEBUG('f', "Repeated filename.\n");
+            error = true;
+        }
 
-            // Check sector.
-            error |= CheckSector(e->sector, shadowMap);
+        // The index must lead to each name where it was put.
+        error |= CheckForError(dir->Find(e.name) == (int) e.sector,
+                               "name not found in its directory.");
 
-            // Check file header.
-            FileHeader *h = new FileHeader;
-            const RawFileHeader *rh = h->GetRaw();
-            h->FetchFrom(e->sector);
-            error |= CheckFileHeader(rh, e->sector, shadowMap);
-            delete h;
-        }
+        // Check sector.
+        error |= CheckSector(e.sector, shadowMap);
+
+        // Check file header.
+        FileHeader *h = new FileHeader;
+        h->FetchFrom(e.sector);
+        error |= CheckFileHeader(h, e.sector, shadowMap);
+        delete h;
     }
     return error;
 }
@@ -670,30 +768,36 @@ FileSystem::Check()
                            "bad bitmap header: wrong file size.");
     error |= CheckForError(bitRH->numSectors == FREE_MAP_FILE_SIZE / SECTOR_SIZE,
                            "bad bitmap header: wrong number of sectors.");
-    error |= CheckFileHeader(bitRH, FREE_MAP_SECTOR, shadowMap);
+    error |= CheckFileHeader(bitH, FREE_MAP_SECTOR, shadowMap);
     delete bitH;
 
     DEBUG('f', "Checking directory.\n");
 
     FileHeader *dirH = new FileHeader;
-    const RawFileHeader *dirRH = dirH->GetRaw();
     dirH->FetchFrom(DIRECTORY_SECTOR);
-    error |= CheckFileHeader(dirRH, DIRECTORY_SECTOR, shadowMap);
+    error |= CheckFileHeader(dirH, DIRECTORY_SECTOR, shadowMap);
     delete dirH;
 
-    Bitmap *freeMap = new Bitmap(NUM_SECTORS);
-    freeMap->FetchFrom(freeMapFile);
+    Bitmap *diskMap = new Bitmap(NUM_SECTORS);
+    diskMap->FetchFrom(freeMapFile);
+    // The root directory grows as names are added through headers of its
+    // own, so `directoryFile` may not know its current length.
+    OpenFile *rootFile = new OpenFile(DIRECTORY_SECTOR);
     Directory *dir = new Directory();
-    const RawDirectory *rdir = dir->GetRaw();
-    dir->FetchFrom(directoryFile);
-    error |= CheckDirectory(rdir, shadowMap);
+    dir->FetchFrom(rootFile);
+    error |= CheckDirectory(dir, shadowMap);
     delete dir;
+    delete rootFile;
 
-    // The two bitmaps should match.
+    // The bitmaps should match, and so should the one on disk and the one
+    // in memory.
     DEBUG('f', "Checking bitmap consistency.\n");
-    error |= CheckBitmaps(freeMap, shadowMap);
+    error |= CheckBitmaps(diskMap, shadowMap);
+    freemapLock->Acquire();
+    error |= CheckBitmaps(freeMap, diskMap);
+    freemapLock->Release();
     delete shadowMap;
-    delete freeMap;
+    delete diskMap;
 
     DEBUG('f', error ? "Filesystem check failed.\n"
                      : "Filesystem check succeeded.\n");
@@ -712,7 +816,6 @@ FileSystem::Print()
 {
     FileHeader *bitH    = new FileHeader;
     FileHeader *dirH    = new FileHeader;
-    Bitmap     *freeMap = new Bitmap(NUM_SECTORS);
     Directory  *dir     = new Directory();
 
     printf("--------------------------------\n");
@@ -724,16 +827,18 @@ FileSystem::Print()
     dirH->Print("Directory");
 
     printf("--------------------------------\n");
-    freeMap->FetchFrom(freeMapFile);
+    freemapLock->Acquire();
     freeMap->Print();
+    freemapLock->Release();
 
     printf("--------------------------------\n");
-    dir->FetchFrom(directoryFile);
+    OpenFile *rootFile = new OpenFile(DIRECTORY_SECTOR);
+    dir->FetchFrom(rootFile);
     dir->Print();
     printf("--------------------------------\n");
 
     delete bitH;
     delete dirH;
-    delete freeMap;
     delete dir;
+    delete rootFile;
 }
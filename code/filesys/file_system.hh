@@ -47,7 +47,6 @@
 /// are not required, but system information tools expects them to be
 /// defined.
 static const unsigned FREE_MAP_FILE_SIZE = 0;
-static const unsigned NUM_DIR_ENTRIES = 0;
 static const unsigned DIRECTORY_FILE_SIZE = 0;
 
 
@@ -97,14 +96,13 @@ class FileTable;
 class DirectoryTable;
 class Lock;
 class FileLock;
+class Bitmap;
+class DentryCache;
 
-/// Initial file sizes for the bitmap and directory; until the file system
-/// supports extensible files, the directory size sets the maximum number of
-/// files that can be loaded onto the disk.
+/// Initial file sizes for the bitmap and directory.  A new directory takes
+/// a header block and an empty leaf, and grows as names are added.
 static const unsigned FREE_MAP_FILE_SIZE = NUM_SECTORS / BITS_IN_BYTE;
-static const unsigned NUM_DIR_ENTRIES = 10;
-static const unsigned DIRECTORY_FILE_SIZE
-  = sizeof (DirectoryEntry) * NUM_DIR_ENTRIES + sizeof (unsigned);
+static const unsigned DIRECTORY_FILE_SIZE = 2 * SECTOR_SIZE;
 
 
 class FileSystem {
@@ -145,14 +143,28 @@ public:
 
     bool chdir(const char *newPath);
 
+    /// Entry of the file at absolute `path`; its sector is `__UINT32_MAX__`
+    /// if there is none.  Components are looked up in `dentries` first,
+    /// from the working directory on if `path` is under it.
+    ///
+    /// The `dirTable` lock must be held: directories are only written to
+    /// holding it, besides their own lock.
     DirectoryEntry FindPath(Path* path);
     
     void firstThreadStart();
 
 private:
+
+    /// Write the words of `freeMap` changed since last time to
+    /// `freeMapFile`.  `freemapLock` must be held.
+    void SyncFreeMap();
+
     OpenFile *freeMapFile;  ///< Bit map of free disk blocks, represented as a
                             ///< file.
 
+    Bitmap *freeMap;  ///< Contents of `freeMapFile`, kept in memory while
+                      ///< Nachos is running.
+
     OpenFile *directoryFile;  ///< “Root” directory -- list of file names,
                               ///< represented as a file.
     FileTable *fileTable;
@@ -161,6 +173,10 @@ private:
 
     DirectoryTable *dirTable;
 
+    DentryCache *dentries;  ///< Names looked up in directories.
+
+    /// Remove the file at `path` from its directory and free its sectors.
+    /// The lock of the directory and the `dirTable` lock must be held.
     void DiskDelete(Path path);
 };
 
@@ -1,4 +1,5 @@
 #include "file_table.hh"
+#include "file_header.hh"
 #include "threads/lock.hh"
 
 FileTable::FileTable()
@@ -16,6 +17,7 @@ FileTable::~FileTable()
     {
         first = first->next;
         delete aux->RWLock;
+        delete aux->hdr;
         delete aux;
     }
 }
@@ -31,7 +33,8 @@ FileTable::LockRelease() {
 }
 
 FileLock* 
-FileTable::OpenFile(int fSector){
+FileTable::OpenFile(int fSector, FileHeader** hdr){
+    ASSERT(hdr != nullptr);
     ListEntry* aux;
     for (aux = first; aux != nullptr; aux = aux->next)
     {
@@ -46,6 +49,8 @@ FileTable::OpenFile(int fSector){
         aux->next = nullptr;
         aux->toRemove = false;
         aux->RWLock = new FileLock();
+        aux->hdr = new FileHeader;
+        aux->hdr->FetchFrom(fSector);
         if (!first) {
             first = last = aux;
         } else {
@@ -57,6 +62,7 @@ FileTable::OpenFile(int fSector){
             return nullptr;
         aux->opened++;
     }
+    *hdr = aux->hdr;
     return aux->RWLock;
 }
 
@@ -89,6 +95,7 @@ FileTable::CloseFile(int fSector) {
         }
 
         delete aux->RWLock;
+        delete aux->hdr;
         delete aux;
         return toR;
     }
@@ -3,11 +3,20 @@
 
 #include "filelock.hh"
 
+class FileHeader;
+
+// In-core inode of an open file, shared by every `OpenFile` for it.
+//
+// Threads holding `RWLock` for writing are the only ones changing `hdr`,
+// except that readers, which may run together, load extent nodes into it
+// as they need them.  That only ever adds whole nodes (see
+// `FileHeader::LoadNode`), so it needs no lock of its own.
 struct ListEntry {
     int sector;
     bool toRemove;
     unsigned opened;
     FileLock* RWLock;
+    FileHeader* hdr;
     ListEntry* next;
 };
 
@@ -22,9 +31,12 @@ public:
     void LockRelease();
 
     // returns nullpointer if the file that is being oppened was set to be removed
-    FileLock* OpenFile(int fSector);
+    // otherwise sets `hdr` to the header shared by all who have the file open,
+    // which is only read from disk by the first one
+    FileLock* OpenFile(int fSector, FileHeader** hdr);
 
     // returns true if the file should be removed, false otherwise
+    // the header is deleted when the last one closes the file
     bool CloseFile(int fSector);
 
     // returns true if no other thread has the file open, otherwise returns false but sets toRemove flag
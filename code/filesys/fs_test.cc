@@ -9,6 +9,21 @@
 /// Perftest
 ///     A stress test for the Nachos file system read and write a really
 ///     really large file in tiny chunks (will not work on baseline system!)
+/// DiskSchedulingTest
+///     Many threads reading scattered sectors at once, under each disk
+///     scheduling policy.
+/// FileLayoutTest
+///     How long it takes to read files back, depending on how they were
+///     written.
+/// BitmapTest
+///     How long searches in a bitmap as large as the disk take on the host,
+///     when it is mostly full.
+/// DirectoryTest
+///     What creating, looking up and removing files costs in a directory
+///     with many of them.
+/// FlatDirectoryTest
+///     A directory in the format older versions wrote is read, and turned
+///     into an indexed one when a name is added to it.
 ///
 /// Copyright (c) 1992-1993 The Regents of the University of California.
 ///               2016-2021 Docentes de la Universidad Nacional de Rosario.
@@ -16,15 +31,19 @@
 /// limitation of liability and disclaimer of warranty provisions.
 
 
+#include "directory.hh"
 #include "file_system.hh"
+#include "lib/bitmap.hh"
 #include "lib/utility.hh"
 #include "machine/disk.hh"
 #include "machine/statistics.hh"
 #include "threads/thread.hh"
 #include "threads/system.hh"
 
+#include <stdint.h>
 #include <stdio.h>
 #include <string.h>
+#include <time.h>
 
 
 static const unsigned TRANSFER_SIZE = 10;  // Make it small, just to be
@@ -206,3 +225,361 @@ PerformanceTest()
     fileSystem->Remove("dir");
     stats->Print();
 }
+
+static const unsigned NUM_READERS      = 8;
+static const unsigned READS_PER_READER = 32;
+
+/// Read sectors scattered over the disk, straight from it.
+static void
+DiskReader(void *arg)
+{
+    unsigned seed = (uintptr_t) arg * 2654435761u;
+    char data[SECTOR_SIZE];
+    for (unsigned i = 0; i < READS_PER_READER; i++) {
+        seed = seed * 1664525 + 1013904223;
+        synchDisk->ReadSector((seed >> 8) % NUM_SECTORS, data);
+    }
+}
+
+void
+DiskSchedulingTest()
+{
+    printf("Disk scheduling, %u threads reading %u sectors each:\n",
+           NUM_READERS, READS_PER_READER);
+
+    for (unsigned p = 0; p < NUM_DISK_POLICIES; p++) {
+        synchDisk->SetPolicy((DiskPolicy) p);
+        unsigned long seekTicks = stats->numDiskSeekTicks;
+        unsigned long ticks     = stats->totalTicks;
+
+        Thread *readers[NUM_READERS];
+        for (unsigned i = 0; i < NUM_READERS; i++) {
+            readers[i] = new Thread("disk reader");
+            readers[i]->Fork(DiskReader, (void *) (uintptr_t) (i + 1));
+        }
+        for (unsigned i = 0; i < NUM_READERS; i++) {
+            readers[i]->Join();
+        }
+
+        printf("    %-5s seek ticks %lu, total ticks %lu\n",
+               DISK_POLICY_NAMES[p], stats->numDiskSeekTicks - seekTicks,
+               stats->totalTicks - ticks);
+    }
+}
+
+static const unsigned LAYOUT_FILE_SIZE = 32 * SECTOR_SIZE;
+
+/// Append a sector of data to each of the `n` files in `files`, in turn,
+/// until they are `LAYOUT_FILE_SIZE` long.
+static void
+WriteInTurns(OpenFile **files, unsigned n)
+{
+    char data[SECTOR_SIZE];
+    memset(data, 'x', SECTOR_SIZE);
+    for (unsigned i = 0; i < LAYOUT_FILE_SIZE; i += SECTOR_SIZE) {
+        for (unsigned j = 0; j < n; j++) {
+            files[j]->Write(data, SECTOR_SIZE);
+        }
+    }
+}
+
+/// Read `file` from the start, a sector at a time, from the disk.
+static void
+TimedRead(OpenFile *file, const char *name)
+{
+    bufferCache->Invalidate();
+    unsigned long reads = stats->numDiskReads;
+    unsigned long ticks = stats->totalTicks;
+
+    char data[SECTOR_SIZE];
+    file->Seek(0);
+    while (file->Read(data, SECTOR_SIZE) > 0) {}
+
+    printf("    %-10s disk reads %lu, ticks %lu\n", name,
+           stats->numDiskReads - reads, stats->totalTicks - ticks);
+}
+
+void
+FileLayoutTest()
+{
+    static const char *const NAMES[] = { "Alone", "Together1", "Together2" };
+
+    printf("File layout, reading %u byte files written a sector at a time:\n",
+           LAYOUT_FILE_SIZE);
+
+    OpenFile *files[3];
+    for (unsigned i = 0; i < 3; i++) {
+        if (!fileSystem->Create(NAMES[i], 0)
+              || (files[i] = fileSystem->Open(NAMES[i])) == nullptr) {
+            fprintf(stderr, "Layout test: cannot create %s\n", NAMES[i]);
+            return;
+        }
+    }
+
+    // One file written by itself, and two growing at the same time.
+    WriteInTurns(&files[0], 1);
+    WriteInTurns(&files[1], 2);
+
+    for (unsigned i = 0; i < 3; i++) {
+        TimedRead(files[i], NAMES[i]);
+        delete files[i];
+        fileSystem->Remove(NAMES[i]);
+    }
+}
+
+static const unsigned BITMAP_ROUNDS = 200000;
+
+/// What `Bitmap::Find` used to do: test one bit after the other, from the
+/// first one on.
+static int
+FindBitByBit(Bitmap *map)
+{
+    for (unsigned i = 0; i < NUM_SECTORS; i++) {
+        if (!map->Test(i)) {
+            map->Mark(i);
+            return i;
+        }
+    }
+    return -1;
+}
+
+/// What `Bitmap::CountClear` used to do.
+static unsigned
+CountBitByBit(const Bitmap *map)
+{
+    unsigned count = 0;
+    for (unsigned i = 0; i < NUM_SECTORS; i++) {
+        if (!map->Test(i)) {
+            count++;
+        }
+    }
+    return count;
+}
+
+static void
+PrintTime(const char *what, clock_t start)
+{
+    double ns = (double) (clock() - start) / CLOCKS_PER_SEC * 1e9
+                / BITMAP_ROUNDS;
+    printf("    %-24s %8.1f ns\n", what, ns);
+}
+
+void
+BitmapTest()
+{
+    // Like a disk filled up from the beginning, with a few holes left at
+    // the end.
+    Bitmap map(NUM_SECTORS);
+    for (unsigned i = 0; i < NUM_SECTORS; i++) {
+        if (i < NUM_SECTORS * 7 / 8 || i % 4 != 0) {
+            map.Mark(i);
+        }
+    }
+
+    printf("Bitmap of %u bits, %u clear, time per operation:\n",
+           NUM_SECTORS, map.CountClear());
+
+    clock_t start = clock();
+    for (unsigned r = 0; r < BITMAP_ROUNDS; r++) {
+        map.Clear(FindBitByBit(&map));
+    }
+    PrintTime("find, bit by bit", start);
+
+    start = clock();
+    for (unsigned r = 0; r < BITMAP_ROUNDS; r++) {
+        map.Clear(map.Find());
+    }
+    PrintTime("find", start);
+
+    start = clock();
+    for (unsigned r = 0; r < BITMAP_ROUNDS; r++) {
+        int first = map.FindRun(2);
+        if (first != -1) {
+            map.Clear(first);
+            map.Clear(first + 1);
+        }
+    }
+    PrintTime("find run of 2 (none)", start);
+
+    start = clock();
+    unsigned count = 0;
+    for (unsigned r = 0; r < BITMAP_ROUNDS; r++) {
+        count += CountBitByBit(&map);
+    }
+    PrintTime("count, bit by bit", start);
+
+    start = clock();
+    for (unsigned r = 0; r < BITMAP_ROUNDS; r++) {
+        count -= map.CountClear();
+    }
+    PrintTime("count", start);
+    ASSERT(count == 0);
+}
+
+static const unsigned DIRECTORY_TEST_FILES = 400;
+
+/// Sectors the buffer cache was asked for since `accesses`.
+static unsigned long
+CacheAccessesSince(unsigned long accesses)
+{
+    return stats->numBufferCacheHits + stats->numBufferCacheMisses - accesses;
+}
+
+void
+DirectoryTest()
+{
+    printf("Directory of %u files:\n", DIRECTORY_TEST_FILES);
+    if (!fileSystem->mkdir("Many") || !fileSystem->chdir("Many")) {
+        fprintf(stderr, "Directory test: cannot create Many\n");
+        return;
+    }
+
+    char name[16];
+    unsigned long accesses = CacheAccessesSince(0);
+    for (unsigned i = 0; i < DIRECTORY_TEST_FILES; i++) {
+        snprintf(name, sizeof name, "file%u", i);
+        if (!fileSystem->Create(name, 0)) {
+            fprintf(stderr, "Directory test: cannot create %s\n", name);
+            return;
+        }
+    }
+    printf("    create      %5.1f sectors accessed each\n",
+           (double) CacheAccessesSince(accesses) / DIRECTORY_TEST_FILES);
+
+    // Straight from the disk, past the dentry cache.
+    Path path = currentThread->GetPath();
+    unsigned sector = fileSystem->FindPath(&path).sector;
+    unsigned long reads = 0;
+    unsigned lookups = 0;
+    for (unsigned i = 0; i < DIRECTORY_TEST_FILES; i += 10, lookups++) {
+        snprintf(name, sizeof name, "file%u", i);
+        bufferCache->Invalidate();
+        unsigned long before = stats->numDiskReads;
+        OpenFile file(sector);
+        Directory dir;
+        dir.FetchFrom(&file);
+        ASSERT(dir.Find(name) != -1);
+        reads += stats->numDiskReads - before;
+    }
+    printf("    lookup      %5.1f disk reads each\n",
+           (double) reads / lookups);
+
+    accesses = CacheAccessesSince(0);
+    for (unsigned i = 0; i < DIRECTORY_TEST_FILES; i++) {
+        snprintf(name, sizeof name, "file%u", i);
+        fileSystem->Remove(name);
+    }
+    printf("    remove      %5.1f sectors accessed each\n",
+           (double) CacheAccessesSince(accesses) / DIRECTORY_TEST_FILES);
+
+    fileSystem->chdir("..");
+    fileSystem->Remove("Many");
+}
+
+static const char *const FLAT_NAMES[] = { "old1", "old2", "old3" };
+static const unsigned NUM_FLAT_NAMES
+  = sizeof FLAT_NAMES / sizeof *FLAT_NAMES;
+
+/// Whether the directory in `file` starts with the magic number.
+static bool
+IsIndexed(OpenFile *file)
+{
+    unsigned magic;
+    file->ReadAt((char *) &magic, sizeof magic, 0);
+    return magic == DIRECTORY_MAGIC;
+}
+
+void
+FlatDirectoryTest()
+{
+    printf("Flat directory:\n");
+    if (!fileSystem->mkdir("Flat") || !fileSystem->chdir("Flat")) {
+        fprintf(stderr, "Flat directory test: cannot create Flat\n");
+        return;
+    }
+    for (unsigned i = 0; i < NUM_FLAT_NAMES; i++) {
+        if (!fileSystem->Create(FLAT_NAMES[i], 0)) {
+            fprintf(stderr, "Flat directory test: cannot create %s\n",
+                    FLAT_NAMES[i]);
+            return;
+        }
+    }
+
+    // Write the same names over the directory the way older versions did:
+    // their number, then a table of entries, the first one unused.
+    Path path = currentThread->GetPath();
+    unsigned sector = fileSystem->FindPath(&path).sector;
+    OpenFile file(sector);
+    DirectoryEntry table[NUM_FLAT_NAMES + 1];
+    memset(table, 0, sizeof table);
+    {
+        Directory dir;
+        dir.FetchFrom(&file);
+        for (unsigned i = 0; i < NUM_FLAT_NAMES; i++) {
+            DirectoryEntry *e = &table[i + 1];
+            e->inUse  = true;
+            e->sector = dir.Find(FLAT_NAMES[i]);
+            strncpy(e->name, FLAT_NAMES[i], FILE_NAME_MAX_LEN);
+        }
+    }
+    unsigned tableSize = NUM_FLAT_NAMES + 1;
+    file.WriteAt((char *) &tableSize, sizeof tableSize, 0);
+    file.WriteAt((char *) table, sizeof table, sizeof tableSize);
+    ASSERT(!IsIndexed(&file));
+
+    // Lookups read it as it is.
+    {
+        Directory dir;
+        dir.FetchFrom(&file);
+        std::vector<DirectoryEntry> entries;
+        dir.GetEntries(&entries);
+        ASSERT(entries.size() == NUM_FLAT_NAMES);
+        for (unsigned i = 0; i < NUM_FLAT_NAMES; i++) {
+            ASSERT(dir.Find(FLAT_NAMES[i]) == (int) table[i + 1].sector);
+        }
+        ASSERT(dir.Find("new") == -1);
+        ASSERT(!dir.IsEmpty());
+    }
+    printf("    read        ok\n");
+
+    // Removing a name keeps the format.
+    if (!fileSystem->Remove(FLAT_NAMES[0])) {
+        fprintf(stderr, "Flat directory test: cannot remove %s\n",
+                FLAT_NAMES[0]);
+        return;
+    }
+    ASSERT(!IsIndexed(&file));
+    {
+        Directory dir;
+        dir.FetchFrom(&file);
+        ASSERT(dir.Find(FLAT_NAMES[0]) == -1);
+        ASSERT(dir.Find(FLAT_NAMES[1]) != -1);
+    }
+    printf("    remove      ok\n");
+
+    // Adding one turns it into a tree, with the names it had.
+    if (!fileSystem->Create("new", 0)) {
+        fprintf(stderr, "Flat directory test: cannot create new\n");
+        return;
+    }
+    ASSERT(IsIndexed(&file));
+    {
+        Directory dir;
+        dir.FetchFrom(&file);
+        std::vector<DirectoryEntry> entries;
+        dir.GetEntries(&entries);
+        ASSERT(entries.size() == NUM_FLAT_NAMES);
+        for (unsigned i = 1; i < NUM_FLAT_NAMES; i++) {
+            ASSERT(dir.Find(FLAT_NAMES[i]) != -1);
+        }
+        ASSERT(dir.Find("new") != -1);
+    }
+    printf("    add         ok, indexed now\n");
+
+    for (unsigned i = 1; i < NUM_FLAT_NAMES; i++) {
+        fileSystem->Remove(FLAT_NAMES[i]);
+    }
+    fileSystem->Remove("new");
+    fileSystem->chdir("..");
+    fileSystem->Remove("Flat");
+}
@@ -3,7 +3,7 @@
 /// (in Nachos, by deleting the `OpenFile` data structure).
 ///
 /// Also as in UNIX, for convenience, we keep the file header in memory while
-/// the file is open.
+/// the file is open, once for all who have it open.
 ///
 /// Copyright (c) 1992-1993 The Regents of the University of California.
 ///               2016-2021 Docentes de la Universidad Nacional de Rosario.
@@ -19,14 +19,20 @@
 
 
 /// Open a Nachos file for reading and writing.  Bring the file header into
-/// memory while the file is open.
+/// memory while the file is open, unless it is there already.
 ///
 /// * `sector` is the location on disk of the file header for this file.
-OpenFile::OpenFile(int sector_, FileLock* fl, Path path_)
+OpenFile::OpenFile(int sector_, FileLock* fl, Path path_, FileHeader* hdr_)
 {
-    hdr = new FileHeader;
-    hdr->FetchFrom(sector_);
+    ASSERT((hdr_ == nullptr) == (fl == nullptr));
+    hdr = hdr_;
+    if (hdr == nullptr) {
+        hdr = new FileHeader;
+        hdr->FetchFrom(sector_);
+    }
     seekPosition = 0;
+    readEnd      = 0;
+    aheadEnd     = 0;
     RWLock = fl;
     path = path_;
     sector = sector_;
@@ -36,8 +42,9 @@ OpenFile::OpenFile(int sector_, FileLock* fl, Path path_)
 OpenFile::~OpenFile()
 {
     if (RWLock)
-        fileSystem->Close(GetSector(), GetPath());
-    delete hdr;
+        fileSystem->Close(GetSector(), GetPath());  // Drops the header.
+    else
+        delete hdr;
 }
 
 /// Change the current location within the open file -- the point at which
@@ -141,12 +148,28 @@ OpenFile::ReadAt(char *into, unsigned numBytes, unsigned position, bool shouldLo
     lastSector = DivRoundDown(position + numBytes - 1, SECTOR_SIZE);
     numSectors = 1 + lastSector - firstSector;
 
-    // Read in all the full and partial sectors that we need.
-    buf = new char [numSectors * SECTOR_SIZE];
-    for (unsigned i = firstSector; i <= lastSector; i++) {
-        synchDisk->ReadSector(hdr->ByteToSector(i * SECTOR_SIZE),
-                              &buf[(i - firstSector) * SECTOR_SIZE]);
+    // When reading sequentially past what was read ahead, read the rest of
+    // the run of sectors in this track along, for the next reads to find
+    // in the cache.
+    unsigned ahead = 0;
+    if (position == readEnd && lastSector >= aheadEnd) {
+        unsigned fileSectors = DivRoundUp(fileLength, SECTOR_SIZE);
+        unsigned last = hdr->ByteToSector(lastSector * SECTOR_SIZE);
+        for (unsigned i = lastSector + 1; i < fileSectors; i++) {
+            unsigned next = hdr->ByteToSector(i * SECTOR_SIZE);
+            if (next != last + 1 || next % SECTORS_PER_TRACK == 0) {
+                break;
+            }
+            last = next;
+            ahead++;
+        }
+        aheadEnd = lastSector + ahead + 1;
     }
+    readEnd = position + numBytes;
+
+    // Read in all the full and partial sectors that we need.
+    buf = new char [(numSectors + ahead) * SECTOR_SIZE];
+    TransferSectors(buf, firstSector, lastSector + ahead, false);
 
     // Copy the part we want.
     memcpy(into, &buf[position - firstSector * SECTOR_SIZE], numBytes);
@@ -164,6 +187,10 @@ OpenFile::WriteAt(const char *from, unsigned numBytes, unsigned position)
     ASSERT(from != nullptr);
     ASSERT(numBytes > 0);
 
+#ifdef USER_PROGRAM
+    executableCache->Invalidate(sector);  // In case it is a program.
+#endif
+
     if (RWLock != nullptr)
         RWLock->WriteAcquire();
 
@@ -212,10 +239,7 @@ OpenFile::WriteAt(const char *from, unsigned numBytes, unsigned position)
     memcpy(&buf[position - firstSector * SECTOR_SIZE], from, numBytes);
 
     // Write modified sectors back.
-    for (unsigned i = firstSector; i <= lastSector; i++) {
-        synchDisk->WriteSector(hdr->ByteToSector(i * SECTOR_SIZE),
-                               &buf[(i - firstSector) * SECTOR_SIZE]);
-    }
+    TransferSectors(buf, firstSector, lastSector, true);
 
     if (RWLock != nullptr)
         RWLock->WriteRelease();
@@ -224,6 +248,33 @@ OpenFile::WriteAt(const char *from, unsigned numBytes, unsigned position)
     return numBytes;
 }
 
+void
+OpenFile::TransferSectors(char *buf, unsigned first, unsigned last,
+                          bool writing)
+{
+    ASSERT(buf != nullptr);
+
+    unsigned runStart = 0, runLength = 0;  // Of the run being gathered.
+    for (unsigned i = first; i <= last + 1; i++) {
+        unsigned s = i <= last ? hdr->ByteToSector(i * SECTOR_SIZE) : 0;
+        if (runLength > 0 && i <= last && s == runStart + runLength
+              && s % SECTORS_PER_TRACK != 0) {
+            runLength++;
+            continue;
+        }
+        if (runLength > 0) {
+            char *data = &buf[(i - runLength - first) * SECTOR_SIZE];
+            if (writing) {
+                bufferCache->WriteSectors(runStart, runLength, data);
+            } else {
+                bufferCache->ReadSectors(runStart, runLength, data);
+            }
+        }
+        runStart  = s;
+        runLength = 1;
+    }
+}
+
 /// Return the number of bytes in the file.
 unsigned
 OpenFile::Length() const
@@ -79,6 +79,13 @@ public:
         return SystemDep::Tell(file);
     }
 
+    /// There are no header sectors here, but the UNIX inode number tells
+    /// files apart just as well.
+    int GetSector()
+    {
+        return SystemDep::FileId(file);
+    }
+
 private:
     int file;
     unsigned currentOffset;
@@ -95,7 +102,16 @@ class OpenFile {
 public:
 
     /// Open a file whose header is located at `sector` on the disk.
-    OpenFile(int sector, FileLock* fl = nullptr, Path path = Path());
+    ///
+    /// Files opened through the file system share the lock `fl` and the
+    /// header `hdr` with every other `OpenFile` for them, and the file
+    /// table owns both.  Otherwise the file gets a header of its own, read
+    /// from the disk now, which does not see later changes made through any
+    /// other `OpenFile`.  Directories, the free map and the root directory
+    /// kept by the file system are opened this way, so a directory that may
+    /// have grown has to be opened again before reading it.
+    OpenFile(int sector, FileLock* fl = nullptr, Path path = Path(),
+             FileHeader* hdr = nullptr);
 
     /// Close the file.
     ~OpenFile();
@@ -125,7 +141,14 @@ public:
     Path GetPath();
 
   private:
+    /// Read/write sectors `first` to `last` of the file from/into `buf`,
+    /// with a request for each run of them consecutive on the disk.
+    void TransferSectors(char *buf, unsigned first, unsigned last,
+                         bool writing);
+
     unsigned seekPosition;  ///< Current position within the file.
+    unsigned readEnd;       ///< Where the last read ended.
+    unsigned aheadEnd;      ///< First sector of the file not read ahead.
     FileLock *RWLock;
     Path path;
     int sector;
@@ -7,13 +7,74 @@
 #define NACHOS_FILESYS_RAWDIRECTORY__HH
 
 
+#include "machine/disk.hh"
+
+#include <stdint.h>
+
+
 class DirectoryEntry;
 
+/// Flat directory, as older disks have them: the number of entries, then
+/// the entries themselves.
 struct RawDirectory {
     unsigned tableSize;  ///< Number of directory entries.
     DirectoryEntry *table;  ///< Table of pairs:
                             ///< *<file name, file header location>*.
 };
 
+/// First word of an indexed directory.  A flat directory has its number of
+/// entries there instead, which is never anywhere near as large.
+static const unsigned DIRECTORY_MAGIC = 0x48534944;
+
+/// An indexed directory is a B-tree keyed by a hash of the names, kept in
+/// blocks of one sector each, the header being block 0.  Blocks are only
+/// ever added at the end of the file.
+struct RawDirectoryHeader {
+    unsigned magic;       ///< `DIRECTORY_MAGIC`.
+    unsigned numBlocks;   ///< Blocks in use, the header included.
+    unsigned numEntries;  ///< Names in the directory.
+    unsigned root;        ///< Block holding the root of the tree.
+    unsigned depth;       ///< Levels of index blocks above the leaves.
+};
+
+/// Names hashing to `hash` or more, and less than the next key if any, are
+/// under `block`.
+struct RawDirectoryKey {
+    unsigned hash;
+    unsigned block;
+};
+
+static const unsigned NUM_DIRECTORY_KEYS
+  = (SECTOR_SIZE - sizeof (unsigned)) / sizeof (RawDirectoryKey);
+
+/// Inner node of the tree.  Keys are sorted by `hash`.
+struct RawDirectoryIndex {
+    unsigned numKeys;
+    RawDirectoryKey keys[NUM_DIRECTORY_KEYS];
+};
+
+/// Entry of a leaf, followed by its name, with no trailing `'\0'`, and
+/// padding up to a multiple of 4 bytes.
+struct RawDirectoryRecord {
+    unsigned hash;
+    unsigned sector;      ///< Sector of the file header.
+    uint16_t isDir;
+    uint16_t nameLength;
+};
+
+static const unsigned DIRECTORY_LEAF_BYTES = SECTOR_SIZE - sizeof (unsigned);
+
+/// Leaf of the tree, holding records one after the other, in no order.
+struct RawDirectoryLeaf {
+    unsigned used;        ///< Bytes of `records` in use.
+    char records[DIRECTORY_LEAF_BYTES];
+};
+
+/// Any block but the header; which one it is follows from its depth.
+union RawDirectoryBlock {
+    RawDirectoryIndex index;
+    RawDirectoryLeaf leaf;
+};
+
 
 #endif
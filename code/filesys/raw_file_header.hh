@@ -10,27 +10,41 @@
 #include "machine/disk.hh"
 
 
-static const unsigned NUM_DIRECT
-  = (SECTOR_SIZE - 6 * sizeof (int)) / sizeof (int);
-static const unsigned NUM_DIRECT2
-  = SECTOR_SIZE / sizeof (int);
-const unsigned MAX_FILE_SIZE = (NUM_DIRECT + NUM_DIRECT2 + NUM_DIRECT2 * NUM_DIRECT2) * SECTOR_SIZE;
+/// A run of `length` sectors of a file, from sector `first` of the file on,
+/// kept in consecutive sectors of the disk from `start` on.
+///
+/// In the inner nodes of the extent tree, `start` is the sector holding a
+/// child node instead, and `length` the number of file sectors under it.
+struct RawExtent {
+    unsigned first;
+    unsigned length;
+    unsigned start;
+};
+
+static const unsigned NUM_ROOT_EXTENTS
+  = (SECTOR_SIZE - 4 * sizeof (unsigned)) / sizeof (RawExtent);
+static const unsigned NUM_NODE_EXTENTS
+  = (SECTOR_SIZE - 2 * sizeof (unsigned)) / sizeof (RawExtent);
 
+/// Files can take the whole disk, as far as the header is concerned.
+const unsigned MAX_FILE_SIZE = NUM_SECTORS * SECTOR_SIZE;
+
+/// The root of the extent tree is kept in the header itself.  Extents are
+/// sorted by `first`, and cover the file with no holes.
 struct RawFileHeader {
-    unsigned numBytes;  ///< Number of bytes in the file.
+    unsigned numBytes;    ///< Number of bytes in the file.
     unsigned numSectors;  ///< Number of data sectors in the file.
-    unsigned dataSectors[NUM_DIRECT];  ///< Disk sector numbers for each data
-                                       ///< block in the file.
-    unsigned fiQuantity = 0;
-    unsigned siQuantity = 0;
-    int firstIndirection = -1;
-    int secondIndirection = -1;
+    unsigned numExtents;  ///< Entries in use in `extents`.
+    unsigned depth;       ///< Levels of nodes under the root; zero if
+                          ///< `extents` holds the runs of data themselves.
+    RawExtent extents[NUM_ROOT_EXTENTS];
 };
 
-
-struct RawFileIndirection
-{
-    unsigned dataSectors[NUM_DIRECT2];
+/// A node of the extent tree other than the root, one per sector.
+struct RawExtentNode {
+    unsigned numExtents;
+    unsigned depth;       ///< Zero for leaves.
+    RawExtent extents[NUM_NODE_EXTENTS];
 };
 
 
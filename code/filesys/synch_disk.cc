@@ -3,9 +3,10 @@
 /// happens later on).  This is a layer on top of the disk providing a
 /// synchronous interface (requests wait until the request completes).
 ///
-/// Use a semaphore to synchronize the interrupt handlers with the pending
-/// requests.  And, because the physical disk can only handle one operation
-/// at a time, use a lock to enforce mutual exclusion.
+/// Use a semaphore per request to synchronize the interrupt handlers with
+/// the pending requests.  And, because the physical disk can only handle
+/// one operation at a time, queue the requests made while it is busy; the
+/// interrupt handler of each one starts the next.
 ///
 /// Copyright (c) 1992-1993 The Regents of the University of California.
 ///               2016-2021 Docentes de la Universidad Nacional de Rosario.
@@ -14,8 +15,13 @@
 
 
 #include "synch_disk.hh"
+#include "threads/system.hh"
 
 
+const char *DISK_POLICY_NAMES[NUM_DISK_POLICIES] = {
+    "fifo", "sstf", "clook"
+};
+
 /// Disk interrupt handler.  Need this to be a C routine, because C++ cannot
 /// handle pointers to member functions.
 static void
@@ -26,24 +32,32 @@ DiskRequestDone(void *arg)
     disk->RequestDone();
 }
 
+static inline unsigned
+Diff(unsigned a, unsigned b)
+{
+    return a > b ? a - b : b - a;
+}
+
 /// Initialize the synchronous interface to the physical disk, in turn
 /// initializing the physical disk.
 ///
 /// * `name` is a UNIX file name to be used as storage for the disk data
 ///   (usually, `DISK`).
-SynchDisk::SynchDisk(const char *name)
+/// * `aPolicy` is the order to serve queued requests in.
+SynchDisk::SynchDisk(const char *name, DiskPolicy aPolicy)
 {
-    semaphore = new Semaphore("synch disk", 0);
-    lock = new Lock("synch disk lock");
+    policy  = aPolicy;
+    pending = nullptr;
+    active  = nullptr;
+    head    = 0;
     disk = new Disk(name, DiskRequestDone, this);
 }
 
 /// De-allocate data structures needed for the synchronous disk abstraction.
 SynchDisk::~SynchDisk()
 {
+    ASSERT(active == nullptr);
     delete disk;
-    delete lock;
-    delete semaphore;
 }
 
 /// Read the contents of a disk sector into a buffer.  Return only after the
@@ -54,12 +68,7 @@ SynchDisk::~SynchDisk()
 void
 SynchDisk::ReadSector(int sectorNumber, char *data)
 {
-    ASSERT(data != nullptr);
-
-    lock->Acquire();  // Only one disk I/O at a time.
-    disk->ReadRequest(sectorNumber, data);
-    semaphore->P();   // Wait for interrupt.
-    lock->Release();
+    ReadSectors(sectorNumber, 1, data);
 }
 
 /// Write the contents of a buffer into a disk sector.  Return only
@@ -69,19 +78,172 @@ SynchDisk::ReadSector(int sectorNumber, char *data)
 /// * `data` are the new contents of the disk sector.
 void
 SynchDisk::WriteSector(int sectorNumber, const char *data)
+{
+    WriteSectors(sectorNumber, 1, data);
+}
+
+/// Read the contents of consecutive disk sectors into a buffer, with a
+/// single request: only the first sector pays for the seek and rotational
+/// delay.  Return only after the data has been read.
+///
+/// * `first` is the first disk sector to read.
+/// * `numSectors` is the number of sectors, which must all be in the same
+///   track.
+/// * `data` is the buffer to hold their contents.
+void
+SynchDisk::ReadSectors(unsigned first, unsigned numSectors, char *data)
 {
     ASSERT(data != nullptr);
 
-    lock->Acquire();  // only one disk I/O at a time
-    disk->WriteRequest(sectorNumber, data);
-    semaphore->P();   // wait for interrupt
-    lock->Release();
+    Request r;
+    r.sector     = first;
+    r.numSectors = numSectors;
+    r.data       = data;
+    r.writing    = false;
+    Submit(&r);
 }
 
-/// Disk interrupt handler.  Wake up any thread waiting for the disk
-/// request to finish.
+/// Write the contents of a buffer into consecutive disk sectors, with a
+/// single request.  Return only after the data has been written.
+///
+/// * `first` is the first disk sector to write.
+/// * `numSectors` is the number of sectors, which must all be in the same
+///   track.
+/// * `data` are their new contents.
+void
+SynchDisk::WriteSectors(unsigned first, unsigned numSectors,
+                        const char *data)
+{
+    ASSERT(data != nullptr);
+
+    Request r;
+    r.sector     = first;
+    r.numSectors = numSectors;
+    r.data       = (char *) data;
+    r.writing    = true;
+    Submit(&r);
+}
+
+void
+SynchDisk::Submit(Request *r)
+{
+    ASSERT(r != nullptr);
+    ASSERT(r->sector < NUM_SECTORS);
+    ASSERT(r->numSectors > 0 && r->sector % SECTORS_PER_TRACK + r->numSectors
+                                  <= SECTORS_PER_TRACK);
+
+    r->done = new Semaphore("synch disk request", 0);
+    r->next = nullptr;
+
+    IntStatus oldLevel = interrupt->SetLevel(INT_OFF);
+    Request **last = &pending;
+    while (*last != nullptr) {
+        last = &(*last)->next;
+    }
+    *last = r;
+    if (active == nullptr) {
+        Start(ChooseNext());
+    }
+    interrupt->SetLevel(oldLevel);
+
+    r->done->P();  // Wait for interrupt.
+    delete r->done;
+}
+
+SynchDisk::Request *
+SynchDisk::ChooseNext()
+{
+    ASSERT(interrupt->GetLevel() == INT_OFF);
+    ASSERT(pending != nullptr);
+
+    Request **chosen = &pending;
+    switch (policy) {
+        case DISK_POLICY_FIFO:
+            break;
+
+        case DISK_POLICY_SSTF: {
+            // The disk knows how long each request would take from where
+            // the head is now, track buffer included.
+            int best = disk->ComputeLatency(pending->sector,
+                                            pending->writing,
+                                            pending->numSectors);
+            for (Request **r = &pending->next; *r != nullptr;
+                 r = &(*r)->next) {
+                int latency = disk->ComputeLatency((*r)->sector,
+                                                   (*r)->writing,
+                                                   (*r)->numSectors);
+                if (latency < best) {
+                    best   = latency;
+                    chosen = r;
+                }
+            }
+            break;
+        }
+
+        case DISK_POLICY_CLOOK: {
+            // The closest request from the head up, or if there is none,
+            // the lowest one, starting a new sweep.
+            Request **lowest = &pending;
+            chosen = nullptr;
+            for (Request **r = &pending; *r != nullptr; r = &(*r)->next) {
+                unsigned sector = (*r)->sector;
+                if (sector < (*lowest)->sector) {
+                    lowest = r;
+                }
+                if (sector >= head
+                      && (chosen == nullptr || sector < (*chosen)->sector)) {
+                    chosen = r;
+                }
+            }
+            if (chosen == nullptr) {
+                chosen = lowest;
+            }
+            break;
+        }
+
+        default:
+            ASSERT(false);
+    }
+
+    Request *r = *chosen;
+    *chosen = r->next;
+    return r;
+}
+
+void
+SynchDisk::Start(Request *r)
+{
+    ASSERT(r != nullptr);
+    ASSERT(active == nullptr);
+
+    stats->numDiskSeekTicks += Diff(r->sector / SECTORS_PER_TRACK,
+                                    head / SECTORS_PER_TRACK) * SEEK_TIME;
+    active = r;
+    head   = r->sector + r->numSectors - 1;
+    if (r->writing) {
+        disk->WriteRequest(r->sector, r->data, r->numSectors);
+    } else {
+        disk->ReadRequest(r->sector, r->data, r->numSectors);
+    }
+}
+
+/// Disk interrupt handler.  Wake up the thread waiting for the disk
+/// request to finish, and start the next one.
 void
 SynchDisk::RequestDone()
 {
-    semaphore->V();
+    ASSERT(active != nullptr);
+
+    Request *r = active;
+    active = nullptr;
+    if (pending != nullptr) {
+        Start(ChooseNext());
+    }
+    r->done->V();
+}
+
+void
+SynchDisk::SetPolicy(DiskPolicy aPolicy)
+{
+    policy = aPolicy;
 }
@@ -10,10 +10,19 @@
 
 
 #include "machine/disk.hh"
-#include "threads/lock.hh"
 #include "threads/semaphore.hh"
 
 
+/// Order in which requests waiting for the disk are served.
+enum DiskPolicy {
+    DISK_POLICY_FIFO,   ///< Arrival order.
+    DISK_POLICY_SSTF,   ///< Shortest positioning time first.
+    DISK_POLICY_CLOOK,  ///< Circular elevator, sweeping up the disk.
+    NUM_DISK_POLICIES
+};
+
+extern const char *DISK_POLICY_NAMES[NUM_DISK_POLICIES];
+
 /// The following class defines a "synchronous" disk abstraction.
 ///
 /// As with other I/O devices, the raw physical disk is an asynchronous
@@ -24,11 +33,17 @@
 ///
 /// This class provides the abstraction that for any individual thread making
 /// a request, it waits around until the operation finishes before returning.
+///
+/// Requests made while the disk is busy are queued, and when it finishes
+/// one, the interrupt handler sends it the next according to the
+/// scheduling policy, so that the head moves less than if requests were
+/// served as threads happen to make them.
 class SynchDisk {
 public:
 
-    /// Initialize a synchronous disk, by initializing the raw Disk.
-    SynchDisk(const char *name);
+    /// Initialize a synchronous disk, by initializing the raw Disk, and
+    /// serve requests according to `policy`.
+    SynchDisk(const char *name, DiskPolicy policy);
 
     /// De-allocate the synch disk data.
     ~SynchDisk();
@@ -40,16 +55,47 @@ public:
     void ReadSector(int sectorNumber, char *data);
     void WriteSector(int sectorNumber, const char *data);
 
+    /// Read/write `numSectors` consecutive sectors, all in the same track,
+    /// in a single request.
+
+    void ReadSectors(unsigned first, unsigned numSectors, char *data);
+    void WriteSectors(unsigned first, unsigned numSectors, const char *data);
+
     /// Called by the disk device interrupt handler, to signal that the
     /// current disk operation is complete.
     void RequestDone();
 
+    /// Change the scheduling policy, for requests chosen from now on.
+    void SetPolicy(DiskPolicy policy);
+
 private:
+
+    struct Request {
+        unsigned sector;   ///< First of the run.
+        unsigned numSectors;
+        char *data;        ///< Only read from, when writing.
+        bool writing;
+        Semaphore *done;   ///< Signalled by the interrupt handler.
+        Request *next;     ///< In arrival order.
+    };
+
+    /// Queue `r`, or start it if the disk is idle, and wait until done.
+    void Submit(Request *r);
+
+    /// Take the request to serve next out of the queue.  Interrupts must
+    /// be disabled.
+    Request *ChooseNext();
+
+    /// Send `r` to the disk.
+    void Start(Request *r);
+
     Disk *disk;  ///< Raw disk device.
-    Semaphore *semaphore;  ///< To synchronize requesting thread with the
-                           ///< interrupt handler.
-    Lock *lock;  ///< Only one read/write request can be sent to the disk at
-                 ///< a time.
+    DiskPolicy policy;
+    Request *pending;  ///< Waiting for the disk.  Shared with the interrupt
+                       ///< handler, so only touched with interrupts off.
+    Request *active;   ///< Being served by the disk, null if idle.
+    unsigned head;     ///< Last sector of the last request sent to the
+                       ///< disk.
 };
 
 
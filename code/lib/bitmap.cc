@@ -9,6 +9,7 @@
 
 #include "bitmap.hh"
 
+#include <algorithm>
 #include <stdio.h>
 
 
@@ -23,15 +24,20 @@ Bitmap::Bitmap(unsigned nitems)
     numBits  = nitems;
     numWords = DivRoundUp(numBits, BITS_IN_WORD);
     map      = new unsigned [numWords];
-    for (unsigned i = 0; i < numBits; i++) {
-        Clear(i);
+    changed  = new bool [numWords];
+    for (unsigned i = 0; i < numWords; i++) {
+        map[i]     = 0;
+        changed[i] = true;
     }
+    numClear = numBits;
+    cursor   = 0;
 }
 
 /// De-allocate a bitmap.
 Bitmap::~Bitmap()
 {
     delete [] map;
+    delete [] changed;
 }
 
 /// Set the “nth” bit in a bitmap.
@@ -41,7 +47,11 @@ void
 Bitmap::Mark(unsigned which)
 {
     ASSERT(which < numBits);
+    if (!Test(which)) {
+        numClear--;
+    }
     map[which / BITS_IN_WORD] |= 1 << which % BITS_IN_WORD;
+    changed[which / BITS_IN_WORD] = true;
 }
 
 /// Clear the “nth” bit in a bitmap.
@@ -51,7 +61,14 @@ void
 Bitmap::Clear(unsigned which)
 {
     ASSERT(which < numBits);
+    if (Test(which)) {
+        numClear++;
+    }
+    if (which < cursor) {
+        cursor = which;
+    }
     map[which / BITS_IN_WORD] &= ~(1 << which % BITS_IN_WORD);
+    changed[which / BITS_IN_WORD] = true;
 }
 
 /// Return true if the “nth” bit is set.
@@ -64,35 +81,106 @@ Bitmap::Test(unsigned which) const
     return map[which / BITS_IN_WORD] & 1 << which % BITS_IN_WORD;
 }
 
-/// Return the number of the first bit which is clear.  As a side effect, set
-/// the bit (mark it as in use).  (In other words, find and allocate a bit.)
+unsigned
+Bitmap::ClearBits(unsigned w) const
+{
+    ASSERT(w < numWords);
+
+    unsigned bits = ~map[w];
+    if (w == numWords - 1 && numBits % BITS_IN_WORD != 0) {
+        bits &= (1u << numBits % BITS_IN_WORD) - 1;
+    }
+    return bits;
+}
+
+/// Return the number of the first bit which is clear.  As a side effect,
+/// set the bit (mark it as in use).  (In other words, find and allocate a
+/// bit.)
 ///
 /// If no bits are clear, return -1.
 int
 Bitmap::Find()
 {
-    for (unsigned i = 0; i < numBits; i++) {
-        if (!Test(i)) {
-            Mark(i);
-            return i;
+    if (numClear == 0) {
+        return -1;
+    }
+
+    // There are clear bits, and none before the cursor.
+    unsigned w = cursor / BITS_IN_WORD;
+    unsigned bits = ClearBits(w) & ~0u << cursor % BITS_IN_WORD;
+    while (bits == 0) {
+        bits = ClearBits(++w);
+    }
+
+    unsigned which = w * BITS_IN_WORD + __builtin_ctz(bits);
+    Mark(which);
+    cursor = which + 1;
+    return which;
+}
+
+int
+Bitmap::FindRunIn(unsigned from, unsigned to, unsigned n) const
+{
+    unsigned runStart = from, runLength = 0;
+    for (unsigned i = from; i < to; ) {
+        unsigned span = std::min(BITS_IN_WORD - i % BITS_IN_WORD, to - i);
+        unsigned mask = span == BITS_IN_WORD ? ~0u : (1u << span) - 1;
+        unsigned clear = ClearBits(i / BITS_IN_WORD) >> i % BITS_IN_WORD
+                         & mask;
+
+        // The clear bits at the beginning of the span make the current run
+        // longer.
+        unsigned k = clear == mask ? span : __builtin_ctz(~clear);
+        if (k > 0) {
+            if (runLength == 0) {
+                runStart = i;
+            }
+            runLength += k;
+            if (runLength >= n) {
+                return runStart;
+            }
+        }
+        if (k == span) {
+            i += span;
+            continue;
         }
+
+        // Bit `i + k` is set: start over at the next clear bit.
+        runLength = 0;
+        unsigned rest = clear >> k;
+        i += rest == 0 ? span : k + __builtin_ctz(rest);
     }
     return -1;
 }
 
+/// Return the number of the first of `n` clear bits in a row.  As a side
+/// effect, set the bits.
+///
+/// If there is no such run, return -1.
+int
+Bitmap::FindRun(unsigned n)
+{
+    ASSERT(n > 0);
+
+    if (n > numClear) {
+        return -1;
+    }
+    int first = FindRunIn(cursor, numBits, n);
+    if (first == -1) {
+        return -1;
+    }
+    for (unsigned i = first; i < first + n; i++) {
+        Mark(i);
+    }
+    return first;
+}
+
 /// Return the number of clear bits in the bitmap.  (In other words, how many
 /// bits are unallocated?)
 unsigned
 Bitmap::CountClear() const
 {
-    unsigned count = 0;
-
-    for (unsigned i = 0; i < numBits; i++) {
-        if (!Test(i)) {
-            count++;
-        }
-    }
-    return count;
+    return numClear;
 }
 
 /// Print the contents of the bitmap, for debugging.
@@ -121,6 +209,12 @@ Bitmap::FetchFrom(OpenFile *file)
 {
     ASSERT(file != nullptr);
     file->ReadAt((char *) map, numWords * sizeof (unsigned), 0);
+    numClear = 0;
+    for (unsigned i = 0; i < numWords; i++) {
+        changed[i] = false;
+        numClear += __builtin_popcount(ClearBits(i));
+    }
+    cursor = 0;
 }
 
 /// Store the contents of a bitmap to a Nachos file.
@@ -134,3 +228,27 @@ Bitmap::WriteBack(OpenFile *file) const
     ASSERT(file != nullptr);
     file->WriteAt((char *) map, numWords * sizeof (unsigned), 0);
 }
+
+/// Store the words of the bitmap changed since it was last fetched or
+/// stored, each run of them with a single write.
+///
+/// * `file` is the place to write the bitmap to.
+void
+Bitmap::WriteChanges(OpenFile *file)
+{
+    ASSERT(file != nullptr);
+
+    for (unsigned i = 0; i < numWords; ) {
+        if (!changed[i]) {
+            i++;
+            continue;
+        }
+        unsigned j = i;
+        for (; j < numWords && changed[j]; j++) {
+            changed[j] = false;
+        }
+        file->WriteAt((char *) &map[i], (j - i) * sizeof (unsigned),
+                      i * sizeof (unsigned));
+        i = j;
+    }
+}
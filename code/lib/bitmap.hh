@@ -3,7 +3,11 @@
 /// vector.
 ///
 /// The bitmap is represented as an array of unsigned integers, on which we
-/// do modulo arithmetic to find the bit we are interested in.
+/// do modulo arithmetic to find the bit we are interested in.  Searches go
+/// a word at a time, skipping whole words with no clear bits, and from a
+/// cursor that stays ahead of the stretch of set bits at the beginning,
+/// which grows as the bitmap fills up.  The number of clear bits is kept up
+/// to date rather than counted.
 ///
 /// The data structure is parameterized with with the number of bits being
 /// managed.
@@ -55,6 +59,12 @@ public:
     /// If no bits are clear, return -1.
     int Find();
 
+    /// Return the index of the first of `n` consecutive clear bits, and as
+    /// a side effect, set them.
+    ///
+    /// If there is no such run, return -1.
+    int FindRun(unsigned n);
+
     /// Return the number of clear bits.
     unsigned CountClear() const;
 
@@ -73,8 +83,18 @@ public:
     /// need to read and write the bitmap to a file.
     void WriteBack(OpenFile *file) const;
 
+    /// Write to disk only the words changed since the last `FetchFrom` or
+    /// `WriteChanges`.
+    void WriteChanges(OpenFile *file);
+
 private:
 
+    /// The clear bits of word `w` set, leaving out those past the end.
+    unsigned ClearBits(unsigned w) const;
+
+    /// First of `n` consecutive clear bits between `from` and `to`, or -1.
+    int FindRunIn(unsigned from, unsigned to, unsigned n) const;
+
     /// Number of bits in the bitmap.
     unsigned numBits;
 
@@ -85,6 +105,16 @@ private:
     /// Bit storage.
     unsigned *map;
 
+    /// Number of clear bits.
+    unsigned numClear;
+
+    /// Every bit before this one is set, so searches start here.
+    unsigned cursor;
+
+    /// Which words of `map` changed since they were last read from or
+    /// written to a file.
+    bool *changed;
+
 };
 
 
@@ -8,53 +8,237 @@ Coremap::Coremap(unsigned physPages)
     ASSERT(physPages > 0);
     numPhysPages = physPages;
     coreMapAdd = new AddressSpace*[numPhysPages];
+    refCount = new unsigned[numPhysPages];
+    textKey = new int[numPhysPages];
+    textVpn = new unsigned[numPhysPages];
+    pinned = new bool[numPhysPages];
     timers = new unsigned[numPhysPages];
     pages = new Bitmap(numPhysPages);
+    for (unsigned i = 0; i < numPhysPages; i++) {
+        coreMapAdd[i] = nullptr;
+        refCount[i] = 0;
+        textKey[i] = -1;
+        pinned[i] = false;
+    }
 }
 
 Coremap::~Coremap()
 {
     delete coreMapAdd;
+    delete refCount;
+    delete textKey;
+    delete textVpn;
+    delete [] pinned;
     delete timers;
     delete pages;
 }
 
+unsigned
+Coremap::CountPinned() const
+{
+    unsigned count = 0;
+    for (unsigned i = 0; i < numPhysPages; i++) {
+        if (pinned[i])
+            count++;
+    }
+    return count;
+}
+
 #ifdef SWAP
 unsigned
 Coremap::ReplacePage(AddressSpace* newSpace)
 {
     int physIndex = pages->Find();
 
-    if (physIndex == -1) {
-        unsigned victim = GetVictim();
-        AddressSpace* space = coreMapAdd[victim];
-        space->SwapPage(space->GetPhysicalPageIndex(victim));
+    // Evicting blocks, so someone else may take the frame freed before we
+    // do, and then we have to try again.
+    while (physIndex == -1) {
+        if (CountPinned() == numPhysPages) {
+            // We hold none of them: wait for their owners to map them, or
+            // for their eviction to finish.
+            currentThread->Yield();
+        } else {
+            // The TLB holds the freshest use and dirty bits.
+            AddressSpace::WriteBackTlb();
+            Evict(GetVictim());
+        }
         physIndex = pages->Find();
         DEBUG('v', "Succesfully swapped, newP: %d\n", physIndex);
     }
-    
+
     coreMapAdd[physIndex] = newSpace;
+    refCount[physIndex] = 1;
+    pinned[physIndex] = true;
     return (unsigned) physIndex;
 }
-#endif
+
+int
+Coremap::FindFree(AddressSpace* newSpace)
+{
+    int physIndex = pages->Find();
+    if (physIndex != -1) {
+        coreMapAdd[physIndex] = newSpace;
+        refCount[physIndex] = 1;
+        pinned[physIndex] = true;
+    }
+    return physIndex;
+}
+
+void
+Coremap::Unpin(unsigned frame)
+{
+    ASSERT(frame < numPhysPages);
+    pinned[frame] = false;
+}
+
+unsigned
+Coremap::CountFree() const
+{
+    return pages->CountClear();
+}
+
+void
+Coremap::Evict(unsigned frame)
+{
+    ASSERT(coreMapAdd[frame] != nullptr);
+    ASSERT(!pinned[frame]);
+
+    // Writing pages out blocks; nobody else may pick the frame meanwhile.
+    pinned[frame] = true;
+
+    // Frames may be shared by forked address spaces, by address spaces
+    // running the same executable, and by merged pages, which need not lie
+    // at the same virtual page.  Each one keeps its own copy in its swap
+    // file (or executable) from now on.
+    for (unsigned i = 0; i < Table<AddressSpace*>::SIZE; i++) {
+        AddressSpace* space = activeSpaces->Get(i);
+        if (space != nullptr)
+            space->SwapFrame(frame);
+    }
+
+    coreMapAdd[frame] = nullptr;
+    refCount[frame] = 0;
+    textKey[frame] = -1;
+    pinned[frame] = false;
+    pages->Clear(frame);
+}
+
+void
+Coremap::Share(unsigned frame)
+{
+    ASSERT(frame < numPhysPages);
+    ASSERT(refCount[frame] > 0);
+    refCount[frame]++;
+}
+
+unsigned
+Coremap::GetRefCount(unsigned frame) const
+{
+    ASSERT(frame < numPhysPages);
+    return refCount[frame];
+}
 
 void
-Coremap::Clear(AddressSpace* space)
+Coremap::Release(unsigned frame, AddressSpace* space)
 {
-    for (unsigned i=0;i<numPhysPages;++i) {
-        if (coreMapAdd[i] == space)
-            pages->Clear(i);
+    ASSERT(frame < numPhysPages);
+    ASSERT(refCount[frame] > 0);
+
+    if (--refCount[frame] == 0) {
+        coreMapAdd[frame] = nullptr;
+        textKey[frame] = -1;
+        pages->Clear(frame);
+        return;
+    }
+    if (coreMapAdd[frame] != space)
+        return;
+
+    // Hand the frame over to another address space still mapping it.  If
+    // there is none, `space` maps it at some other page as well.
+    for (unsigned i = 0; i < Table<AddressSpace*>::SIZE; i++) {
+        AddressSpace* other = activeSpaces->Get(i);
+        if (other != nullptr && other != space && other->HoldsFrame(frame)) {
+            coreMapAdd[frame] = other;
+            return;
+        }
     }
 }
 
+int
+Coremap::FindText(int key, unsigned vpn) const
+{
+    for (unsigned i = 0; i < numPhysPages; i++) {
+        if (textKey[i] == key && textVpn[i] == vpn)
+            return i;
+    }
+    return -1;
+}
+
+void
+Coremap::SetText(unsigned frame, int key, unsigned vpn)
+{
+    ASSERT(frame < numPhysPages);
+    ASSERT(refCount[frame] > 0);
+    textKey[frame] = key;
+    textVpn[frame] = vpn;
+}
+
+bool
+Coremap::CanMerge(unsigned frame) const
+{
+    ASSERT(frame < numPhysPages);
+    if (refCount[frame] == 0 || textKey[frame] != -1 || pinned[frame])
+        return false;
+
+    // A frame being loaded or swapped out is allocated, but no page maps
+    // it.
+    bool held = false;
+    for (unsigned i = 0; i < Table<AddressSpace*>::SIZE; i++) {
+        AddressSpace* space = activeSpaces->Get(i);
+        if (space == nullptr || !space->HoldsFrame(frame))
+            continue;
+        if (!space->MayMerge(frame))
+            return false;
+        held = true;
+    }
+    return held;
+}
+
+void
+Coremap::Merge(unsigned from, unsigned into)
+{
+    ASSERT(from < numPhysPages && into < numPhysPages && from != into);
+    ASSERT(refCount[from] > 0 && refCount[into] > 0);
+
+    for (unsigned i = 0; i < Table<AddressSpace*>::SIZE; i++) {
+        AddressSpace* space = activeSpaces->Get(i);
+        if (space == nullptr)
+            continue;
+        space->ProtectFrame(into);
+        unsigned moved = space->RemapFrame(from, into);
+        refCount[into] += moved;
+        refCount[from] -= moved;
+    }
+    ASSERT(refCount[from] == 0);
+
+    coreMapAdd[from] = nullptr;
+    textKey[from] = -1;
+    pages->Clear(from);
+}
+#endif
+
 unsigned
 Coremap::GetVictim()
 {
     DEBUG('v', "Getting Victims\n");
+    // Pinned frames are skipped: their owner may be the one waiting.
+    ASSERT(CountPinned() < numPhysPages);
 #ifdef PRPOLICY_CLOCK
     for (unsigned i = 0; i < numPhysPages; i++) {
         victimIndex++;
         victimIndex = victimIndex % numPhysPages;
+        if (pinned[victimIndex])
+            continue;
         AddressSpace* space = coreMapAdd[victimIndex];
         if (space == nullptr)
             return victimIndex;
@@ -68,6 +252,8 @@ Coremap::GetVictim()
     for (unsigned i = 0; i < numPhysPages; i++) {
         victimIndex++;
         victimIndex = victimIndex % numPhysPages;
+        if (pinned[victimIndex])
+            continue;
         AddressSpace* space = coreMapAdd[victimIndex];
         if (space == nullptr)
             return victimIndex;
@@ -86,6 +272,8 @@ Coremap::GetVictim()
     for (unsigned i = 0; i < numPhysPages; i++) {
         victimIndex++;
         victimIndex = victimIndex % numPhysPages;
+        if (pinned[victimIndex])
+            continue;
         AddressSpace* space = coreMapAdd[victimIndex];
         if (space == nullptr)
             return victimIndex;
@@ -99,6 +287,8 @@ Coremap::GetVictim()
     for (unsigned i = 0; i < numPhysPages; i++) {
         victimIndex++;
         victimIndex = victimIndex % numPhysPages;
+        if (pinned[victimIndex])
+            continue;
         AddressSpace* space = coreMapAdd[victimIndex];
         if (space == nullptr)
             return victimIndex;
@@ -112,19 +302,28 @@ Coremap::GetVictim()
     return victimIndex;
 #else
 #ifdef PRPOLICY_FIFO
-    return victimIndex++ % numPhysPages;
+    unsigned victim;
+    do {
+        victim = victimIndex++ % numPhysPages;
+    } while (pinned[victim]);
+    return victim;
 #else
 #ifdef PRPOLICY_LRU    
-    unsigned victim, m = 0;
+    int victim = -1;
+    unsigned m = 0;
     for (unsigned i = 0; i < numPhysPages; ++i)
-        if (timers[i] > m){
+        if (!pinned[i] && (victim == -1 || timers[i] > m)) {
             victim = i;
             m = timers[i];
         }
 
     return victim;
 #else
-    return rand() % numPhysPages;
+    unsigned victim;
+    do {
+        victim = rand() % numPhysPages;
+    } while (pinned[victim]);
+    return victim;
 #endif
 #endif
 #endif
@@ -140,9 +339,3 @@ Coremap::UpdateTimers(unsigned pageUsed)
     timers[pageUsed] = 0;
 }
 #endif
-
-void
-Coremap::ClearPageIndex(unsigned page)
-{
-    pages->Clear(page);
-}
\ No newline at end of file
@@ -10,18 +10,74 @@ public:
 
     ~Coremap();
 
+    /// Take a frame for `newSpace`, evicting a page if there is none free.
+    /// The frame is pinned: it will not be evicted, nor merged, until the
+    /// page loaded into it is mapped and `Unpin` is called.
     unsigned ReplacePage(AddressSpace* newSpace);
 
-    void Clear(AddressSpace* space);
+    /// Like `ReplacePage`, but never evicts: returns -1 if there is no free
+    /// frame.
+    int FindFree(AddressSpace* newSpace);
 
+    /// The page loaded into `frame` is now mapped, so the frame may be
+    /// evicted like any other.
+    void Unpin(unsigned frame);
+
+    /// Number of frames not in use.
+    unsigned CountFree() const;
+
+    /// Account one more address space mapping `frame`.
+    void Share(unsigned frame);
+
+    /// Number of address spaces mapping `frame`.
+    unsigned GetRefCount(unsigned frame) const;
+
+    /// `space` stops mapping `frame`; the frame is freed once nobody maps
+    /// it.
+    void Release(unsigned frame, AddressSpace* space);
+
+    /// Find the frame holding code page `vpn` of the executable identified
+    /// by `key`, or return -1.
+    int FindText(int key, unsigned vpn) const;
+
+    /// Record that `frame` holds code page `vpn` of executable `key`, so
+    /// that other address spaces running it can map the same frame.
+    void SetText(unsigned frame, int key, unsigned vpn);
+
+    /// Check whether `frame` holds pages that may share a frame with
+    /// others of the same contents (see `AddressSpace::MayMerge`).
+    bool CanMerge(unsigned frame) const;
+
+    /// Make every page at frame `from` share frame `into` copy-on-write,
+    /// both holding the same contents, and free `from`.
+    void Merge(unsigned from, unsigned into);
+
+    /// Frame to evict next, by the replacement policy.  Pinned frames are
+    /// never chosen, and some frame must not be.
     unsigned GetVictim();
     
     void UpdateTimers(unsigned pageUsed);
 
-    void ClearPageIndex(unsigned pageUsed);
-
 private:
+    /// Swap out the page held in `frame` from every address space mapping
+    /// it, and free the frame.
+    void Evict(unsigned frame);
+
+    /// One of the address spaces mapping each frame.
     AddressSpace** coreMapAdd;
+    unsigned* refCount;
+
+    /// Executable and page of the code held by each frame; the key is -1
+    /// for frames not holding shared code.
+    int* textKey;
+    unsigned* textVpn;
+
+    /// Frames allocated but not mapped yet, or being evicted.
+    bool* pinned;
+
+    /// Number of frames pinned.
+    unsigned CountPinned() const;
+
     unsigned numPhysPages;
     unsigned victimIndex = 0;
     unsigned* timers;
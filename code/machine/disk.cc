@@ -93,60 +93,73 @@ PrintSector(bool writing, unsigned sector, const char *data)
 
 /// Disk::ReadRequest/WriteRequest
 ///
-/// Simulate a request to read/write a single disk sector.
+/// Simulate a request to read/write a run of consecutive disk sectors, all
+/// in the same track.
 ///
 /// Do the read/write immediately to the UNIX file.  Set up an interrupt
 /// handler to be called later, that will notify the caller when the
 /// simulator says the operation has completed.
 ///
-/// Note that a disk only allows an entire sector to be read/written, not
+/// Note that a disk only allows entire sectors to be read/written, not
 /// part of a sector.
 ///
-/// * `sectorNumber` is the disk sector to read/write.
+/// * `sectorNumber` is the first disk sector to read/write.
 /// * `data` are the bytes to be written, the buffer to hold the incoming
 ///   bytes.
+/// * `numSectors` is how many sectors to read/write.
 void
-Disk::ReadRequest(unsigned sectorNumber, char *data)
+Disk::ReadRequest(unsigned sectorNumber, char *data, unsigned numSectors)
 {
     ASSERT(data != nullptr);
 
-    int ticks = ComputeLatency(sectorNumber, false);
+    int ticks = ComputeLatency(sectorNumber, false, numSectors);
 
     ASSERT(!active);  // only one request at a time
     ASSERT(sectorNumber >= 0 && sectorNumber < NUM_SECTORS);
+    ASSERT(numSectors > 0 && sectorNumber % SECTORS_PER_TRACK + numSectors
+                               <= SECTORS_PER_TRACK);
 
-    DEBUG('d', "Reading from sector %u\n", sectorNumber);
+    DEBUG('d', "Reading from sector %u, %u sectors\n",
+          sectorNumber, numSectors);
     SystemDep::Lseek(fileno, SECTOR_SIZE * sectorNumber + MAGIC_SIZE, 0);
-    SystemDep::Read(fileno, data, SECTOR_SIZE);
+    SystemDep::Read(fileno, data, SECTOR_SIZE * numSectors);
     if (debug.IsEnabled('d')) {
-        PrintSector(false, sectorNumber, data);
+        for (unsigned i = 0; i < numSectors; i++) {
+            PrintSector(false, sectorNumber + i, &data[i * SECTOR_SIZE]);
+        }
     }
 
     active = true;
-    UpdateLast(sectorNumber);
+    UpdateLast(sectorNumber + numSectors - 1);
     stats->numDiskReads++;
     interrupt->Schedule(DiskDone, this, ticks, DISK_INT);
 }
 
 void
-Disk::WriteRequest(unsigned sectorNumber, const char *data)
+Disk::WriteRequest(unsigned sectorNumber, const char *data,
+                   unsigned numSectors)
 {
     ASSERT(data != nullptr);
 
-    int ticks = ComputeLatency(sectorNumber, true);
+    int ticks = ComputeLatency(sectorNumber, true, numSectors);
 
     ASSERT(!active);
     ASSERT(sectorNumber >= 0 && sectorNumber < NUM_SECTORS);
+    ASSERT(numSectors > 0 && sectorNumber % SECTORS_PER_TRACK + numSectors
+                               <= SECTORS_PER_TRACK);
 
-    DEBUG('d', "Writing to sector %u\n", sectorNumber);
+    DEBUG('d', "Writing to sector %u, %u sectors\n",
+          sectorNumber, numSectors);
     SystemDep::Lseek(fileno, SECTOR_SIZE * sectorNumber + MAGIC_SIZE, 0);
-    SystemDep::WriteFile(fileno, data, SECTOR_SIZE);
+    SystemDep::WriteFile(fileno, data, SECTOR_SIZE * numSectors);
     if (debug.IsEnabled('d')) {
-        PrintSector(true, sectorNumber, data);
+        for (unsigned i = 0; i < numSectors; i++) {
+            PrintSector(true, sectorNumber + i, &data[i * SECTOR_SIZE]);
+        }
     }
 
     active = true;
-    UpdateLast(sectorNumber);
+    UpdateLast(sectorNumber + numSectors - 1);
     stats->numDiskWrites++;
     interrupt->Schedule(DiskDone, this, ticks, DISK_INT);
 }
@@ -203,11 +216,15 @@ Disk::ModuloDiff(unsigned to, unsigned from)
     return (toOffset - fromOffset + SECTORS_PER_TRACK) % SECTORS_PER_TRACK;
 }
 
-/// Return how long will it take to read/write a disk sector, from
-/// the current position of the disk head.
+/// Return how long will it take to read/write a run of `numSectors` disk
+/// sectors starting at `newSector`, from the current position of the disk
+/// head.
 ///
 ///     Latency = seek time + rotational latency + transfer time
 ///
+/// Sectors of a run follow each other under the head, so only the first
+/// one pays for the seek and the rotational latency.
+///
 /// Disk seeks at one track per `SEEK_TIME` ticks (cf. `stats.hh`) and
 /// rotates at one sector per `ROTATION_TIME` ticks.
 ///
@@ -220,29 +237,33 @@ Disk::ModuloDiff(unsigned to, unsigned from)
 /// requests to the current track to be satisfied more quickly.  The contents
 /// of the track buffer are discarded after every seek to a new track.
 int
-Disk::ComputeLatency(unsigned newSector, bool writing)
+Disk::ComputeLatency(unsigned newSector, bool writing, unsigned numSectors)
 {
     unsigned rotation;
     unsigned seek      = TimeToSeek(newSector, &rotation);
     unsigned timeAfter = stats->totalTicks + seek + rotation;
+    unsigned transfer  = numSectors * ROTATION_TIME;
 
 #ifndef NOTRACKBUF  // Turn this on if you do not want the track buffer
                     // stuff.
-    // Check if track buffer applies.
+    // Check if track buffer applies, to the whole run.
+    unsigned lastInRun = newSector + numSectors - 1;
     if (!writing && seek == 0
         && (timeAfter - bufferInit) / ROTATION_TIME
-           > ModuloDiff(newSector, bufferInit / ROTATION_TIME)) {
-        DEBUG('d', "Request latency = %u\n", ROTATION_TIME);
-        return ROTATION_TIME;
-          // Time to transfer sector from the track buffer.
+           > ModuloDiff(newSector, bufferInit / ROTATION_TIME)
+        && (timeAfter - bufferInit) / ROTATION_TIME
+           > ModuloDiff(lastInRun, bufferInit / ROTATION_TIME)) {
+        DEBUG('d', "Request latency = %u\n", transfer);
+        return transfer;
+          // Time to transfer sectors from the track buffer.
     }
 #endif
 
     rotation += ModuloDiff(newSector, timeAfter / ROTATION_TIME)
                 * ROTATION_TIME;
 
-    DEBUG('d', "Request latency = %u\n", seek + rotation + ROTATION_TIME);
-    return seek + rotation + ROTATION_TIME;
+    DEBUG('d', "Request latency = %u\n", seek + rotation + transfer);
+    return seek + rotation + transfer;
 }
 
 /// Keep track of the most recently requested sector.  So we can know what is
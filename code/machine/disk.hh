@@ -74,21 +74,26 @@ public:
     Disk(const char *name, VoidFunctionPtr callWhenDone, void *callArg);
     ~Disk();  // Deallocate the disk.
 
-    /// Read/write an single disk sector.
+    /// Read/write a single disk sector, or `numSectors` consecutive ones
+    /// within a track.
     ///
     /// These routines send a request to the disk and return immediately.
     /// Only one request allowed at a time!
 
-    void ReadRequest(unsigned sectorNumber, char *data);
-    void WriteRequest(unsigned sectorNumber, const char *data);
+    void ReadRequest(unsigned sectorNumber, char *data,
+                     unsigned numSectors = 1);
+    void WriteRequest(unsigned sectorNumber, const char *data,
+                      unsigned numSectors = 1);
 
     /// Interrupt handler, invoked when disk request finishes.
     void HandleInterrupt();
 
-    /// Return how long a request to newSector will take.
+    /// Return how long a request to `numSectors` sectors from `newSector`
+    /// will take.
     ///
     ///     (seek + rotational delay + transfer)
-    int ComputeLatency(unsigned newSector, bool writing);
+    int ComputeLatency(unsigned newSector, bool writing,
+                       unsigned numSectors = 1);
 
 private:
     int fileno;  ///< UNIX file number for simulated disk.
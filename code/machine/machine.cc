@@ -50,7 +50,11 @@ Machine::~Machine()
 /// * `st` -- pointer to an object that performs single stepping, for
 ///   dropping into it after each user instruction is executed; if null,
 ///   execute normally, without single stepping.
-Machine::Machine(SingleStepper *st, unsigned aNumPhysicalPages): mmu(aNumPhysicalPages)
+/// * `tlbSize`, `tlbWays` -- number of TLB entries and associativity, if
+///   the machine has a TLB.
+Machine::Machine(SingleStepper *st, unsigned aNumPhysicalPages,
+                 unsigned tlbSize, unsigned tlbWays)
+  : mmu(aNumPhysicalPages, tlbSize, tlbWays)
 {
     for (unsigned i = 0; i < NUM_TOTAL_REGS; i++) {
         registers[i] = 0;
@@ -68,7 +68,8 @@ class Machine {
 public:
 
     /// Initialize the simulation of the hardware for running user programs.
-    Machine(SingleStepper *st, unsigned numPhysicalPages);
+    Machine(SingleStepper *st, unsigned numPhysicalPages,
+            unsigned tlbSize = TLB_SIZE, unsigned tlbWays = TLB_SIZE);
 
     ~Machine();
     /// Routines callable by the Nachos kernel.
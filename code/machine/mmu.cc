@@ -17,8 +17,9 @@
 /// there must also be a backup translation scheme (such as page tables), but
 /// the hardware does not need to know anything at all about that.
 ///
-/// Note that the contents of the TLB are specific to an address space.
-/// If the address space changes, so does the contents of the TLB!
+/// Entries in the TLB are tagged with the identifier of the address space
+/// they belong to, and only those matching `currentAsid` are used, so the
+/// TLB can keep entries of several address spaces across context switches.
 ///
 /// DO NOT CHANGE -- part of the machine emulation
 ///
@@ -37,18 +38,35 @@
 extern Machine* machine;
 
 
-MMU::MMU(unsigned aNumPhysPages)
+MMU::MMU(unsigned aNumPhysPages, unsigned aTlbSize, unsigned aTlbWays)
 {
     numPhysicalPages = aNumPhysPages;
     memorySize = numPhysicalPages * PAGE_SIZE;
+    tlbSize = aTlbSize;
+    tlbWays = aTlbWays;
+    tlbClock = 0;
 #ifdef USE_TLB
-    tlb = new TranslationEntry[TLB_SIZE];
-    for (unsigned i = 0; i < TLB_SIZE; i++) {
+    // An instruction may need its own page and the page of its operand at
+    // the same time, so a set holds at least two entries.
+    ASSERT(tlbWays >= 2 && tlbSize % tlbWays == 0);
+    tlbSets = tlbSize / tlbWays;
+    tlb = new TranslationEntry[tlbSize];
+    tlbLastUse = new unsigned long[tlbSize];
+    for (unsigned i = 0; i < tlbSize; i++) {
         tlb[i].valid = false;
+        tlbLastUse[i] = 0;
+    }
+    tlbFifo = new unsigned[tlbSets];
+    for (unsigned i = 0; i < tlbSets; i++) {
+        tlbFifo[i] = 0;
     }
     pageTable = nullptr;
+    currentAsid = 0;
 #else  // Use linear page table.
+    tlbSets = 0;
     tlb = nullptr;
+    tlbLastUse = nullptr;
+    tlbFifo = nullptr;
     pageTable = nullptr;
 #endif
    
@@ -58,18 +76,55 @@ MMU::~MMU()
 {
     if (tlb != nullptr) {
         delete [] tlb;
+        delete [] tlbLastUse;
+        delete [] tlbFifo;
     }
 }
 
+unsigned
+MMU::GetTlbSize() const
+{
+    return tlbSize;
+}
+
+unsigned
+MMU::GetTlbWays() const
+{
+    return tlbWays;
+}
+
+/// Consecutive pages of one address space fall in consecutive sets; the
+/// identifier is hashed so that the same page of different address spaces
+/// does not always compete for the same set.
+unsigned
+MMU::TlbSet(unsigned vpn, unsigned asid) const
+{
+    return (vpn + (asid * 2654435761u >> 16)) % tlbSets * tlbWays;
+}
+
+unsigned long
+MMU::GetTlbLastUse(unsigned i) const
+{
+    ASSERT(i < tlbSize);
+    return tlbLastUse[i];
+}
+
+unsigned
+MMU::NextTlbFifo(unsigned first)
+{
+    ASSERT(first < tlbSize && first % tlbWays == 0);
+    return first + tlbFifo[first / tlbWays]++ % tlbWays;
+}
+
 void
 MMU::PrintTLB() const
 {
 #ifdef USE_TLB
-    printf("TLB content (%u entries):\n", TLB_SIZE);
-    for (unsigned i = 0; i < TLB_SIZE; i++) {
+    printf("TLB content (%u entries, %u-way):\n", tlbSize, tlbWays);
+    for (unsigned i = 0; i < tlbSize; i++) {
         const TranslationEntry *e = &tlb[i];
-        printf("(%u) valid: %d, virt: %d, frame: %d, flags: %s%s%s\n",
-               i, e->valid, e->virtualPage, e->physicalPage,
+        printf("(%u) valid: %d, asid: %u, virt: %d, frame: %d, flags: %s%s%s\n",
+               i, e->valid, e->asid, e->virtualPage, e->physicalPage,
                (e->readOnly) ? "readonly " : "",
                (e->use)      ? "use " : "",
                (e->dirty)    ? "dirty" : "");
@@ -170,7 +225,7 @@ MMU::WriteMem(unsigned addr, unsigned size, int value)
 }
 
 ExceptionType
-MMU::RetrievePageEntry(unsigned vpn, TranslationEntry **entry) const
+MMU::RetrievePageEntry(unsigned vpn, TranslationEntry **entry)
 {
     ASSERT(entry != nullptr);
 
@@ -195,14 +250,19 @@ MMU::RetrievePageEntry(unsigned vpn, TranslationEntry **entry) const
         return NO_EXCEPTION;
 
     } else {
-        // Use the TLB.
+        // Use the TLB.  Only the set the page maps to needs to be searched.
 
-        unsigned i;
-        for (i = 0; i < TLB_SIZE; i++) {
+        unsigned first = TlbSet(vpn, currentAsid);
+        for (unsigned i = first; i < first + tlbWays; i++) {
             TranslationEntry *e = &tlb[i];
-            if (e->valid && e->virtualPage == vpn) {
+            if (e->valid && e->asid == currentAsid
+                  && e->virtualPage == vpn) {
                 *entry = e;  // FOUND!
+                tlbLastUse[i] = ++tlbClock;
                 stats->numPageHits++;
+#ifdef USE_TLB
+                stats->numTlbHits++;
+#endif
                 return NO_EXCEPTION;
             }
         }
@@ -210,6 +270,9 @@ MMU::RetrievePageEntry(unsigned vpn, TranslationEntry **entry) const
         // Not found.
         DEBUG_CONT('a', "no valid TLB entry found for this virtual page!\n");
         stats->numPageFaults++;
+#ifdef USE_TLB
+        stats->numTlbMisses++;
+#endif
         return PAGE_FAULT_EXCEPTION;  // Really, this is a TLB fault, the
                                       // page may be in memory, but not in
                                       // the TLB.
@@ -271,8 +334,9 @@ MMU::Translate(unsigned virtAddr, unsigned *physAddr,
         return BUS_ERROR_EXCEPTION;
     }
 
-    // Set the `use` and `dirty` flags.
-    entry->use = true;
+    // Set the `use`, `referenced` and `dirty` flags.
+    entry->use        = true;
+    entry->referenced = true;
     if (writing) {
         entry->dirty = true;
     }
@@ -22,9 +22,10 @@ const unsigned PAGE_SIZE = SECTOR_SIZE;  ///< Set the page size equal to the
 const unsigned DEFAULT_NUM_PHYS_PAGES = 32;
 const unsigned MEMORY_SIZE = DEFAULT_NUM_PHYS_PAGES * PAGE_SIZE;
 
-/// Number of entries in the TLB, if one is present.
+/// Default number of entries in the TLB, if one is present.
 ///
-/// If there is a TLB, it will be small compared to page tables.
+/// If there is a TLB, it will be small compared to page tables.  By default
+/// it is fully associative.
 const unsigned TLB_SIZE = 32;
 
 
@@ -33,7 +34,12 @@ const unsigned TLB_SIZE = 32;
 class MMU {
 public:
     // Initialize the MMU subsystem.
-    MMU(unsigned numPhysicalPages);
+    //
+    // The TLB, if present, has `tlbSize` entries grouped in sets of
+    // `tlbWays` entries each; `tlbWays` must divide `tlbSize` and be at
+    // least 2.
+    MMU(unsigned numPhysicalPages, unsigned tlbSize = TLB_SIZE,
+        unsigned tlbWays = TLB_SIZE);
 
     // Deallocate data structures.
     ~MMU();
@@ -47,6 +53,24 @@ public:
 
     void PrintTLB() const;
 
+    /// TLB geometry.
+
+    unsigned GetTlbSize() const;
+    unsigned GetTlbWays() const;
+
+    /// Index of the first entry of the set where the translation of `vpn`
+    /// in address space `asid` has to be cached.  The set spans
+    /// `GetTlbWays()` consecutive entries.
+    unsigned TlbSet(unsigned vpn, unsigned asid) const;
+
+    /// Time of the last translation done through TLB entry `i`, in number
+    /// of TLB hits.  Useful to refill the least recently used entry.
+    unsigned long GetTlbLastUse(unsigned i) const;
+
+    /// Entry of the set starting at `first` to refill next, in first in,
+    /// first out order; each call moves on to the following one.
+    unsigned NextTlbFifo(unsigned first);
+
     /// Data structures -- all of these are accessible to Nachos kernel code.
     /// “Public” for convenience.
     ///
@@ -79,11 +103,16 @@ public:
     TranslationEntry *pageTable;
     unsigned pageTableSize;
 
+    /// Address space identifier of the running program.  Only TLB entries
+    /// tagged with it are used for translation, so the TLB does not need to
+    /// be flushed on a context switch.
+    unsigned currentAsid;
+
 private:
 
     /// Retrieve a page entry either from a page table or the TLB.
     ExceptionType RetrievePageEntry(unsigned vpn,
-                                    TranslationEntry **entry) const;
+                                    TranslationEntry **entry);
 
     /// Translate an address, and check for alignment.
     ///
@@ -94,6 +123,15 @@ private:
                             unsigned size, bool writing);
     unsigned memorySize;
     unsigned numPhysicalPages;
+
+    unsigned tlbSize;
+    unsigned tlbWays;
+    unsigned tlbSets;
+
+    unsigned long *tlbLastUse;  ///< Value of `tlbClock` at the last hit on
+                                ///< each entry.
+    unsigned long tlbClock;     ///< Number of TLB hits so far.
+    unsigned *tlbFifo;          ///< Refills done in each set so far.
 };
 
 
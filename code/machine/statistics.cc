@@ -21,6 +21,34 @@ Statistics::Statistics()
     numDiskReads = numDiskWrites = 0;
     numConsoleCharsRead = numConsoleCharsWritten = 0;
     numPageFaults = numPageHits = 0;
+#ifdef USE_TLB
+    numTlbHits = numTlbMisses = numTlbRefills = 0;
+    tlbEntries = tlbWays = 0;
+    tlbPolicy = "";
+#endif
+#ifdef USER_PROGRAM
+    numExecCacheHits = numExecCacheMisses = numExecCacheEvictions = 0;
+    numThrottles = 0;
+#endif
+#ifdef DEMAND_LOADING
+    numPageLoads = numZeroFills = numTextShares = 0;
+    numPrefetches = numPrefetchHits = numPrefetchWasted = 0;
+#endif
+#ifdef SWAP
+    numCowFaults = numCowCopies = 0;
+    numMappedReads = numMappedWrites = 0;
+    numSwapCacheHits = numSwapCacheMisses = numSwapCacheStores = 0;
+    numSwapCacheSameFilled = numSwapCacheRejects = 0;
+    numSwapCacheWritebacks = 0;
+    numSwapCacheBytesIn = numSwapCacheBytesOut = 0;
+    numMergeScans = numMergedPages = numMergedFrames = 0;
+#endif
+#ifdef FILESYS
+    numDiskSeekTicks = 0;
+    numBufferCacheHits = numBufferCacheMisses = 0;
+    numBufferCacheWritebacks = 0;
+    numDentryCacheHits = numDentryCacheMisses = 0;
+#endif
 #ifdef DFS_TICKS_FIX
     tickResets = 0;
 #endif
@@ -41,7 +69,59 @@ Statistics::Print()
     printf("Ticks: total %lu, idle %lu, system %lu, user %lu\n",
            totalTicks, idleTicks, systemTicks, userTicks);
     printf("Disk I/O: reads %lu, writes %lu\n", numDiskReads, numDiskWrites);
+#ifdef FILESYS
+    printf("Disk seeks: %lu ticks\n", numDiskSeekTicks);
+#endif
     printf("Console I/O: reads %lu, writes %lu\n",
            numConsoleCharsRead, numConsoleCharsWritten);
     printf("Paging: faults %lu, hits: %lu, real hits: %lu, hit ratio: %.3f%%\n", numPageFaults, numPageHits, numPageHits-numPageFaults, ((double)(numPageHits-numPageFaults) / (numPageHits)) * 100);
+#ifdef USE_TLB
+    printf("TLB (%u entries, %u-way, %s refill): hits %lu, misses %lu,"
+           " refills %lu, miss ratio: %.3f%%\n",
+           tlbEntries, tlbWays, tlbPolicy,
+           numTlbHits, numTlbMisses, numTlbRefills,
+           numTlbHits + numTlbMisses == 0 ? 0.0 :
+             (double) numTlbMisses / (numTlbHits + numTlbMisses) * 100);
+#endif
+#ifdef USER_PROGRAM
+    printf("Executable cache: hits %lu, misses %lu, evictions %lu\n",
+           numExecCacheHits, numExecCacheMisses, numExecCacheEvictions);
+    printf("Thrashing: processes throttled %lu times\n", numThrottles);
+#endif
+#ifdef DEMAND_LOADING
+    printf("Page loads: from executable %lu, zero filled %lu,"
+           " shared code %lu\n",
+           numPageLoads, numZeroFills, numTextShares);
+    printf("Prefetch: pages %lu, hits %lu, wasted %lu\n",
+           numPrefetches, numPrefetchHits, numPrefetchWasted);
+#endif
+#ifdef SWAP
+    printf("Copy on write: faults %lu, copies %lu\n",
+           numCowFaults, numCowCopies);
+    printf("Mapped files: pages read %lu, written back %lu\n",
+           numMappedReads, numMappedWrites);
+    printf("Swap cache: hits %lu, misses %lu, hit ratio: %.3f%%\n",
+           numSwapCacheHits, numSwapCacheMisses,
+           numSwapCacheHits + numSwapCacheMisses == 0 ? 0.0 :
+             (double) numSwapCacheHits
+               / (numSwapCacheHits + numSwapCacheMisses) * 100);
+    printf("Swap cache: stored %lu (same filled %lu), not compressible %lu,"
+           " written back %lu, compression ratio: %.2f\n",
+           numSwapCacheStores, numSwapCacheSameFilled, numSwapCacheRejects,
+           numSwapCacheWritebacks,
+           numSwapCacheBytesOut == 0 ? 0.0 :
+             (double) numSwapCacheBytesIn / numSwapCacheBytesOut);
+    printf("Page merging: scans %lu, pages merged %lu, frames freed %lu\n",
+           numMergeScans, numMergedPages, numMergedFrames);
+#endif
+#ifdef FILESYS
+    printf("Buffer cache: hits %lu, misses %lu, written back %lu,"
+           " hit ratio: %.3f%%\n",
+           numBufferCacheHits, numBufferCacheMisses, numBufferCacheWritebacks,
+           numBufferCacheHits + numBufferCacheMisses == 0 ? 0.0 :
+             (double) numBufferCacheHits
+               / (numBufferCacheHits + numBufferCacheMisses) * 100);
+    printf("Dentry cache: hits %lu, misses %lu\n",
+           numDentryCacheHits, numDentryCacheMisses);
+#endif
 }
@@ -50,6 +50,130 @@ public:
     /// Number of virtual memory page "hits".
     unsigned long numPageHits;
 
+#ifdef USE_TLB
+    /// Number of translations found in the TLB.
+    unsigned long numTlbHits;
+
+    /// Number of translations missing from the TLB.
+    unsigned long numTlbMisses;
+
+    /// Number of TLB misses served straight from the page table, without
+    /// bringing the page into memory.
+    unsigned long numTlbRefills;
+
+    /// TLB geometry and refill policy the counters above refer to, so that
+    /// runs with different configurations can be told apart.
+    unsigned tlbEntries;
+    unsigned tlbWays;
+    const char *tlbPolicy;
+#endif
+
+#ifdef USER_PROGRAM
+    /// Number of programs run whose executable was found in the cache.
+    unsigned long numExecCacheHits;
+
+    /// Number of programs run whose executable had to be read.
+    unsigned long numExecCacheMisses;
+
+    /// Number of executables dropped from the cache to make room.
+    unsigned long numExecCacheEvictions;
+
+    /// Number of times a process gave way to others because its page fault
+    /// frequency showed it was thrashing.
+    unsigned long numThrottles;
+#endif
+
+#ifdef DEMAND_LOADING
+    /// Number of pages read from an executable.
+    unsigned long numPageLoads;
+
+    /// Number of uninitialized data and stack pages brought in by just
+    /// zeroing them.
+    unsigned long numZeroFills;
+
+    /// Number of code pages mapped from a frame already holding them for
+    /// another address space.
+    unsigned long numTextShares;
+
+    /// Number of pages loaded ahead of a fault by the prefetcher.
+    unsigned long numPrefetches;
+
+    /// Number of prefetched pages that were referenced before leaving
+    /// memory.
+    unsigned long numPrefetchHits;
+
+    /// Number of prefetched pages that were evicted or freed without ever
+    /// being referenced.
+    unsigned long numPrefetchWasted;
+#endif
+
+#ifdef SWAP
+    /// Number of writes to pages shared copy-on-write.
+    unsigned long numCowFaults;
+
+    /// Number of those that had to copy the page, because some other
+    /// address space still shared it.
+    unsigned long numCowCopies;
+
+    /// Number of pages of mapped files read from them.
+    unsigned long numMappedReads;
+
+    /// Number of dirty pages of mapped files written back to them.
+    unsigned long numMappedWrites;
+
+    /// Number of pages read back from swap found in the swap cache.
+    unsigned long numSwapCacheHits;
+
+    /// Number of pages read back from swap that had to come from disk.
+    unsigned long numSwapCacheMisses;
+
+    /// Number of evicted pages kept in the swap cache.
+    unsigned long numSwapCacheStores;
+
+    /// Number of those filled with a single repeated word.
+    unsigned long numSwapCacheSameFilled;
+
+    /// Number of evicted pages that did not compress, and went to disk.
+    unsigned long numSwapCacheRejects;
+
+    /// Number of pages pushed out of the full swap cache to disk.
+    unsigned long numSwapCacheWritebacks;
+
+    /// Bytes of pages stored in the swap cache, before and after
+    /// compression.
+    unsigned long numSwapCacheBytesIn;
+    unsigned long numSwapCacheBytesOut;
+
+    /// Number of times memory was scanned for identical pages.
+    unsigned long numMergeScans;
+
+    /// Number of pages made to share a frame with identical ones.
+    unsigned long numMergedPages;
+
+    /// Number of frames freed by doing so.
+    unsigned long numMergedFrames;
+#endif
+
+#ifdef FILESYS
+    /// Ticks the disk spent moving its head between tracks.
+    unsigned long numDiskSeekTicks;
+
+    /// Number of sector reads and writes found in the buffer cache.
+    unsigned long numBufferCacheHits;
+
+    /// Number of those that were not.
+    unsigned long numBufferCacheMisses;
+
+    /// Number of dirty sectors written back from the buffer cache.
+    unsigned long numBufferCacheWritebacks;
+
+    /// Number of path components resolved from the dentry cache.
+    unsigned long numDentryCacheHits;
+
+    /// Number of those that needed reading the directory.
+    unsigned long numDentryCacheMisses;
+#endif
+
     /// Number of packets sent over the network.
     unsigned long numPacketsSent;
 
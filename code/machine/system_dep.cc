@@ -34,6 +34,7 @@ extern "C" {
 #include <sys/types.h>
 #include <sys/socket.h>
 #include <sys/file.h>
+#include <sys/stat.h>
 #include <sys/un.h>
 #include <sys/mman.h>
 #ifdef HOST_i386
@@ -181,6 +182,18 @@ Tell(int fd)
 #endif
 }
 
+/// Report the inode number of an open file.
+///
+/// Abort on error.
+int
+FileId(int fd)
+{
+    struct stat st;
+    int retVal = fstat(fd, &st);
+    ASSERT(retVal >= 0);
+    return (int) st.st_ino;
+}
+
 /// Close a file.
 ///
 /// Abort on error.
@@ -41,6 +41,10 @@ namespace SystemDep {
 
     int Tell(int fd);
 
+    /// Identify the file open as `fd`, regardless of its name: two open
+    /// files give the same number if and only if they are the same file.
+    int FileId(int fd);
+
     void Close(int fd);
 
     bool Unlink(const char *name);
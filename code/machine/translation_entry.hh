@@ -38,6 +38,11 @@ public:
     /// `mainMemory`).
     unsigned physicalPage;
 
+    /// Identifier of the address space the entry belongs to.  Only looked
+    /// at by the TLB, so that entries of several address spaces can be
+    /// cached at the same time.
+    unsigned asid;
+
     /// If this bit is set, the translation is ignored.
     ///
     /// (In other words, the entry has not been initialized.)
@@ -54,7 +59,20 @@ public:
     /// This bit is set by the hardware every time the page is modified.
     bool dirty;
 
+    /// Set by the hardware along with `use`, but only cleared by working
+    /// set sampling, so that page replacement keeps its own use bits.
+    bool referenced;
+
     bool isInSwap;
+
+    /// Set along with `readOnly` while the page shares its frame with a
+    /// forked address space: writing to it makes a private copy instead of
+    /// being an error.
+    bool copyOnWrite;
+
+    /// Set when the page was brought into memory by the prefetcher and has
+    /// not been referenced since.
+    bool prefetched;
 };
 
 
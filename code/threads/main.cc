@@ -12,10 +12,15 @@
 ///
 ///     nachos [-d <debugflags>] [-do <debugopts>] 
 ///            [-rs <random seed #>] [-z] [-tt|-tN] 
-///            [-m <num phys pages>]
+///            [-m <num phys pages>] [-pf <num pages>] [-xc <num files>]
+///            [-pff <num ticks>] [-ms] [-sc <num bytes>]
+///            [-pm <num ticks>]
+///            [-tlb <num entries> <num ways>] [-tlbp <policy>]
 ///            [-s] [-x <nachos file>] [-tc <consoleIn> <consoleOut>] 
 ///            [-f] [-cp <unix file> <nachos file>] [-pr <nachos file>]
 ///            [-rm <nachos file>] [-ls] [-D] [-c] [-tf]
+///            [-bc <num sectors>] [-bf <num ticks>] [-dp <policy>] [-td]
+///            [-tl] [-tb] [-tn] [-to]
 ///
 /// General options
 /// ---------------
@@ -27,6 +32,16 @@
 /// * `-rs` -- causes `Yield` to occur at random (but repeatable) spots.
 /// * `-z`  -- prints version and copyright information, and exits.
 /// * `-m`  -- size of emulated physical memory (in pages)
+/// * `-pf` -- number of pages to prefetch when page faults follow a
+///            sequential or strided pattern (0 disables prefetching).
+/// * `-sc` -- bytes of host memory for compressed pages evicted to swap
+///            (0 sends them straight to the swap files).
+/// * `-pm` -- ticks between scans of memory for identical pages, which are
+///            then merged into a single frame shared copy-on-write (0
+///            disables merging).
+/// * `-tlb` -- number of TLB entries and their associativity, at least 2 and
+///            dividing the number of entries.
+/// * `-tlbp` -- TLB refill policy: `fifo`, `random`, `nru` or `lru`.
 ///
 /// *THREADS* options
 /// -----------------
@@ -40,6 +55,13 @@
 ///
 /// * `-s`  -- causes user programs to be executed in single-step mode.
 /// * `-x`  -- runs a user program.
+/// * `-xc` -- number of executables to keep cached in memory, so that
+///            running them again does not read them from the file system
+///            (0 disables the cache).
+/// * `-pff` -- ticks between page faults that read from disk below which a
+///            process is taken to be thrashing and is made to yield, while
+///            memory is full (0 disables throttling).
+/// * `-ms` -- prints the memory counters of each process when it exits.
 /// * `-tc` -- tests the console.
 ///
 /// *FILESYS* options
@@ -53,6 +75,19 @@
 /// * `-D`  -- prints the contents of the entire file system.
 /// * `-c`  -- checks the filesystem integrity.
 /// * `-tf` -- tests the performance of the Nachos file system.
+/// * `-bc` -- number of disk sectors kept in the buffer cache.
+/// * `-bf` -- ticks between write backs of the dirty sectors in the buffer
+///            cache (0 only writes them back when replaced or at halt).
+/// * `-dp` -- order to serve queued disk requests in: `fifo`, `sstf` or
+///            `clook`.
+/// * `-td` -- compares the seek time of the disk scheduling policies with
+///            many concurrent readers.
+/// * `-tl` -- compares reading back files written alone and at the same
+///            time.
+/// * `-tb` -- times searches in a mostly full bitmap.
+/// * `-tn` -- measures file operations in a directory with many files.
+/// * `-to` -- checks that directories in the old flat format are read, and
+///            converted when written.
 ///
 /// ----
 ///
@@ -84,6 +119,11 @@
 void Copy(const char *unixFile, const char *nachosFile);
 void Print(const char *file);
 void PerformanceTest(void);
+void DiskSchedulingTest(void);
+void FileLayoutTest(void);
+void BitmapTest(void);
+void DirectoryTest(void);
+void FlatDirectoryTest(void);
 void StartProcess(const char *file);
 void ConsoleTest(const char *in, const char *out);
 
@@ -178,6 +218,16 @@ main(int argc, char **argv)
             printf("Filesystem check %s.\n", result ? "succeeded" : "failed");
         } else if (!strcmp(*argv, "-tf")) {  // Performance test.
             PerformanceTest();
+        } else if (!strcmp(*argv, "-td")) {  // Disk scheduling test.
+            DiskSchedulingTest();
+        } else if (!strcmp(*argv, "-tl")) {  // File layout test.
+            FileLayoutTest();
+        } else if (!strcmp(*argv, "-tb")) {  // Bitmap search test.
+            BitmapTest();
+        } else if (!strcmp(*argv, "-tn")) {  // Large directory test.
+            DirectoryTest();
+        } else if (!strcmp(*argv, "-to")) {  // Flat directory test.
+            FlatDirectoryTest();
         }
 #endif
     }
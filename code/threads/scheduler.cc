@@ -143,9 +143,14 @@ void
 Scheduler::TransferPriority(Thread* thread, unsigned number) {
     ASSERT(number >= 0 && number < QUANTITY_PRIORITY_QUEUES);
     DEBUG('t', "Transfering piority %d to thread \"%s\"", number, thread->GetName());
-    priorityQueue[thread->GetPriority()]->Remove(thread);
+    // Only a thread that is waiting on the ready list has to change queues;
+    // a running or blocked one is queued with its new priority later on.
+    bool ready = priorityQueue[thread->GetPriority()]->Has(thread);
+    if (ready)
+        priorityQueue[thread->GetPriority()]->Remove(thread);
     thread->SetPriority(number);
-    priorityQueue[number]->Append(thread);
+    if (ready)
+        priorityQueue[number]->Append(thread);
 }
 
 /// Print the scheduler state -- in other words, the contents of the ready
@@ -2,6 +2,7 @@
 #include "copyright.h"
 #include "filesys/directory_entry.hh"
 #include "filesys/file_system.hh"
+#include "filesys/raw_directory.hh"
 #include "filesys/raw_file_header.hh"
 #include "machine/mmu.hh"
 
@@ -62,12 +63,15 @@ Disk:\n\
   SECTOR_SIZE, SECTORS_PER_TRACK, NUM_TRACKS, NUM_SECTORS, DISK_SIZE);
     printf("\n\
 Filesystem:\n\
-  Sectors per header: %u.\n\
+  Extents in a header: %u.\n\
+  Extents per tree node: %u.\n\
   Maximum file size: %u bytes.\n\
   File name maximum length: %u.\n\
   Free sectors map size: %u bytes.\n\
-  Maximum number of dir-entries: %u.\n\
-  Directory file size: %u bytes.\n",
-      NUM_DIRECT, MAX_FILE_SIZE, FILE_NAME_MAX_LEN,
-      FREE_MAP_FILE_SIZE, NUM_DIR_ENTRIES, DIRECTORY_FILE_SIZE);
+  Keys per directory index block: %u.\n\
+  Bytes of records per directory leaf: %u.\n\
+  Initial directory file size: %u bytes.\n",
+      NUM_ROOT_EXTENTS, NUM_NODE_EXTENTS, MAX_FILE_SIZE, FILE_NAME_MAX_LEN,
+      FREE_MAP_FILE_SIZE, NUM_DIRECTORY_KEYS, DIRECTORY_LEAF_BYTES,
+      DIRECTORY_FILE_SIZE);
 }
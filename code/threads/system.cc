@@ -36,14 +36,20 @@ FileSystem *fileSystem;
 
 #ifdef FILESYS
 SynchDisk *synchDisk;
+BufferCache *bufferCache;
 #endif
 
 #ifdef USER_PROGRAM  // Requires either *FILESYS* or *FILESYS_STUB*.
 Machine *machine;  ///< User program memory and registers.
 SynchConsole *synchconsole;
 Table<Thread*> *activeThreads;
+ExecutableCache *executableCache;
+unsigned pffThreshold = 200;
+bool printSpaceStats = false;
 #ifdef SWAP
 Coremap *coreMap;
+SwapCache *swapCache;
+PageMerger *pageMerger;
 #else
 Bitmap *pages;
 #endif
@@ -51,6 +57,16 @@ Bitmap *pages;
 
 #ifdef USE_TLB
 const unsigned NUMBER_OF_TRIES = 5;
+Table<AddressSpace*> *activeSpaces;
+TlbPolicy tlbPolicy = TLB_POLICY_LRU;
+
+static const char *TLB_POLICY_NAMES[NUM_TLB_POLICIES] = {
+    "fifo", "random", "nru", "lru"
+};
+#endif
+
+#ifdef DEMAND_LOADING
+unsigned prefetchWindow = 4;
 #endif
 
 // External definition, to allow us to take a pointer to this function.
@@ -111,6 +127,40 @@ ParseDebugOpts(char *s, DebugOpts *out)
     return true;
 }
 
+#ifdef FILESYS
+static bool
+ParseDiskPolicy(const char *s, DiskPolicy *out)
+{
+    ASSERT(s != nullptr);
+    ASSERT(out != nullptr);
+
+    for (unsigned i = 0; i < NUM_DISK_POLICIES; i++) {
+        if (strcmp(s, DISK_POLICY_NAMES[i]) == 0) {
+            *out = (DiskPolicy) i;
+            return true;
+        }
+    }
+    return false;  // Invalid policy.
+}
+#endif
+
+#ifdef USE_TLB
+static bool
+ParseTlbPolicy(const char *s, TlbPolicy *out)
+{
+    ASSERT(s != nullptr);
+    ASSERT(out != nullptr);
+
+    for (unsigned i = 0; i < NUM_TLB_POLICIES; i++) {
+        if (strcmp(s, TLB_POLICY_NAMES[i]) == 0) {
+            *out = (TlbPolicy) i;
+            return true;
+        }
+    }
+    return false;  // Invalid policy.
+}
+#endif
+
 /// Initialize Nachos global data structures.
 ///
 /// Interpret command line arguments in order to determine flags for the
@@ -136,10 +186,24 @@ Initialize(int argc, char **argv)
 #ifdef USER_PROGRAM
     bool debugUserProg = false;  // Single step user program.
     int numPhysicalPages = DEFAULT_NUM_PHYS_PAGES;
+    unsigned execCacheSize = 4;  // Executables kept in memory.
+#endif
+#ifdef SWAP
+    unsigned swapCacheSize = 4096;  // Bytes of compressed pages.
+    unsigned mergeInterval = 1000;  // Ticks between scans for equal pages.
+#endif
+#ifdef USE_TLB
+    unsigned tlbSize = TLB_SIZE;
+    unsigned tlbWays = TLB_SIZE;  // Fully associative.
 #endif
 #ifdef FILESYS_NEEDED
     bool format = false;  // Format disk.
 #endif
+#ifdef FILESYS
+    unsigned bufferCacheSize = 64;      // Sectors cached.
+    unsigned flushInterval   = 100000;  // Ticks between write backs.
+    DiskPolicy diskPolicy = DISK_POLICY_CLOOK;
+#endif
 
     for (argc--, argv++; argc > 0; argc -= argCount, argv += argCount) {
         argCount = 1;
@@ -171,11 +235,76 @@ Initialize(int argc, char **argv)
             numPhysicalPages = atoi(*(argv + 1));
             argCount = 2;
         }
+        if (!strcmp(*argv, "-pff")) {
+            ASSERT(argc > 1);
+            pffThreshold = atoi(*(argv + 1));
+            argCount = 2;
+        }
+        if (!strcmp(*argv, "-ms")) {
+            printSpaceStats = true;
+        }
+        if (!strcmp(*argv, "-xc")) {
+            ASSERT(argc > 1);
+            execCacheSize = atoi(*(argv + 1));
+            argCount = 2;
+        }
+#endif
+#ifdef USE_TLB
+        if (!strcmp(*argv, "-tlb")) {
+            ASSERT(argc > 2);
+            tlbSize = atoi(*(argv + 1));
+            tlbWays = atoi(*(argv + 2));
+            // At least two ways per set, and whole sets.
+            ASSERT(tlbWays >= 2 && tlbSize >= tlbWays
+                     && tlbSize % tlbWays == 0);
+            argCount = 3;
+        }
+        if (!strcmp(*argv, "-tlbp")) {
+            ASSERT(argc > 1);
+            ASSERT(ParseTlbPolicy(*(argv + 1), &tlbPolicy));
+            argCount = 2;
+        }
+#endif
+#ifdef SWAP
+        if (!strcmp(*argv, "-sc")) {
+            ASSERT(argc > 1);
+            swapCacheSize = atoi(*(argv + 1));
+            argCount = 2;
+        }
+        if (!strcmp(*argv, "-pm")) {
+            ASSERT(argc > 1);
+            mergeInterval = atoi(*(argv + 1));
+            argCount = 2;
+        }
+#endif
+#ifdef DEMAND_LOADING
+        if (!strcmp(*argv, "-pf")) {
+            ASSERT(argc > 1);
+            prefetchWindow = atoi(*(argv + 1));
+            argCount = 2;
+        }
 #endif
 #ifdef FILESYS_NEEDED
         if (!strcmp(*argv, "-f")) {
             format = true;
         }
+#endif
+#ifdef FILESYS
+        if (!strcmp(*argv, "-bc")) {
+            ASSERT(argc > 1);
+            bufferCacheSize = atoi(*(argv + 1));
+            argCount = 2;
+        }
+        if (!strcmp(*argv, "-bf")) {
+            ASSERT(argc > 1);
+            flushInterval = atoi(*(argv + 1));
+            argCount = 2;
+        }
+        if (!strcmp(*argv, "-dp")) {
+            ASSERT(argc > 1);
+            ASSERT(ParseDiskPolicy(*(argv + 1), &diskPolicy));
+            argCount = 2;
+        }
 #endif
     }
 
@@ -191,6 +320,9 @@ Initialize(int argc, char **argv)
 #ifdef USER_PROGRAM
     activeThreads = new Table<Thread*>();
 #endif
+#ifdef USE_TLB
+    activeSpaces = new Table<AddressSpace*>();
+#endif
 
     threadToBeDestroyed = nullptr;
 
@@ -206,10 +338,22 @@ Initialize(int argc, char **argv)
 #ifdef USER_PROGRAM
     Debugger *d = debugUserProg ? new Debugger : nullptr;
     
+#ifdef USE_TLB
+    machine = new Machine(d, numPhysicalPages, tlbSize, tlbWays);
+      // This must come first.
+    stats->tlbEntries = tlbSize;
+    stats->tlbWays    = tlbWays;
+    stats->tlbPolicy  = TLB_POLICY_NAMES[tlbPolicy];
+#else
     machine = new Machine(d, numPhysicalPages);  // This must come first.
+#endif
     synchconsole = new SynchConsole(nullptr, nullptr);
+    executableCache = new ExecutableCache(execCacheSize);
+      // Before the file system, which invalidates its entries.
 #ifdef SWAP
     coreMap = new Coremap(numPhysicalPages);
+    swapCache = new SwapCache(swapCacheSize);
+    pageMerger = new PageMerger(numPhysicalPages, mergeInterval);
 #else
     pages = new Bitmap(numPhysicalPages);
 #endif
@@ -217,7 +361,8 @@ Initialize(int argc, char **argv)
 #endif
 
 #ifdef FILESYS
-    synchDisk = new SynchDisk("DISK");
+    synchDisk = new SynchDisk("DISK", diskPolicy);
+    bufferCache = new BufferCache(bufferCacheSize, flushInterval);
 #endif
 
 #ifdef FILESYS_NEEDED
@@ -236,6 +381,23 @@ Cleanup()
 {
     DEBUG('i', "Cleaning up...\n");
 
+#ifdef USER_PROGRAM
+    // Tear down the running address space while the machine, statistics
+    // and file system it refers to still exist.
+    if (currentThread != nullptr && currentThread->space != nullptr) {
+        if (printSpaceStats)
+            currentThread->space->PrintStats(currentThread->GetName());
+        delete currentThread->space;
+        currentThread->space = nullptr;
+    }
+#endif
+
+#ifdef FILESYS
+    // Other threads may run while the writes that did not reach the disk
+    // yet are done, so nothing is torn down before.
+    bufferCache->Flush();
+#endif
+
 #ifdef USER_PROGRAM
     delete machine;
     delete synchconsole;
@@ -247,9 +409,14 @@ Cleanup()
 #endif
 
 #ifdef FILESYS
+    delete bufferCache;
     delete synchDisk;
 #endif
 
+#ifdef USER_PROGRAM
+    delete executableCache;
+#endif
+
     delete timer;
     delete scheduler;
     delete interrupt;
@@ -264,9 +431,14 @@ Cleanup()
 #ifdef USER_PROGRAM
 #ifdef SWAP
     delete coreMap;
+    delete swapCache;
+    delete pageMerger;
 #else
     delete pages;
 #endif
+#endif
+#ifdef USE_TLB
+    delete activeSpaces;
 #endif
 
     exit(0);
@@ -40,9 +40,19 @@ extern Machine *machine;  // User program memory and registers.
 extern SynchConsole *synchconsole;
 #include "lib/table.hh"
 extern Table<Thread *> *activeThreads;
+#include "userprog/executable_cache.hh"
+extern ExecutableCache *executableCache;
+extern unsigned pffThreshold;  ///< Ticks between major faults below which
+                               ///< a process is taken to be thrashing.
+extern bool printSpaceStats;   ///< Print memory counters of each process
+                               ///< when it exits.
 #ifdef SWAP
 #include "lib/coremap.hh"
+#include "userprog/swap_cache.hh"
 extern Coremap *coreMap;
+extern SwapCache *swapCache;
+#include "userprog/page_merger.hh"
+extern PageMerger *pageMerger;
 #else
 #include "lib/bitmap.hh"
 extern Bitmap *pages;
@@ -57,10 +67,30 @@ extern FileSystem *fileSystem;
 #ifdef FILESYS
 #include "filesys/synch_disk.hh"
 extern SynchDisk *synchDisk;
+#include "filesys/buffer_cache.hh"
+extern BufferCache *bufferCache;
 #endif
 
 #ifdef USE_TLB
 extern const unsigned NUMBER_OF_TRIES;
+extern Table<AddressSpace *> *activeSpaces;  ///< Address spaces by TLB
+                                             ///< identifier.
+
+/// How the page fault handler picks the TLB entry to refill, among those
+/// of the set the page maps to, when none of them is invalid.
+enum TlbPolicy {
+    TLB_POLICY_FIFO,    ///< Round robin.
+    TLB_POLICY_RANDOM,
+    TLB_POLICY_NRU,     ///< Not recently used, from the use bits.
+    TLB_POLICY_LRU,     ///< Least recently used.
+    NUM_TLB_POLICIES
+};
+extern TlbPolicy tlbPolicy;
+#endif
+
+#ifdef DEMAND_LOADING
+extern unsigned prefetchWindow;  ///< Pages to load ahead of a strided
+                                 ///< page fault pattern.
 #endif
 
 #endif
@@ -57,7 +57,8 @@ Thread::Thread(const char *threadName, bool joinableParam, unsigned priorityPara
     spaceId = activeThreads->Add(this);
 #endif
 #ifdef FILESYS
-    currentDirLock = nullptr;
+    currentDirLock   = nullptr;
+    currentDirSector = 0;
 #endif
 }
 
@@ -181,6 +182,18 @@ Thread::Join()
 void
 Thread::Finish(int returnStatus)
 {
+#ifdef USER_PROGRAM
+    // Releasing the address space may block on the disk (swap and
+    // executable files), so do it here rather than in the destructor, which
+    // runs in whichever thread comes next, maybe in the middle of a disk
+    // request of its own.
+    if (space != nullptr) {
+        if (printSpaceStats)
+            space->PrintStats(GetName());
+        delete space;
+        space = nullptr;
+    }
+#endif
     if (joinable)
         channel->Send(returnStatus);
 
@@ -147,6 +147,10 @@ public:
     void SetPath(Path _path);
     
     Lock* currentDirLock;
+
+    /// Sector of the header of the working directory, where paths under
+    /// it are resolved from.  Meaningful while `currentDirLock` is set.
+    unsigned currentDirSector;
 #endif
 
 private:
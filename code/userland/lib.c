@@ -35,3 +35,101 @@ void itoa(int n, char *str) {
     str[i] = '\0';
     reverse(str);
 }
+
+/// Memory allocation, on top of `Sbrk`.
+///
+/// Free blocks are kept in a circular list ordered by address, and merged
+/// with their neighbours when freed.  A large enough free block at the end
+/// of the heap is given back to the kernel.
+
+typedef struct Header {
+    struct Header *next;
+    unsigned size;  // In units of `Header`, this one included.
+} Header;
+
+#define MALLOC_MIN_UNITS 64  // Least memory asked from the kernel at once.
+
+static Header mallocBase;
+static Header *freeList = 0;
+
+static void insertFree(Header *b) {
+    Header *p;
+
+    for (p = freeList; !(b > p && b < p->next); p = p->next)
+        if (p >= p->next && (b > p || b < p->next))
+            break;  // At either end of the heap.
+
+    if (b + b->size == p->next) {
+        b->size += p->next->size;
+        b->next = p->next->next;
+    } else
+        b->next = p->next;
+    if (p + p->size == b) {
+        p->size += b->size;
+        p->next = b->next;
+    } else
+        p->next = b;
+    freeList = p;
+}
+
+void free(void *ptr) {
+    Header *p;
+    char *end;
+
+    if (ptr == 0)
+        return;
+    insertFree((Header *) ptr - 1);
+
+    end = Sbrk(0);
+    p = freeList;
+    do {
+        Header *t = p->next;
+        if ((char *) (t + t->size) == end && t->size >= MALLOC_MIN_UNITS) {
+            p->next = t->next;
+            freeList = p;
+            Sbrk(-(int) (t->size * sizeof (Header)));
+            break;
+        }
+        p = t;
+    } while (p != freeList);
+}
+
+static Header *moreCore(unsigned units) {
+    char *mem;
+    Header *b;
+
+    if (units < MALLOC_MIN_UNITS)
+        units = MALLOC_MIN_UNITS;
+    mem = Sbrk(units * sizeof (Header));
+    if (mem == (char *) -1)
+        return 0;
+    b = (Header *) mem;
+    b->size = units;
+    insertFree(b);
+    return freeList;
+}
+
+void *malloc(unsigned size) {
+    Header *p, *prev;
+    unsigned units = (size + sizeof (Header) - 1) / sizeof (Header) + 1;
+
+    if ((prev = freeList) == 0) {
+        mallocBase.next = freeList = prev = &mallocBase;
+        mallocBase.size = 0;
+    }
+    for (p = prev->next; ; prev = p, p = p->next) {
+        if (p->size >= units) {
+            if (p->size == units)
+                prev->next = p->next;
+            else {
+                p->size -= units;  // Hand out the tail end.
+                p += p->size;
+                p->size = units;
+            }
+            freeList = prev;
+            return p + 1;
+        }
+        if (p == freeList && (p = moreCore(units)) == 0)
+            return 0;
+    }
+}
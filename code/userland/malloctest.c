@@ -0,0 +1,66 @@
+/// Test program for `malloc` and `free`, and for giving memory back to the
+/// kernel through `Sbrk`.
+///
+/// Blocks of several sizes are allocated and filled in, checked for
+/// overlaps, and freed out of order, so that free blocks have to merge.
+/// Once all of them are freed, the heap must end where it started.  Exits
+/// with 0 if all went well.
+
+
+#include "syscall.h"
+#include "lib.c"
+
+
+#define NUM_BLOCKS  32
+
+static char *blocks[NUM_BLOCKS];
+
+static unsigned
+BlockSize(int i)
+{
+    return 16 + (i % 7) * 100;
+}
+
+static void
+Fail(const char *message)
+{
+    puts2(message);
+    Exit(1);
+}
+
+int
+main(void)
+{
+    char *start = Sbrk(0);
+    int i;
+    unsigned j;
+
+    for (i = 0; i < NUM_BLOCKS; i++) {
+        blocks[i] = malloc(BlockSize(i));
+        if (blocks[i] == 0)
+            Fail("malloc failed\n");
+        for (j = 0; j < BlockSize(i); j++)
+            blocks[i][j] = (char) i;
+    }
+    for (i = 0; i < NUM_BLOCKS; i++) {
+        for (j = 0; j < BlockSize(i); j++) {
+            if (blocks[i][j] != (char) i)
+                Fail("Block overwritten\n");
+        }
+    }
+
+    // Every other block first, so that the rest merge with them.
+    for (i = 0; i < NUM_BLOCKS; i += 2)
+        free(blocks[i]);
+    for (i = 1; i < NUM_BLOCKS; i += 2)
+        free(blocks[i]);
+    if ((char *) Sbrk(0) != start)
+        Fail("Heap not given back\n");
+
+    // Nor can the heap shrink below its start, or move by absurd amounts.
+    if (Sbrk(-1) != (void *) -1 || Sbrk(-2147483647 - 1) != (void *) -1)
+        Fail("Bad Sbrk accepted\n");
+
+    puts2("malloc ok\n");
+    return 0;
+}
@@ -0,0 +1,76 @@
+/// Test program for the gap between the heap and the files mapped with
+/// `Mmap`.
+///
+/// Mapping a file stretches the address space up to the mapping, but the
+/// pages between the heap break and it must still be off limits.  Run
+/// without arguments, this program runs itself again to touch one of them,
+/// and checks that the kernel killed it for that, with the exception as
+/// its status rather than the 1 it exits with if it gets through.  Exits
+/// with 0 if all went well.
+
+
+#include "syscall.h"
+#include "lib.c"
+
+
+#define PROGRAM_NAME  "mmapgap"
+#define FILE_NAME     "mmapgap.txt"
+#define FILE_SIZE     300
+
+static char buffer[FILE_SIZE];
+
+static void
+Fail(const char *message)
+{
+    puts2(message);
+    Exit(1);
+}
+
+static void
+TouchGap(void)
+{
+    OpenFileId o;
+    char *map;
+
+    if ((o = Open(FILE_NAME)) < 0)
+        Fail("Cannot open file\n");
+    map = Mmap(o, 0, FILE_SIZE);
+    if (map == (char *) -1)
+        Fail("Mmap failed\n");
+
+    // Right below the mapping, and far above the break.
+    map[-1] = 'x';
+    Fail("Gap between heap and mapping is accessible\n");
+}
+
+int
+main(int argc, char *argv[])
+{
+    char *args[3];
+    OpenFileId o;
+    SpaceId child;
+    int i;
+
+    if (argc > 1)
+        TouchGap();
+
+    for (i = 0; i < FILE_SIZE; i++)
+        buffer[i] = 'a' + i % 26;
+    if (Create(FILE_NAME) < 0 || (o = Open(FILE_NAME)) < 0)
+        Fail("Cannot create file\n");
+    if (Write(buffer, FILE_SIZE, o) < 0)
+        Fail("Cannot write file\n");
+    Close(o);
+
+    args[0] = PROGRAM_NAME;
+    args[1] = "child";
+    args[2] = 0;
+    if ((child = Exec2(PROGRAM_NAME, args, 1)) < 0)
+        Fail("Cannot run child\n");
+    if (Join(child) == 1)
+        Fail("Child was not killed\n");
+    Remove(FILE_NAME);
+
+    puts2("mmapgap ok\n");
+    return 0;
+}
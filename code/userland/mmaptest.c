@@ -0,0 +1,73 @@
+/// Test program for mapping files into memory with `Mmap`.
+///
+/// A file is written through `Write`, mapped, checked and changed through
+/// memory, and unmapped; then it is read back with `Read`, which must see
+/// the changes.  A mapped file must not be closable, and an address must
+/// not be unmapped twice.  Exits with 0 if all went well.
+
+
+#include "syscall.h"
+#include "lib.c"
+
+
+#define FILE_NAME  "mmap.txt"
+#define FILE_SIZE  300  // Not a whole number of pages.
+
+static char buffer[FILE_SIZE];
+
+static void
+Fail(const char *message)
+{
+    puts2(message);
+    Exit(1);
+}
+
+int
+main(void)
+{
+    OpenFileId o;
+    char *map;
+    int i;
+
+    for (i = 0; i < FILE_SIZE; i++)
+        buffer[i] = 'a' + i % 26;
+    if (Create(FILE_NAME) < 0 || (o = Open(FILE_NAME)) < 0)
+        Fail("Cannot create file\n");
+    if (Write(buffer, FILE_SIZE, o) < 0)
+        Fail("Cannot write file\n");
+
+    // Ask for more than there is: the mapping stops at the end of the file.
+    map = Mmap(o, 0, 2 * FILE_SIZE);
+    if (map == (char *) -1)
+        Fail("Mmap failed\n");
+    for (i = 0; i < FILE_SIZE; i++) {
+        if (map[i] != buffer[i])
+            Fail("Mapping does not match the file\n");
+    }
+    for (i = 0; i < FILE_SIZE; i++)
+        map[i] = 'A' + i % 26;
+
+    if (Close(o) != -1)
+        Fail("Mapped file closed\n");
+    if (Munmap(map) != 0)
+        Fail("Munmap failed\n");
+    if (Munmap(map) != -1)
+        Fail("Unmapped twice\n");
+    if (Close(o) != 0)
+        Fail("Cannot close file\n");
+
+    // The changes must have reached the file.
+    if ((o = Open(FILE_NAME)) < 0)
+        Fail("Cannot open file\n");
+    if (Read(buffer, FILE_SIZE, o) != FILE_SIZE)
+        Fail("Cannot read file\n");
+    for (i = 0; i < FILE_SIZE; i++) {
+        if (buffer[i] != 'A' + i % 26)
+            Fail("Changes not written back\n");
+    }
+    Close(o);
+    Remove(FILE_NAME);
+
+    puts2("mmap ok\n");
+    return 0;
+}
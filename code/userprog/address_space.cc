@@ -22,6 +22,68 @@ unsigned int AddressSpace::Translate(unsigned int virtualAddr)
   return physicalPage * PAGE_SIZE + offset;
 }
 
+/// Find the part of the segment starting at `addr`, `size` bytes long, that
+/// falls inside the page starting at `pageStart`.
+///
+/// Returns false if there is none; otherwise its start address and length
+/// are stored in `from` and `length`.
+static bool
+PageOverlap(uint32_t pageStart, uint32_t addr, uint32_t size,
+            uint32_t *from, uint32_t *length)
+{
+    uint32_t start = addr > pageStart ? addr : pageStart;
+    uint32_t end   = addr + size < pageStart + PAGE_SIZE
+                     ? addr + size : pageStart + PAGE_SIZE;
+    if (size == 0 || start >= end)
+        return false;
+
+    *from   = start;
+    *length = end - start;
+    return true;
+}
+
+/// Tell where the initial contents of page `vpn` come from, and whether it
+/// may be written to, from the segments it overlaps.
+static PageKind
+ClassifyPage(const Executable &exe, unsigned vpn)
+{
+    uint32_t start    = vpn * PAGE_SIZE, from, length;
+    bool     inFile   = false;
+    bool     writable = start + PAGE_SIZE > exe.GetSize();  // Stack.
+
+    if (PageOverlap(start, exe.GetCodeAddr(), exe.GetCodeSize(),
+                    &from, &length)) {
+        inFile    = true;
+        writable |= (exe.GetCodeFlags() & NOFF_WRITE) != 0;
+    }
+    if (PageOverlap(start, exe.GetInitDataAddr(), exe.GetInitDataSize(),
+                    &from, &length)) {
+        inFile    = true;
+        writable |= (exe.GetInitDataFlags() & NOFF_WRITE) != 0;
+    }
+    if (PageOverlap(start, exe.GetUninitDataAddr(), exe.GetUninitDataSize(),
+                    &from, &length))
+        writable = true;
+
+    if (inFile)
+        return writable ? PAGE_INIT_DATA : PAGE_CODE;
+    return start < exe.GetSize() ? PAGE_BSS : PAGE_STACK;
+}
+
+
+#ifdef SWAP
+/// Drop every TLB entry mapping `frame`, whichever address space it belongs
+/// to, keeping its use and dirty bits.
+static void
+ShootDownFrame(unsigned frame)
+{
+    TranslationEntry *tlb = machine->GetMMU()->tlb;
+    for (unsigned i = 0; i < machine->GetMMU()->GetTlbSize(); i++) {
+        if (tlb[i].valid && tlb[i].physicalPage == frame)
+            activeSpaces->Get(tlb[i].asid)->SyncTlbEntry(i);
+    }
+}
+#endif
 
 /// First, set up the translation from program memory to physical memory.
 /// For now, this is really simple (1:1), since we are only uniprogramming,
@@ -36,10 +98,13 @@ AddressSpace::AddressSpace(OpenFile *executable_file, int spaceId)
 
     // How big is address space?
 
-    unsigned size = exe.GetSize() + USER_STACK_SIZE;
-      // We need to increase the size to leave room for the stack.
-    numPages = DivRoundUp(size, PAGE_SIZE);
-    size = numPages * PAGE_SIZE;
+    // The stack goes on top, with an unmapped page below it: growing down
+    // past its bottom faults there instead of writing over the data.
+    stackGuard = DivRoundUp(exe.GetSize(), PAGE_SIZE);
+    numPages = stackGuard + 1 + DivRoundUp(USER_STACK_SIZE, PAGE_SIZE);
+    unsigned size = numPages * PAGE_SIZE;
+    heapStart = numPages;
+    heapBreak = heapStart * PAGE_SIZE;  // The heap starts out empty.
 
 #ifndef SWAP
     ASSERT(numPages <= pages->CountClear());
@@ -52,30 +117,47 @@ AddressSpace::AddressSpace(OpenFile *executable_file, int spaceId)
 
     // First, set up the translation.
 
-    pageTable = new TranslationEntry[numPages];
+#ifdef USE_TLB
+    asid = activeSpaces->Add(this);
+    ASSERT(asid != -1);
+#endif
+
+#ifdef USE_TLB
+    pageTable.SetAsid(asid);
+#endif
+    pageTable.Resize(numPages);
+#ifndef DEMAND_LOADING
+    // Otherwise pages start out invalid, and are loaded when first used.
     for (unsigned i = 0; i < numPages; i++) {
-        pageTable[i].virtualPage  = i;
-#ifdef DEMAND_LOADING
-        pageTable[i].physicalPage = UINT_MAX;
-        pageTable[i].valid        = false;
-        pageTable[i].isInSwap     = false;
-#else
+        if (i == stackGuard)
+            continue;
         pageTable[i].physicalPage = pages->Find();
         pageTable[i].valid        = true;
-#endif
-        pageTable[i].use          = false;
-        pageTable[i].dirty        = false;
-        pageTable[i].readOnly     = false;
-          // If the code segment was entirely on a separate page, we could
-          // set its pages to be read-only.
+        pageTable[i].readOnly     = ClassifyPage(exe, i) == PAGE_CODE;
     }
+#endif
+
+#ifdef DEMAND_LOADING
+    // Keep the header around and tell apart the pages that have to be read
+    // from the executable from those that only need zeroing, so that faults
+    // on the latter do not touch the file at all.
+    executable = new Executable(exe);
+    imageRefs  = new unsigned(1);
+    pageKind   = new PageKind[numPages];
+    textKey    = executable_file->GetSector();
+    for (unsigned i = 0; i < numPages; i++)
+        pageKind[i] = ClassifyPage(exe, i);
+
+    lastFaultVpn = -1;
+    faultStride  = 1;  // So that a first fault on page 0 counts as the
+                       // start of a sequential run.
+#endif
+    InitMemoryStats();
 
 #ifdef SWAP
-    swapFileName = new char[10];
-    sprintf(swapFileName, "SWAP.%d", spaceId);
-    DEBUG('v', "Creating swap file %s\n", swapFileName);
-    fileSystem->Create(swapFileName, size);
-    swapFile = fileSystem->Open(swapFileName);
+    for (unsigned i = 0; i < MAX_MAPPINGS; i++)
+        mappings[i].file = nullptr;
+    CreateSwap(spaceId);
 #endif
 #ifndef DEMAND_LOADING
     char *mainMemory = machine->mainMemory;
@@ -85,53 +167,223 @@ AddressSpace::AddressSpace(OpenFile *executable_file, int spaceId)
     // memset(mainMemory, 0, size);
 
     for (unsigned i = 0; i < numPages; i++) {
+        if (i == stackGuard)
+            continue;
         memset(&mainMemory[pageTable[i].physicalPage * PAGE_SIZE], 0, PAGE_SIZE);
     }
 
     // Then, copy in the code and data segments into memory.
-    uint32_t codeSize = exe.GetCodeSize();
-    uint32_t initDataSize = exe.GetInitDataSize();
-    if (codeSize > 0) {
-        unsigned i = 0;
-        uint32_t virtualAddr = exe.GetCodeAddr();
-        DEBUG('a', "Initializing code segment, at 0x%X, size %u\n", virtualAddr, codeSize);
-        while (i < codeSize) {
-            uint32_t addr = Translate(virtualAddr + i);
-            exe.ReadCodeBlock(&mainMemory[addr], 1, i);
-            i++;
+    if (exe.GetCodeSize() > 0) {
+        DEBUG('a', "Initializing code segment, at 0x%X, size %u\n",
+              exe.GetCodeAddr(), exe.GetCodeSize());
+        LoadSegment(&exe, true);
+    }
+    if (exe.GetInitDataSize() > 0) {
+        DEBUG('a', "Initializing data segment, at 0x%X, size %u\n",
+              exe.GetInitDataAddr(), exe.GetInitDataSize());
+        LoadSegment(&exe, false);
+    }
+#endif
+}
+
+#ifndef DEMAND_LOADING
+/// Read the code segment of `exe` (or the initialized data segment, if
+/// `code` is false) into the frames of the pages it spans.
+///
+/// Pages are translated once each, and runs of pages that are contiguous in
+/// physical memory as well are read from the file at once.
+void
+AddressSpace::LoadSegment(Executable *exe, bool code)
+{
+    char    *mainMemory = machine->mainMemory;
+    uint32_t addr = code ? exe->GetCodeAddr() : exe->GetInitDataAddr();
+    uint32_t size = code ? exe->GetCodeSize() : exe->GetInitDataSize();
+
+    uint32_t offset = 0;
+    while (offset < size) {
+        uint32_t virtualAddr = addr + offset;
+        uint32_t physAddr    = Translate(virtualAddr);
+        uint32_t length      = PAGE_SIZE - virtualAddr % PAGE_SIZE;
+        while (offset + length < size
+                 && Translate(virtualAddr + length) == physAddr + length)
+            length += PAGE_SIZE;
+        if (length > size - offset)
+            length = size - offset;
+
+        if (code)
+            exe->ReadCodeBlock(&mainMemory[physAddr], length, offset);
+        else
+            exe->ReadDataBlock(&mainMemory[physAddr], length, offset);
+        offset += length;
+    }
+}
+#endif
+
+AddressSpace::AddressSpace(AddressSpace *parent, int spaceId)
+{
+    ASSERT(parent != nullptr);
+
+    numPages       = parent->numPages;
+    stackGuard     = parent->stackGuard;
+    heapStart      = parent->heapStart;
+    heapBreak      = parent->heapBreak;
+    executableFile = parent->executableFile;
+
+#if !defined(SWAP) && !defined(DEMAND_LOADING)
+    ASSERT(numPages <= pages->CountClear());
+#endif
+
+    DEBUG('a', "Forking address space, num pages %u\n", numPages);
+
+    // Evicting a frame looks at every registered page table, ours included,
+    // so it must be there, if empty, before others can run.
+    pageTable.Resize(numPages);
+#ifdef SWAP
+    for (unsigned i = 0; i < MAX_MAPPINGS; i++)
+        mappings[i].file = nullptr;
+#endif
+#ifdef USE_TLB
+    asid = activeSpaces->Add(this);
+    ASSERT(asid != -1);
+    pageTable.SetAsid(asid);
+#endif
+#ifdef SWAP
+    CreateSwap(spaceId);
+
+    // The parent's TLB entries hold the freshest use and dirty bits, and
+    // must not let it write to the pages about to be shared.
+    for (unsigned i = 0; i < machine->GetMMU()->GetTlbSize(); i++) {
+        if (machine->GetMMU()->tlb[i].valid
+              && machine->GetMMU()->tlb[i].asid == (unsigned) parent->asid)
+            parent->SyncTlbEntry(i);
+    }
+#endif
+
+    for (unsigned i = parent->pageTable.Next(0); i < numPages;
+         i = parent->pageTable.Next(i + 1)) {
+        TranslationEntry *entry = &parent->pageTable[i];
+#ifdef SWAP
+        if (parent->FindMapping(i) != nullptr) {
+            // Mappings are not inherited, just like open files; the child
+            // sees an unused page there.
+            pageTable[i] = *entry;
+            pageTable[i].asid         = asid;
+            pageTable[i].physicalPage = UINT_MAX;
+            pageTable[i].valid        = false;
+            pageTable[i].isInSwap     = false;
+            pageTable[i].dirty        = false;
+            pageTable[i].prefetched   = false;
+            continue;
+        }
+        if (entry->valid) {
+            coreMap->Share(entry->physicalPage);
+            if (!entry->readOnly || entry->copyOnWrite) {
+                // Once private, the copy may differ from the executable
+                // even if nobody writes to it again.
+                entry->dirty       = entry->dirty || entry->isInSwap;
+                entry->readOnly    = true;
+                entry->copyOnWrite = true;
+                ShootDownFrame(entry->physicalPage);
+            }
         }
+#endif
+        pageTable[i] = *entry;
+#ifdef USE_TLB
+        pageTable[i].asid       = asid;
+#endif
+        pageTable[i].prefetched = false;
+
+#ifndef SWAP
+        if (entry->valid) {
+            char *mainMemory = machine->mainMemory;
+            int frame = pages->Find();
+            ASSERT(frame != -1);
+            memcpy(&mainMemory[frame * PAGE_SIZE],
+                   &mainMemory[entry->physicalPage * PAGE_SIZE], PAGE_SIZE);
+            pageTable[i].physicalPage = frame;
+        }
+#endif
     }
-    if (initDataSize > 0) {
-        unsigned i = 0;
-        uint32_t virtualAddr = exe.GetInitDataAddr();
-        DEBUG('a', "Initializing data segment, at 0x%X, size %u\n", virtualAddr, initDataSize);
-        while (i < initDataSize) {
-            uint32_t addr = Translate(virtualAddr + i);
-            exe.ReadDataBlock(&mainMemory[addr], 1, i);
-            i++;
+
+#ifdef SWAP
+    // Only now that every page the parent has in memory is shared and
+    // write protected can we wait for the disk.
+    for (unsigned i = pageTable.Next(0); i < numPages;
+         i = pageTable.Next(i + 1)) {
+        if (!pageTable[i].valid && pageTable[i].isInSwap) {
+            char page[PAGE_SIZE];
+            if (!swapCache->Peek(parent, i, page))
+                parent->swapFile->ReadAt(page, PAGE_SIZE, i * PAGE_SIZE);
+            if (!swapCache->Store(this, i, page))
+                WriteSwap(i, page);
         }
     }
 #endif
+
+#ifdef DEMAND_LOADING
+    // Pages never loaded still come from the same executable.
+    executable = parent->executable;
+    pageKind   = parent->pageKind;
+    imageRefs  = parent->imageRefs;
+    textKey    = parent->textKey;
+    (*imageRefs)++;
+
+    lastFaultVpn = -1;
+    faultStride  = 1;
+#endif
+    InitMemoryStats();
 }
 
 /// Deallocate an address space.
 AddressSpace::~AddressSpace()
 {
 #ifdef SWAP
-    coreMap->Clear(this);
+    for (unsigned i = 0; i < MAX_MAPPINGS; i++) {
+        if (mappings[i].file != nullptr)
+            Munmap(mappings[i].firstPage * PAGE_SIZE);
+    }
+#endif
+#ifdef USE_TLB
+    // Our TLB entries outlive context switches, but not the address space.
+    TranslationEntry *tlb = machine->GetMMU()->tlb;
+    for (unsigned i = 0; i < machine->GetMMU()->GetTlbSize(); i++) {
+        if (tlb[i].asid == (unsigned) asid)
+            tlb[i].valid = false;
+    }
+    activeSpaces->Remove(asid);
+#endif
+#ifdef DEMAND_LOADING
+    for (unsigned i = pageTable.Next(0); i < numPages;
+         i = pageTable.Next(i + 1)) {
+        if (pageTable[i].valid && pageTable[i].prefetched)
+            stats->numPrefetchWasted++;
+    }
+#endif
+#ifdef SWAP
+    for (unsigned i = pageTable.Next(0); i < numPages;
+         i = pageTable.Next(i + 1)) {
+        if (pageTable[i].valid)
+            coreMap->Release(pageTable[i].physicalPage, this);
+    }
+    swapCache->DropAll(this);
     delete swapFile;
     fileSystem->Remove(swapFileName);
     delete swapFileName;
 #else
-    for (unsigned i = 0; i < numPages; i++) {
+    for (unsigned i = pageTable.Next(0); i < numPages;
+         i = pageTable.Next(i + 1)) {
         if (pageTable[i].valid)
             pages->Clear(pageTable[i].physicalPage);
     }
 #endif
-    delete [] pageTable;
     
 #ifdef DEMAND_LOADING
-    delete executableFile;
+    if (--*imageRefs == 0) {
+        delete executable;
+        delete [] pageKind;
+        delete executableFile;
+        delete imageRefs;
+    }
 #endif
 }
 
@@ -166,125 +418,816 @@ AddressSpace::InitRegisters()
 /// On a context switch, save any machine state, specific to this address
 /// space, that needs saving.
 ///
-/// For now, nothing!
+/// For now, nothing!  TLB entries are tagged with `asid`, so they can stay
+/// in the TLB; their use and dirty bits are written back lazily, when the
+/// entry or the page itself gets replaced.
 void
 AddressSpace::SaveState()
 {
+    if (VirtualTime() - lastSampleTick >= WS_SAMPLE_TICKS)
+        SampleReferences();
+    virtualTicks = VirtualTime();
+    runStart     = stats->userTicks;
+}
+
+unsigned long
+AddressSpace::VirtualTime() const
+{
+    return virtualTicks + (stats->userTicks - runStart);
+}
+
+void
+AddressSpace::InitMemoryStats()
+{
+    majorFaults = minorFaults = tlbRefills = evictions = throttles = 0;
+    numResident = 0;
+    for (unsigned i = pageTable.Next(0); i < numPages;
+         i = pageTable.Next(i + 1)) {
+        if (pageTable[i].valid)
+            numResident++;
+    }
+    peakResident = numResident;
+
+    virtualTicks       = 0;
+    runStart           = stats->userTicks;
+    numSamples         = 0;
+    lastSampleTick     = 0;
+    workingSet         = peakWorkingSet = 0;
+    lastMajorFaultTick = 0;
+    thrashRun          = 0;
+}
+
+unsigned
+AddressSpace::CountResident() const
+{
+    return numResident;
+}
+
+bool
+AddressSpace::IsValidPage(unsigned vpn) const
+{
+    if (vpn == stackGuard)
+        return false;
+    if (vpn < DivRoundUp(heapBreak, PAGE_SIZE))
+        return true;
+#ifdef SWAP
+    // Past the break, only mapped files; `numPages` reaches up to them, but
+    // the gap in between is not part of the heap.
+    return FindMapping(vpn) != nullptr;
+#else
+    return false;
+#endif
+}
+
+bool
+AddressSpace::NeedsIo(unsigned vpn) const
+{
+    ASSERT(vpn < numPages);
+    if (pageTable[vpn].valid)
+        return false;
+#ifdef DEMAND_LOADING
+    if (pageTable[vpn].isInSwap)
+#ifdef SWAP
+        return !swapCache->Has(this, vpn);
+#else
+        return true;
+#endif
+    PageKind kind = KindOf(vpn);
+    return kind == PAGE_CODE || kind == PAGE_INIT_DATA || kind == PAGE_MAPPED;
+#else
+    return false;
+#endif
+}
+
+void
+AddressSpace::SampleReferences()
+{
+#ifdef USE_TLB
+    // Our TLB entries hold the freshest reference bits.
+    TranslationEntry *tlb = machine->GetMMU()->tlb;
+    for (unsigned i = 0; i < machine->GetMMU()->GetTlbSize(); i++) {
+        if (tlb[i].valid && tlb[i].asid == (unsigned) asid) {
+            pageTable[tlb[i].virtualPage].referenced |= tlb[i].referenced;
+            tlb[i].referenced = false;
+        }
+    }
+#endif
+
+    numSamples++;
+    lastSampleTick = VirtualTime();
+    workingSet = 0;
+    for (unsigned i = pageTable.Next(0); i < numPages;
+         i = pageTable.Next(i + 1)) {
+        unsigned &lastSample = pageTable.LastSample(i);
+        if (pageTable[i].valid && pageTable[i].referenced)
+            lastSample = numSamples;
+        pageTable[i].referenced = false;
+        if (lastSample != 0 && numSamples - lastSample < WS_WINDOW)
+            workingSet++;
+    }
+    if (workingSet > peakWorkingSet)
+        peakWorkingSet = workingSet;
+}
+
+bool
+AddressSpace::RecordFault(FaultKind kind)
+{
+    unsigned long now = VirtualTime();
+    bool thrashing = false;
+
+    switch (kind) {
+        case FAULT_REFILL:
+            tlbRefills++;
+            minorFaults++;
+            break;
+        case FAULT_MINOR:
+            minorFaults++;
+            break;
+        case FAULT_MAJOR:
+            majorFaults++;
+            // Page fault frequency: only count faults while memory is full,
+            // otherwise the process is just warming up.
 #ifdef SWAP
-    for (unsigned i=0; i<TLB_SIZE; ++i)
-        SyncTlbEntry(i);
+            thrashing = coreMap->CountFree() == 0;
+#else
+            thrashing = pages->CountClear() == 0;
 #endif
+            thrashing = thrashing && pffThreshold != 0
+                        && now - lastMajorFaultTick < pffThreshold;
+            thrashRun = thrashing ? thrashRun + 1 : 0;
+            lastMajorFaultTick = now;
+            break;
+    }
+
+    if (kind != FAULT_REFILL && numResident > peakResident)
+        peakResident = numResident;
+    if (now - lastSampleTick >= WS_SAMPLE_TICKS)
+        SampleReferences();
+
+    if (thrashRun < PFF_BURST)
+        return false;
+    DEBUG('v', "Throttling a thrashing process, %u close faults\n",
+          thrashRun);
+    thrashRun = 0;
+    throttles++;
+    stats->numThrottles++;
+    return true;
+}
+
+void
+AddressSpace::PrintStats(const char *name)
+{
+    printf("Memory of %s: faults major %lu, minor %lu (TLB refills %lu),"
+           " evictions %lu, throttled %lu\n",
+           name, majorFaults, minorFaults, tlbRefills, evictions, throttles);
+    printf("    resident %u pages (peak %u), working set %u pages"
+           " (peak %u), heap %u bytes, page table %lu bytes\n",
+           CountResident(), peakResident, workingSet, peakWorkingSet,
+           heapBreak - heapStart * PAGE_SIZE, pageTable.Footprint());
 }
 
 TranslationEntry
-AddressSpace::GetPageTableEntry(unsigned vpn) {
+AddressSpace::GetPageTableEntry(unsigned vpn) const
+{
     return pageTable[vpn];
 }
 
 void
 AddressSpace::SetNotUsed(unsigned vpn) {
     pageTable[vpn].use = false;
+#ifdef USE_TLB
+    // Otherwise the stale bit would come back on the next write back.
+    TranslationEntry *tlb = machine->GetMMU()->tlb;
+    for (unsigned i = 0; i < machine->GetMMU()->GetTlbSize(); ++i)
+        if (tlb[i].valid && tlb[i].asid == (unsigned) asid
+              && tlb[i].virtualPage == vpn)
+            tlb[i].use = false;
+#endif
 }
 
-TranslationEntry
-AddressSpace::LoadPage(unsigned vpn, unsigned frame) {
-    ASSERT(vpn >= 0);
-    unsigned vpnadd = vpn * PAGE_SIZE;
+int
+AddressSpace::Sbrk(int increment)
+{
+    // Anything larger is refused below anyway, and this way `-increment`
+    // cannot overflow.
+    if (increment < -(int) USER_HEAP_MAX_SIZE
+          || increment > (int) USER_HEAP_MAX_SIZE)
+        return -1;
 
-    Executable exe (executableFile);
-    
-    DEBUG('v', "Loading Page Frame %lu from file\n", frame);
+    unsigned oldBreak = heapBreak;
+    unsigned heapSize = heapBreak - heapStart * PAGE_SIZE;
+    if (increment < 0 ? (unsigned) -increment > heapSize
+                      : (unsigned) increment > USER_HEAP_MAX_SIZE - heapSize)
+        return -1;
 
-    char *mainMemory = machine->mainMemory;
-    uint32_t physicalAddressToWrite = frame * PAGE_SIZE;
-    memset(&mainMemory[physicalAddressToWrite], 0, PAGE_SIZE);
+    unsigned newBreak = heapBreak + increment;
+    unsigned oldEnd   = DivRoundUp(heapBreak, PAGE_SIZE);
+    unsigned newEnd   = DivRoundUp(newBreak, PAGE_SIZE);
+    if (numPages <= oldEnd) {
+        if (!Resize(newEnd))
+            return -1;
+    } else if (newEnd < oldEnd) {
+        // Mapped files lie above; keep the page table as it is.
+        ReleasePages(newEnd, oldEnd);
+    }
+    DEBUG('a', "Moved heap break from 0x%X to 0x%X\n", oldBreak, newBreak);
+    heapBreak = newBreak;
+    return oldBreak;
+}
 
-    unsigned readed = 0;
+bool
+AddressSpace::Resize(unsigned newNumPages)
+{
+    ASSERT(newNumPages >= heapStart);
+    if (newNumPages == numPages)
+        return true;
 
-    uint32_t codeSize = exe.GetCodeSize();
-    uint32_t initDataSize = exe.GetInitDataSize();
-    uint32_t virtualDataAddr = exe.GetInitDataAddr();
+#ifndef DEMAND_LOADING
+    // Without page faults to load them later, new pages need frames now.
+    if (newNumPages > numPages && newNumPages - numPages > pages->CountClear())
+        return false;
+#endif
 
-    if (codeSize > 0 && vpnadd < codeSize) {
-        uint32_t toRead = (codeSize - vpnadd) < PAGE_SIZE ? (codeSize - vpnadd) : PAGE_SIZE;
+    if (newNumPages < numPages)
+        ReleasePages(newNumPages, numPages);
 
-        exe.ReadCodeBlock(&mainMemory[physicalAddressToWrite], toRead, vpnadd);
+    // New pages are zero filled on first use.
+    pageTable.Resize(newNumPages);
+#ifndef DEMAND_LOADING
+    for (unsigned i = numPages; i < newNumPages; i++) {
+        pageTable[i].physicalPage = pages->Find();
+        pageTable[i].valid        = true;
+        numResident++;
+        memset(&machine->mainMemory[pageTable[i].physicalPage * PAGE_SIZE],
+               0, PAGE_SIZE);
+    }
+#endif
+    numPages = newNumPages;
+#ifndef USE_TLB
+    if (currentThread->space == this) {
+        // The machine may point to the old table.
+        machine->GetMMU()->pageTable     = pageTable.GetEntries();
+        machine->GetMMU()->pageTableSize = numPages;
+    }
+#endif
+    return true;
+}
 
-        readed += toRead; 
+void
+AddressSpace::ReleasePages(unsigned first, unsigned end)
+{
+    ASSERT(first <= end && end <= numPages);
+
+    for (unsigned i = pageTable.Next(first); i < end;
+         i = pageTable.Next(i + 1)) {
+#ifdef USE_TLB
+        TranslationEntry *tlb = machine->GetMMU()->tlb;
+        for (unsigned j = 0; j < machine->GetMMU()->GetTlbSize(); j++) {
+            if (tlb[j].valid && tlb[j].asid == (unsigned) asid
+                  && tlb[j].virtualPage == i)
+                tlb[j].valid = false;
+        }
+#endif
+        if (pageTable[i].valid) {
+#ifdef DEMAND_LOADING
+            if (pageTable[i].prefetched)
+                stats->numPrefetchWasted++;
+#endif
+#ifdef SWAP
+            coreMap->Release(pageTable[i].physicalPage, this);
+#else
+            pages->Clear(pageTable[i].physicalPage);
+#endif
+            numResident--;
+        }
+        pageTable[i].physicalPage = UINT_MAX;
+        pageTable[i].valid        = false;
+        pageTable[i].dirty        = false;
+        pageTable[i].readOnly     = false;
+        pageTable[i].copyOnWrite  = false;
+        pageTable[i].prefetched   = false;
+#ifdef DEMAND_LOADING
+        pageTable[i].isInSwap     = false;
+#endif
+#ifdef SWAP
+        swapCache->Drop(this, i);
+#endif
+    }
+}
+
+#ifdef SWAP
+const AddressSpace::Mapping *
+AddressSpace::FindMapping(unsigned vpn) const
+{
+    for (unsigned i = 0; i < MAX_MAPPINGS; i++) {
+        const Mapping *m = &mappings[i];
+        if (m->file != nullptr
+              && vpn >= m->firstPage && vpn < m->firstPage + m->numPages)
+            return m;
+    }
+    return nullptr;
+}
+
+bool
+AddressSpace::MapsFile(const OpenFile *file) const
+{
+    for (unsigned i = 0; i < MAX_MAPPINGS; i++) {
+        if (mappings[i].file == file)
+            return true;
+    }
+    return false;
+}
+
+int
+AddressSpace::Mmap(OpenFile *file, unsigned offset, unsigned length)
+{
+    ASSERT(file != nullptr);
+
+    unsigned fileLength = file->Length();
+    if (offset % PAGE_SIZE != 0 || offset >= fileLength || length == 0)
+        return -1;
+    if (length > fileLength - offset)
+        length = fileLength - offset;
+
+    Mapping *m = nullptr;
+    for (unsigned i = 0; i < MAX_MAPPINGS && m == nullptr; i++) {
+        if (mappings[i].file == nullptr)
+            m = &mappings[i];
+    }
+    if (m == nullptr)
+        return -1;
+
+    // Take the lowest free range above the largest possible heap.
+    unsigned count = DivRoundUp(length, PAGE_SIZE);
+    unsigned first = heapStart + DivRoundUp(USER_HEAP_MAX_SIZE, PAGE_SIZE);
+    for (bool moved = true; moved; ) {
+        moved = false;
+        for (unsigned i = 0; i < MAX_MAPPINGS; i++) {
+            const Mapping *other = &mappings[i];
+            if (other->file != nullptr
+                  && first < other->firstPage + other->numPages
+                  && other->firstPage < first + count) {
+                first = other->firstPage + other->numPages;
+                moved = true;
+            }
+        }
+    }
+    if (first + count > numPages && !Resize(first + count))
+        return -1;
+
+    m->file      = file;
+    m->offset    = offset;
+    m->length    = length;
+    m->firstPage = first;
+    m->numPages  = count;
+    DEBUG('a', "Mapped %u bytes of a file at 0x%X\n",
+          length, first * PAGE_SIZE);
+    return first * PAGE_SIZE;
+}
+
+bool
+AddressSpace::Munmap(unsigned addr)
+{
+    Mapping *m = nullptr;
+    for (unsigned i = 0; i < MAX_MAPPINGS && m == nullptr; i++) {
+        if (mappings[i].file != nullptr
+              && mappings[i].firstPage * PAGE_SIZE == addr)
+            m = &mappings[i];
+    }
+    if (m == nullptr)
+        return false;
+
+    unsigned end = m->firstPage + m->numPages;
+    TranslationEntry *tlb = machine->GetMMU()->tlb;
+    for (unsigned i = 0; i < machine->GetMMU()->GetTlbSize(); i++) {
+        if (tlb[i].valid && tlb[i].asid == (unsigned) asid
+              && tlb[i].virtualPage >= m->firstPage
+              && tlb[i].virtualPage < end)
+            SyncTlbEntry(i);
+    }
+    for (unsigned vpn = pageTable.Next(m->firstPage); vpn < end;
+         vpn = pageTable.Next(vpn + 1)) {
+        if (pageTable[vpn].valid && pageTable[vpn].dirty)
+            WriteBackMapped(m, vpn);
     }
+    ReleasePages(m->firstPage, end);
+    m->file = nullptr;
+    DEBUG('a', "Unmapped the file at 0x%X\n", addr);
+
+    // Give back the page table entries, unless something lies above.
+    unsigned newNumPages = DivRoundUp(heapBreak, PAGE_SIZE);
+    for (unsigned i = 0; i < MAX_MAPPINGS; i++) {
+        if (mappings[i].file != nullptr
+              && mappings[i].firstPage + mappings[i].numPages > newNumPages)
+            newNumPages = mappings[i].firstPage + mappings[i].numPages;
+    }
+    Resize(newNumPages);
+    return true;
+}
+
+void
+AddressSpace::WriteBackMapped(const Mapping *m, unsigned vpn)
+{
+    ASSERT(m != nullptr);
+    ASSERT(pageTable[vpn].physicalPage != UINT_MAX);
 
-    if (initDataSize > 0 && vpnadd + readed < virtualDataAddr + initDataSize &&
-        readed != PAGE_SIZE) {
+    unsigned from   = (vpn - m->firstPage) * PAGE_SIZE;
+    unsigned length = m->length - from < PAGE_SIZE ? m->length - from
+                                                   : PAGE_SIZE;
+    char *page = &machine->mainMemory[pageTable[vpn].physicalPage * PAGE_SIZE];
+    DEBUG('v', "Writing back mapped page %u\n", vpn);
+    m->file->WriteAt(page, length, m->offset + from);
+    pageTable[vpn].dirty = false;
+    stats->numMappedWrites++;
+}
+#endif
 
-        uint32_t toRead = (virtualDataAddr + initDataSize - vpnadd) < PAGE_SIZE ?
-                                (virtualDataAddr + initDataSize) - (vpnadd + readed)
-                            :
-                                PAGE_SIZE - readed;
+#ifdef DEMAND_LOADING
+PageKind
+AddressSpace::KindOf(unsigned vpn) const
+{
+    if (vpn < heapStart)
+        return pageKind[vpn];
+#ifdef SWAP
+    if (FindMapping(vpn) != nullptr)
+        return PAGE_MAPPED;
+#endif
+    return PAGE_HEAP;
+}
+
+TranslationEntry
+AddressSpace::LoadPage(unsigned vpn, unsigned frame)
+{
+    ASSERT(vpn < numPages);
 
-        readed ? 
-            exe.ReadDataBlock(&mainMemory[physicalAddressToWrite + readed], toRead,  0)
-        :
-            exe.ReadDataBlock(&mainMemory[physicalAddressToWrite], toRead, vpnadd - codeSize);
+    char *page = &machine->mainMemory[frame * PAGE_SIZE];
+    memset(page, 0, PAGE_SIZE);
 
-        readed += toRead; 
+    PageKind kind = KindOf(vpn);
+    if (kind == PAGE_BSS || kind == PAGE_STACK || kind == PAGE_HEAP) {
+        DEBUG('v', "Zero filling page %u in frame %u\n", vpn, frame);
+        stats->numZeroFills++;
+#ifdef SWAP
+    } else if (kind == PAGE_MAPPED) {
+        DEBUG('v', "Loading mapped page %u into frame %u\n", vpn, frame);
+        const Mapping *m = FindMapping(vpn);
+        unsigned from   = (vpn - m->firstPage) * PAGE_SIZE;
+        unsigned length = m->length - from < PAGE_SIZE ? m->length - from
+                                                       : PAGE_SIZE;
+        m->file->ReadAt(page, length, m->offset + from);
+        stats->numMappedReads++;
+#endif
+    } else {
+        DEBUG('v', "Loading page %u into frame %u from file\n", vpn, frame);
+        uint32_t pageStart = vpn * PAGE_SIZE;
+        uint32_t from, length;
+        if (PageOverlap(pageStart, executable->GetCodeAddr(),
+                        executable->GetCodeSize(), &from, &length))
+            executable->ReadCodeBlock(&page[from - pageStart], length,
+                                      from - executable->GetCodeAddr());
+        if (PageOverlap(pageStart, executable->GetInitDataAddr(),
+                        executable->GetInitDataSize(), &from, &length))
+            executable->ReadDataBlock(&page[from - pageStart], length,
+                                      from - executable->GetInitDataAddr());
+        stats->numPageLoads++;
     }
 
-    if(vpnadd > codeSize + initDataSize) {
-        readed = PAGE_SIZE;
-    };
     pageTable[vpn].valid = true;
     pageTable[vpn].dirty = false;
     pageTable[vpn].use = true;
+    pageTable[vpn].prefetched = false;
     pageTable[vpn].physicalPage = frame;
+    numResident++;
+    if (kind == PAGE_CODE) {
+        pageTable[vpn].readOnly = true;
+#ifdef SWAP
+        coreMap->SetText(frame, textKey, vpn);
+#endif
+    }
+#ifdef SWAP
+    coreMap->Unpin(frame);
+#endif
     return pageTable[vpn];
 }
 
+#ifdef SWAP
+bool
+AddressSpace::ShareText(unsigned vpn)
+{
+    ASSERT(vpn < numPages);
+    if (KindOf(vpn) != PAGE_CODE)
+        return false;
+
+    int frame = coreMap->FindText(textKey, vpn);
+    if (frame == -1)
+        return false;
+
+    DEBUG('v', "Sharing code page %u in frame %d\n", vpn, frame);
+    coreMap->Share(frame);
+    pageTable[vpn].physicalPage = frame;
+    pageTable[vpn].valid        = true;
+    pageTable[vpn].readOnly     = true;
+    pageTable[vpn].use          = true;
+    pageTable[vpn].dirty        = false;
+    pageTable[vpn].prefetched   = false;
+    numResident++;
+    stats->numTextShares++;
+    return true;
+}
+#endif
+
+void
+AddressSpace::TrackFault(unsigned vpn)
+{
+    int stride = (int) vpn - lastFaultVpn;
+    bool strided = stride != 0 && stride == faultStride;
+    faultStride  = stride;
+    lastFaultVpn = vpn;
+    if (!strided)
+        return;
+
+    for (unsigned i = 1; i <= prefetchWindow; i++) {
+        int target = (int) vpn + stride * (int) i;
+        if (target < 0 || target >= (int) numPages
+              || !IsValidPage(target))
+            break;
+        // Only looking, so that pages not brought in cost no leaf.
+        if (GetPageTableEntry(target).valid
+#ifdef SWAP
+              || ShareText(target)
+#endif
+              ) {
+            lastFaultVpn = target;
+            continue;
+        }
+
+        // Only take frames that are already free; evicting someone else's
+        // page for a guess is not worth it.
+#ifdef SWAP
+        int frame = coreMap->FindFree(this);
+#else
+        int frame = pages->Find();
+#endif
+        if (frame == -1)
+            break;
+
+        DEBUG('v', "Prefetching page %d into frame %d\n", target, frame);
+#ifdef SWAP
+        if (pageTable[target].isInSwap)
+            LoadFromSwap(target, frame);
+        else
+#endif
+            LoadPage(target, frame);
+        pageTable[target].use        = false;
+        pageTable[target].prefetched = true;
+        stats->numPrefetches++;
+
+        // The next fault along the stride is expected right after the
+        // prefetched run.
+        lastFaultVpn = target;
+    }
+}
+
+void
+AddressSpace::CountPrefetchHit(unsigned vpn)
+{
+    if (pageTable[vpn].prefetched) {
+        pageTable[vpn].prefetched = false;
+        stats->numPrefetchHits++;
+    }
+}
+#endif
+
 /// On a context switch, restore the machine state so that this address space
 /// can run.
 ///
-/// For now, tell the machine where to find the page table.
+/// For now, tell the machine where to find the page table, or which TLB
+/// entries are ours.
 void
 AddressSpace::RestoreState()
 {
+    runStart = stats->userTicks;
 #ifdef USE_TLB
-    for (unsigned i = 0; i < TLB_SIZE; ++i)
-        machine->GetMMU()->tlb[i].valid = false;
+    machine->GetMMU()->currentAsid = asid;
 #else
-    machine->GetMMU()->pageTable     = pageTable;
+    machine->GetMMU()->pageTable     = pageTable.GetEntries();
     machine->GetMMU()->pageTableSize = numPages;
 #endif
 }
 
 #ifdef SWAP
+void
+AddressSpace::CreateSwap(int spaceId)
+{
+    swapFileName = new char[10];
+    sprintf(swapFileName, "SWAP.%d", spaceId);
+    DEBUG('v', "Creating swap file %s\n", swapFileName);
+    fileSystem->Create(swapFileName, numPages * PAGE_SIZE);
+    swapFile = fileSystem->Open(swapFileName);
+}
+
 TranslationEntry
 AddressSpace::LoadFromSwap(unsigned vpn, unsigned physIndex)
 {
     DEBUG('v', "Loading from the swap \n");
-    char *mainMemory = machine->mainMemory;
-    swapFile->ReadAt(&mainMemory[physIndex * PAGE_SIZE], PAGE_SIZE, PAGE_SIZE * vpn);
+    char *page = &machine->mainMemory[physIndex * PAGE_SIZE];
+    if (swapCache->Load(this, vpn, page)) {
+        // The cache let go of it, so it has to be saved again on eviction.
+        pageTable[vpn].dirty = true;
+    } else {
+        swapFile->ReadAt(page, PAGE_SIZE, PAGE_SIZE * vpn);
+    }
 
     pageTable[vpn].valid = true;
     pageTable[vpn].use = true;
+    pageTable[vpn].prefetched = false;
     pageTable[vpn].physicalPage = physIndex;
+    numResident++;
+    coreMap->Unpin(physIndex);
     return pageTable[vpn];
 }
 
+void
+AddressSpace::WriteSwap(unsigned vpn, const char *page)
+{
+    ASSERT(vpn < numPages);
+
+    // Heap pages may lie past the end of the swap file, which must not
+    // have holes.
+    static const char zeroPage[PAGE_SIZE] = {};
+    for (unsigned end = swapFile->Length(); end < PAGE_SIZE * vpn;
+         end += PAGE_SIZE)
+        swapFile->WriteAt(zeroPage, PAGE_SIZE, end);
+
+    swapFile->WriteAt(page, PAGE_SIZE, PAGE_SIZE * vpn);
+}
+
+bool
+AddressSpace::MapsFrame(unsigned vpn, unsigned frame) const
+{
+    return vpn < numPages && pageTable[vpn].valid
+           && pageTable[vpn].physicalPage == frame;
+}
+
+bool
+AddressSpace::HoldsFrame(unsigned frame) const
+{
+    for (unsigned vpn = pageTable.Next(0); vpn < numPages;
+         vpn = pageTable.Next(vpn + 1)) {
+        if (MapsFrame(vpn, frame))
+            return true;
+    }
+    return false;
+}
+
+void
+AddressSpace::SwapFrame(unsigned frame)
+{
+    for (unsigned vpn = pageTable.Next(0); vpn < numPages;
+         vpn = pageTable.Next(vpn + 1)) {
+        if (MapsFrame(vpn, frame))
+            SwapPage(vpn);
+    }
+}
+
+bool
+AddressSpace::MayMerge(unsigned frame) const
+{
+    for (unsigned vpn = pageTable.Next(0); vpn < numPages;
+         vpn = pageTable.Next(vpn + 1)) {
+        if (!MapsFrame(vpn, frame))
+            continue;
+        if (pageTable[vpn].readOnly && !pageTable[vpn].copyOnWrite)
+            return false;  // Code, shared by other means.
+        if (FindMapping(vpn) != nullptr)
+            return false;
+    }
+    return true;
+}
+
+void
+AddressSpace::ProtectFrame(unsigned frame)
+{
+    // Keep the use and dirty bits, and stop writes through the TLB.
+    TranslationEntry *tlb = machine->GetMMU()->tlb;
+    for (unsigned i = 0; i < machine->GetMMU()->GetTlbSize(); i++) {
+        if (tlb[i].valid && tlb[i].asid == (unsigned) asid
+              && tlb[i].physicalPage == frame)
+            SyncTlbEntry(i);
+    }
+
+    for (unsigned vpn = pageTable.Next(0); vpn < numPages;
+         vpn = pageTable.Next(vpn + 1)) {
+        if (MapsFrame(vpn, frame)) {
+            pageTable[vpn].readOnly    = true;
+            pageTable[vpn].copyOnWrite = true;
+        }
+    }
+}
+
+unsigned
+AddressSpace::RemapFrame(unsigned from, unsigned to)
+{
+    if (from == to)
+        return 0;
+
+    ProtectFrame(from);
+    unsigned count = 0;
+    for (unsigned vpn = pageTable.Next(0); vpn < numPages;
+         vpn = pageTable.Next(vpn + 1)) {
+        if (!MapsFrame(vpn, from))
+            continue;
+        // Each page keeps its own dirty bit: the contents are the same, so
+        // wherever it would be reloaded from still holds them.
+        pageTable[vpn].physicalPage = to;
+        count++;
+    }
+    return count;
+}
+
+bool
+AddressSpace::CopyOnWrite(unsigned vpn)
+{
+    if (vpn >= numPages || !pageTable[vpn].copyOnWrite)
+        return false;
+
+    // Drop the read-only translation, keeping its use and dirty bits.
+    TranslationEntry *tlb = machine->GetMMU()->tlb;
+    for (unsigned i = 0; i < machine->GetMMU()->GetTlbSize(); ++i)
+        if (tlb[i].valid && tlb[i].asid == (unsigned) asid
+              && tlb[i].virtualPage == vpn)
+            SyncTlbEntry(i);
+
+    ASSERT(pageTable[vpn].valid);
+    unsigned frame = pageTable[vpn].physicalPage;
+    stats->numCowFaults++;
+
+    if (coreMap->GetRefCount(frame) > 1) {
+        char *mainMemory = machine->mainMemory;
+        char page[PAGE_SIZE];
+        memcpy(page, &mainMemory[frame * PAGE_SIZE], PAGE_SIZE);
+
+        // Making room may swap the shared frame out, and then we no longer
+        // map it.
+        unsigned newFrame = coreMap->ReplacePage(this);
+        if (MapsFrame(vpn, frame))
+            coreMap->Release(frame, this);
+
+        DEBUG('v', "Copying shared page %u into frame %u\n", vpn, newFrame);
+        memcpy(&mainMemory[newFrame * PAGE_SIZE], page, PAGE_SIZE);
+        if (!pageTable[vpn].valid)
+            numResident++;  // Swapped out while making room.
+        pageTable[vpn].physicalPage = newFrame;
+        pageTable[vpn].valid        = true;
+        pageTable[vpn].dirty        = true;
+        coreMap->Unpin(newFrame);
+        stats->numCowCopies++;
+    }
+
+    pageTable[vpn].readOnly    = false;
+    pageTable[vpn].copyOnWrite = false;
+    pageTable[vpn].use         = true;
+    return true;
+}
+
 void
 AddressSpace::SyncTlbEntry(unsigned entry)
 {
     DEBUG('v', "Synching from TLB \n");
     TranslationEntry* tlb = machine->GetMMU()->tlb;
     if (tlb[entry].valid) {
+        ASSERT(tlb[entry].asid == (unsigned) asid);
         pageTable[tlb[entry].virtualPage].dirty = tlb[entry].dirty;
-        pageTable[tlb[entry].virtualPage].use = tlb[entry].use;
+        // Only `SetNotUsed` clears the use bit of the page: the TLB one
+        // may have been cleared by its own refill policy.
+        pageTable[tlb[entry].virtualPage].use |= tlb[entry].use;
+        pageTable[tlb[entry].virtualPage].referenced |= tlb[entry].referenced;
     }
 
     tlb[entry].valid = false;
 }
 
+void
+AddressSpace::WriteBackTlb()
+{
+    TranslationEntry *tlb = machine->GetMMU()->tlb;
+    for (unsigned i = 0; i < machine->GetMMU()->GetTlbSize(); ++i) {
+        if (!tlb[i].valid)
+            continue;
+        AddressSpace *owner = activeSpaces->Get(tlb[i].asid);
+        ASSERT(owner != nullptr);
+        TranslationEntry *e = &owner->pageTable[tlb[i].virtualPage];
+        e->use        |= tlb[i].use;
+        e->dirty       = tlb[i].dirty;
+        e->referenced |= tlb[i].referenced;
+        tlb[i].referenced = false;
+    }
+}
+
 unsigned
 AddressSpace::GetPhysicalPageIndex(unsigned victim) {
-    for (unsigned i=0; i < numPages; ++i)
+    for (unsigned i = pageTable.Next(0); i < numPages;
+         i = pageTable.Next(i + 1))
         if (pageTable[i].physicalPage == victim) return i;
     ASSERT(false);
     return 0;
@@ -294,22 +1237,37 @@ void
 AddressSpace::SwapPage(unsigned vpn) 
 {
     pageTable[vpn].valid = false;
-    coreMap->ClearPageIndex(pageTable[vpn].physicalPage);
-    
-    if (currentThread->space == this) {
-        TranslationEntry *tlb = machine->GetMMU()->tlb;
-
-        for (unsigned i=0; i<TLB_SIZE; ++i)
-            if(tlb[i].physicalPage == pageTable[vpn].physicalPage)
-                SyncTlbEntry(i);
+    numResident--;
+    evictions++;
+    if (pageTable[vpn].prefetched) {
+        pageTable[vpn].prefetched = false;
+        stats->numPrefetchWasted++;
     }
     
-    if (pageTable[vpn].dirty) {
-        char *mainMemory = machine->mainMemory;
-        swapFile->WriteAt(&mainMemory[pageTable[vpn].physicalPage * PAGE_SIZE], PAGE_SIZE, PAGE_SIZE * vpn);
+    // The page may be cached in the TLB even if we are not running.
+    TranslationEntry *tlb = machine->GetMMU()->tlb;
+    for (unsigned i=0; i < machine->GetMMU()->GetTlbSize(); ++i)
+        if (tlb[i].valid && tlb[i].asid == (unsigned) asid
+              && tlb[i].virtualPage == vpn)
+            SyncTlbEntry(i);
+    
+    const Mapping *m = FindMapping(vpn);
+    if (pageTable[vpn].dirty && m != nullptr) {
+        // Mapped pages go back to their file, and are read from it again.
+        WriteBackMapped(m, vpn);
+    } else if (pageTable[vpn].dirty) {
+        char *page = &machine->mainMemory[pageTable[vpn].physicalPage * PAGE_SIZE];
+        if (!swapCache->Store(this, vpn, page))
+            WriteSwap(vpn, page);
         pageTable[vpn].isInSwap = true;
         DEBUG('v', "Swap saved %lu \n", pageTable[vpn].physicalPage);
     }
+    if (pageTable[vpn].copyOnWrite) {
+        // Whatever we had in the shared frame now lives in our own swap
+        // file or executable.
+        pageTable[vpn].readOnly    = false;
+        pageTable[vpn].copyOnWrite = false;
+    }
     pageTable[vpn].physicalPage = UINT_MAX;
 }
 
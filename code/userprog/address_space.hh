@@ -14,11 +14,50 @@
 #define NACHOS_USERPROG_ADDRESSSPACE__HH
 
 
+#include "executable.hh"
+#include "page_table.hh"
 #include "filesys/file_system.hh"
 #include "machine/translation_entry.hh"
 
 
 const unsigned USER_STACK_SIZE = 1024;  ///< Increase this as necessary!
+const unsigned USER_HEAP_MAX_SIZE = 64 * 1024;  ///< Limit for `Sbrk`.
+const unsigned MAX_MAPPINGS = 8;  ///< Files mapped at once, with `Mmap`.
+
+/// Working set estimation: reference bits are sampled every `WS_SAMPLE_TICKS`
+/// ticks of the process' virtual time (user instructions it executed) at
+/// most, and the working set is made of the pages referenced in the last
+/// `WS_WINDOW` samples.
+const unsigned long WS_SAMPLE_TICKS = 1000;
+const unsigned WS_WINDOW = 4;
+
+/// Major faults closer than `pffThreshold` ticks of virtual time to each
+/// other, this many in a row while memory is full, get the process
+/// throttled.
+const unsigned PFF_BURST = 4;
+
+/// How a page fault was served, for the per address space counters.
+enum FaultKind {
+    FAULT_REFILL,  ///< The page was in memory; only the TLB missed it.
+    FAULT_MINOR,   ///< Brought in without I/O: zero filled or shared.
+    FAULT_MAJOR    ///< Read from the executable, a mapped file or swap.
+};
+
+/// What a virtual page holds, which tells where its initial contents come
+/// from.
+enum PageKind {
+    PAGE_CODE,       ///< Read-only contents (code), read from the executable
+                     ///< and mapped read-only.
+    PAGE_INIT_DATA,  ///< Initialized data (maybe along with the end of the
+                     ///< code, unless the executable is page aligned), read
+                     ///< from the executable.
+    PAGE_BSS,        ///< Uninitialized data, zero filled.
+    PAGE_STACK,      ///< Stack, zero filled.
+    PAGE_HEAP,       ///< Heap, right above the stack, and grown by
+                     ///< `Sbrk`; zero filled.
+    PAGE_MAPPED      ///< Part of a file mapped with `Mmap`, read from and
+                     ///< written back to it.
+};
 
 
 class AddressSpace {
@@ -36,6 +75,13 @@ public:
     ///   program; it contains the object code to load into memory.
     AddressSpace(OpenFile *executable_file, int spaceId = -1);
 
+    /// Create a copy of address space `parent`, for `Fork`.
+    ///
+    /// With swapping, pages in memory are not copied: the frames are shared
+    /// and mapped read-only in both address spaces, until either writes to
+    /// them.  Otherwise every page is copied right away.
+    AddressSpace(AddressSpace *parent, int spaceId = -1);
+
     /// De-allocate an address space.
     ~AddressSpace();
 
@@ -47,38 +93,258 @@ public:
     void SaveState();
     void RestoreState();
 
-    TranslationEntry GetPageTableEntry(unsigned vpn);
-
-    TranslationEntry LoadPage(unsigned vpn, unsigned frame);
+    /// Copy of the entry of page `vpn`.  Only looks: no part of the table
+    /// gets allocated for it.
+    TranslationEntry GetPageTableEntry(unsigned vpn) const;
 
     unsigned GetPhysicalPageIndex(unsigned victim);
 
     void SetNotUsed(unsigned vpn);
 
+    /// Account a page fault served as `kind`, and sample reference bits if
+    /// it is time to.
+    ///
+    /// Returns true if the fault frequency shows the process is thrashing,
+    /// and it should give way to others for a while.
+    bool RecordFault(FaultKind kind);
+
+    /// Check whether `vpn` may be referenced at all: it must lie below the
+    /// heap break or in a mapped file, and not be the guard page below the
+    /// stack.
+    bool IsValidPage(unsigned vpn) const;
+
+    /// Check whether bringing page `vpn` in takes reading a file.
+    bool NeedsIo(unsigned vpn) const;
+
+    /// Number of pages in memory.
+    unsigned CountResident() const;
+
+    /// Print the memory counters of this address space, run by `name`.
+    void PrintStats(const char *name);
+
+    /// Move the end of the heap by `increment` bytes, which may be
+    /// negative, growing or shrinking the address space as needed.
+    ///
+    /// Returns the previous end of the heap, or -1 if it cannot be moved
+    /// that far.
+    int Sbrk(int increment);
+
+#ifdef SWAP
+    /// Map `length` bytes of `file`, from `offset` on, into the address
+    /// space, above the largest possible heap.  The range is clipped to the
+    /// end of the file, and `offset` must be page aligned.
+    ///
+    /// Pages are read from the file when first referenced, and written back
+    /// to it if dirty when evicted or unmapped.  Returns the address of the
+    /// mapping, or -1.
+    int Mmap(OpenFile *file, unsigned offset, unsigned length);
+
+    /// Remove the mapping starting at `addr`, writing back its dirty pages.
+    bool Munmap(unsigned addr);
+
+    /// Check whether some range of `file` is mapped.
+    bool MapsFile(const OpenFile *file) const;
+#endif
+
+#ifdef DEMAND_LOADING
+    /// Bring virtual page `vpn` into physical page `frame` from the
+    /// executable, or zero it if it holds neither code nor initialized
+    /// data.
+    TranslationEntry LoadPage(unsigned vpn, unsigned frame);
+
+#ifdef SWAP
+    /// If `vpn` is a code page already in memory for another address space
+    /// running the same executable, map that same frame, read-only.
+    ///
+    /// Returns false if the page has to be loaded.
+    bool ShareText(unsigned vpn);
+#endif
+
+    /// Record a page fault on `vpn`, after the page has been loaded.
+    ///
+    /// If the last faults follow a sequential or strided pattern, the next
+    /// `prefetchWindow` pages along it are loaded into free frames, so that
+    /// their first reference only costs a TLB refill.
+    void TrackFault(unsigned vpn);
+
+    /// Account a prefetch hit if `vpn` was prefetched and this is its first
+    /// reference.
+    void CountPrefetchHit(unsigned vpn);
+#endif
+
 #ifdef SWAP
     void SwapPage(unsigned vpn);
 
     TranslationEntry LoadFromSwap(unsigned vpn, unsigned physIndex);
 
+    /// Write `page` as the contents of virtual page `vpn` in the swap file.
+    void WriteSwap(unsigned vpn, const char *page);
+
+    /// Check whether virtual page `vpn` is in memory, at `frame`.
+    bool MapsFrame(unsigned vpn, unsigned frame) const;
+
+    /// Check whether any virtual page is in memory at `frame`.
+    bool HoldsFrame(unsigned frame) const;
+
+    /// Swap out every virtual page in memory at `frame`.
+    void SwapFrame(unsigned frame);
+
+    /// Check whether the pages at `frame`, if any, may share it with other
+    /// pages of the same contents: they must be writable, or shared
+    /// copy-on-write already, and not belong to a mapped file.
+    bool MayMerge(unsigned frame) const;
+
+    /// Map every virtual page at `frame` copy-on-write.
+    void ProtectFrame(unsigned frame);
+
+    /// Move every virtual page at frame `from` to frame `to`, which holds
+    /// the same contents, and map it copy-on-write.  Returns the number of
+    /// pages moved, none if `from` is `to`.
+    unsigned RemapFrame(unsigned from, unsigned to);
+
+    /// Handle a write to virtual page `vpn` while it is mapped read-only.
+    ///
+    /// If the page is shared copy-on-write, give it a private frame (unless
+    /// nobody else maps it anymore) and make it writable.  Returns false if
+    /// the page is really read-only.
+    bool CopyOnWrite(unsigned vpn);
+
+    /// Write back the use and dirty bits of TLB entry `entry`, which must
+    /// belong to this address space, and invalidate it.
     void SyncTlbEntry(unsigned entry);
 
+    /// Write back the use and dirty bits of every valid TLB entry into the
+    /// page table of the address space it belongs to, leaving the entries
+    /// in place.
+    static void WriteBackTlb();
+
 #endif
 
 private:
 
     unsigned int Translate(unsigned int virtualAddr);
 
-    /// Assume linear page table translation for now!
-    TranslationEntry *pageTable;
+    /// Change the size of the address space to `newNumPages` pages, adding
+    /// or removing pages at the end.
+    bool Resize(unsigned newNumPages);
+
+    /// Drop pages `first` up to `end` (excluded), freeing their frames.
+    void ReleasePages(unsigned first, unsigned end);
+
+    /// Record which pages were referenced since the last sample, clearing
+    /// their `referenced` bits, and update the working set estimate.  Use
+    /// bits are left alone, they belong to page and TLB replacement.
+    void SampleReferences();
+
+#ifdef DEMAND_LOADING
+    /// Kind of virtual page `vpn`, including heap pages.
+    PageKind KindOf(unsigned vpn) const;
+#endif
+
+#ifndef DEMAND_LOADING
+    /// Copy a whole segment of `exe` into memory, when the address space
+    /// is created.
+    void LoadSegment(Executable *exe, bool code);
+#endif
+
+#ifdef SWAP
+    /// A range of a file mapped with `Mmap`.
+    struct Mapping {
+        OpenFile *file;      ///< Null if the slot is free.
+        unsigned offset;     ///< Where the range starts in the file.
+        unsigned length;     ///< Bytes mapped.
+        unsigned firstPage;  ///< Virtual page it is mapped at.
+        unsigned numPages;
+    };
+
+    /// Find the mapping containing virtual page `vpn`, or return null.
+    const Mapping *FindMapping(unsigned vpn) const;
+
+    /// Write back page `vpn` of mapping `m`, from the frame it is in.
+    void WriteBackMapped(const Mapping *m, unsigned vpn);
+
+    /// Create the swap file, big enough for the whole address space.
+    void CreateSwap(int spaceId);
+#endif
+
+    PageTable pageTable;
 
     /// Number of pages in the virtual address space.
     unsigned numPages;
 
+    /// Page between the data and the stack that is never mapped, so that a
+    /// stack overflowing faults instead of writing over the data.
+    unsigned stackGuard;
+
+    /// First page of the heap, and the address where it currently ends.
+    unsigned heapStart;
+    unsigned heapBreak;
+
+    /// Memory counters, see `PrintStats`.
+
+    unsigned long majorFaults;
+    unsigned long minorFaults;   ///< TLB refills included.
+    unsigned long tlbRefills;
+    unsigned long evictions;     ///< Pages taken away by replacement.
+    unsigned long throttles;     ///< Times yielded for thrashing.
+    unsigned numResident;        ///< Kept up as pages are mapped and dropped.
+    unsigned peakResident;
+
+    /// Working set estimation and page fault frequency.
+
+    unsigned long virtualTicks;  ///< User ticks run, until `runStart`.
+    unsigned long runStart;      ///< User ticks when last scheduled.
+    unsigned numSamples;
+    unsigned long lastSampleTick;
+    unsigned workingSet;
+    unsigned peakWorkingSet;
+    unsigned long lastMajorFaultTick;
+    unsigned thrashRun;          ///< Close major faults in a row.
+
+    /// Set the counters above up, for a new address space.
+    void InitMemoryStats();
+
+    /// User ticks run by this address space so far; it must be running.
+    unsigned long VirtualTime() const;
+
     OpenFile *executableFile;
 
     char* swapFileName;
 
     OpenFile *swapFile;
+
+#ifdef SWAP
+    Mapping mappings[MAX_MAPPINGS];
+#endif
+
+#ifdef USE_TLB
+    /// Identifier used to tag this address space's entries in the TLB.
+    int asid;
+#endif
+
+#ifdef DEMAND_LOADING
+    /// Header of `executableFile`, parsed once when the address space is
+    /// created.
+    Executable *executable;
+
+    /// Kind of each virtual page below `heapStart`, computed from the
+    /// header.
+    PageKind *pageKind;
+
+    /// Number of address spaces sharing the three above, which forked
+    /// address spaces inherit.
+    unsigned *imageRefs;
+
+    /// Identifies the executable, so that code pages can be shared with
+    /// other address spaces running it: the sector of its file header.
+    int textKey;
+
+    /// Fault pattern tracking for the prefetcher.
+
+    int lastFaultVpn;  ///< Page of the last fault, or the last page
+                       ///< prefetched along the current stride.
+    int faultStride;   ///< Distance between the last two faults.
+#endif
 };
 
 
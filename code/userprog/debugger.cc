@@ -168,6 +168,8 @@ Debugger commands:\n\
                             a file.\n\
     flags, f                Show current flags for debug output.\n\
     help, h, ?              Show this help message.\n\
+    memory, m               Show page fault, resident set and working set\n\
+                            counters of every process.\n\
     print, p <address>...   Print bytes from memory.  The addresses are\n\
                             taken as virtual by default; one can specify\n\
                             whether each of them is physical or virtual\n\
@@ -192,6 +194,22 @@ PrintChar(char c)
     }
 }
 
+/// Show the memory counters of every running process.
+static DCM::RunResult
+CommandMemory(char **args, void *extra)
+{
+    if (currentThread->space != nullptr) {
+        currentThread->space->PrintStats(currentThread->GetName());
+    }
+    for (unsigned i = 0; i < Table<Thread *>::SIZE; i++) {
+        Thread *t = activeThreads->Get(i);
+        if (t != nullptr && t != currentThread && t->space != nullptr) {
+            t->space->PrintStats(t->GetName());
+        }
+    }
+    return DCM::RUN_RESULT_STAY;
+}
+
 /// Exceptions on memory reads performed by this function are not handled by
 /// Nachos (as in normal execution).  However, the use bit in the
 /// corresponding translation entry does get enabled when reading a virtual
@@ -312,6 +330,8 @@ Debugger::Debugger()
     manager.AddCommand("help",     &CommandHelp,     nullptr);
     manager.AddCommand("h",        &CommandHelp,     nullptr);
     manager.AddCommand("?",        &CommandHelp,     nullptr);
+    manager.AddCommand("memory",   &CommandMemory,   nullptr);
+    manager.AddCommand("m",        &CommandMemory,   nullptr);
     manager.AddCommand("print",    &CommandPrint,    nullptr);
     manager.AddCommand("p",        &CommandPrint,    nullptr);
     manager.AddCommand("quit",     &CommandQuit,     nullptr);
@@ -25,6 +25,7 @@
 #include "transfer.hh"
 #include "syscall.h"
 #include "filesys/directory_entry.hh"
+#include "lib/utility.hh"
 #include "threads/system.hh"
 #include "args.hh"
 
@@ -62,6 +63,20 @@ void startProcess(void *args)
     machine->Run(); //Run the program
 }
 
+/// Start running a process created by `Fork`, from a copy of the parent's
+/// registers.
+void startForkedProcess(void *args)
+{
+    int *registers = (int *) args;
+    for (unsigned i = 0; i < NUM_TOTAL_REGS; i++)
+        machine->WriteRegister(i, registers[i]);
+    delete [] registers;
+
+    currentThread->space->RestoreState();
+
+    machine->Run(); //Run the program
+}
+
 /// Do some default behavior for an unexpected exception.
 ///
 /// NOTE: this function is meant specifically for unexpected exceptions.  If
@@ -220,6 +235,74 @@ SyscallHandler(ExceptionType _et)
             break;
         }
 
+        case SC_FORK: {
+            DEBUG('e', "Fork requested.\n");
+            Thread *thread = new Thread(currentThread->GetName());
+
+#ifdef SWAP
+            AddressSpace *space = new AddressSpace(currentThread->space, thread->GetSpaceId());
+#else 
+            AddressSpace *space = new AddressSpace(currentThread->space);
+#endif
+            thread->space = space;
+
+            // The child resumes right after the system call, seeing 0 as
+            // its result.
+            int *registers = new int[NUM_TOTAL_REGS];
+            for (unsigned i = 0; i < NUM_TOTAL_REGS; i++)
+                registers[i] = machine->ReadRegister(i);
+            registers[2]           = 0;
+            registers[PREV_PC_REG] = registers[PC_REG];
+            registers[PC_REG]      = registers[NEXT_PC_REG];
+            registers[NEXT_PC_REG] += 4;
+
+            thread->Fork(startForkedProcess, registers);
+
+            SpaceId forked = thread->GetSpaceId();
+            DEBUG('e', "Forked %s with spaceId %d.\n", thread->GetName(), forked);
+            machine->WriteRegister(2, forked);
+            break;
+        }
+
+        case SC_SBRK: {
+            int increment = machine->ReadRegister(4);
+            DEBUG('e', "Sbrk requested, increment %d.\n", increment);
+            machine->WriteRegister(2, currentThread->space->Sbrk(increment));
+            break;
+        }
+
+        case SC_MMAP: {
+            int fid    = machine->ReadRegister(4);
+            int offset = machine->ReadRegister(5);
+            int length = machine->ReadRegister(6);
+            DEBUG('e', "`Mmap` requested for id %d, offset %d, length %d.\n",
+                  fid, offset, length);
+#ifdef SWAP
+            OpenFile *file = fid >= 2 ? currentThread->FileGet(fid) : nullptr;
+            if (file == nullptr || offset < 0 || length <= 0) {
+                DEBUG('e', "Error: cannot map file with id %d.\n", fid);
+                machine->WriteRegister(2, -1);
+                break;
+            }
+            machine->WriteRegister(2, currentThread->space->Mmap(file, offset, length));
+#else
+            // Mapped files need pages to be loaded on demand.
+            machine->WriteRegister(2, -1);
+#endif
+            break;
+        }
+
+        case SC_MUNMAP: {
+            int addr = machine->ReadRegister(4);
+            DEBUG('e', "`Munmap` requested for address 0x%X.\n", addr);
+#ifdef SWAP
+            machine->WriteRegister(2, currentThread->space->Munmap(addr) ? 0 : -1);
+#else
+            machine->WriteRegister(2, -1);
+#endif
+            break;
+        }
+
         case SC_JOIN: {
             SpaceId id = machine->ReadRegister(4);
             DEBUG('e', "Request to join %d.\n", id);
@@ -333,6 +416,14 @@ SyscallHandler(ExceptionType _et)
         case SC_CLOSE: {
             int fid = machine->ReadRegister(4);
             DEBUG('e', "`Close` requested for id %u.\n", fid);
+#ifdef SWAP
+            if (fid >= 2 && currentThread->FileGet(fid) != nullptr
+                  && currentThread->space->MapsFile(currentThread->FileGet(fid))) {
+                DEBUG('e', "Error: file %d is mapped.\n", fid);
+                machine->WriteRegister(2, -1);
+                break;
+            }
+#endif
             OpenFile* file = currentThread->FileClose(fid);
             if(!file) {
                 DEBUG('e', "Error closing file %d.\n", fid);
@@ -479,19 +570,82 @@ SyscallHandler(ExceptionType _et)
     IncrementPC();
 }
 
-#ifdef SWAP
-void ReplaceTlbEntry(unsigned index, AddressSpace* space, TranslationEntry entry)
+#ifdef USE_TLB
+/// Pick the TLB entry to refill with the translation of `vpn` in address
+/// space `asid`.
+///
+/// Only the entries of the set the page maps to are candidates.  An invalid
+/// one is taken if there is any; otherwise `tlbPolicy` decides.
+static unsigned
+ChooseTlbEntry(unsigned vpn, unsigned asid)
 {
-    TranslationEntry* tlb = machine->GetMMU()->tlb;
+    MMU *mmu = machine->GetMMU();
+    TranslationEntry *tlb = mmu->tlb;
+    unsigned first = mmu->TlbSet(vpn, asid);
+    unsigned ways  = mmu->GetTlbWays();
+
+    for (unsigned i = first; i < first + ways; i++) {
+        if (!tlb[i].valid)
+            return i;
+    }
 
-    for (unsigned i=0;i<TLB_SIZE;++i) {
-        if (!tlb[i].valid) {
-            tlb[i] = entry;
-            return;
+    switch (tlbPolicy) {
+        case TLB_POLICY_FIFO:
+            return mmu->NextTlbFifo(first);
+
+        case TLB_POLICY_RANDOM:
+            return first + SystemDep::Random() % ways;
+
+        case TLB_POLICY_NRU: {
+            // Lowest class first: not used and clean, not used and dirty,
+            // used and clean, used and dirty.
+            unsigned victim = first;
+            unsigned best   = 4;
+            for (unsigned i = first; i < first + ways; i++) {
+                unsigned cls = tlb[i].use * 2 + tlb[i].dirty;
+                if (cls < best) {
+                    best   = cls;
+                    victim = i;
+                }
+            }
+            if (best >= 2) {
+                // Every entry of the set was used: start a new period.  The
+                // bits are written back first, page replacement needs them.
+#ifdef SWAP
+                AddressSpace::WriteBackTlb();
+#endif
+                for (unsigned i = first; i < first + ways; i++)
+                    tlb[i].use = false;
+            }
+            return victim;
+        }
+
+        case TLB_POLICY_LRU:
+        default: {
+            unsigned victim = first;
+            for (unsigned i = first + 1; i < first + ways; i++) {
+                if (mmu->GetTlbLastUse(i) < mmu->GetTlbLastUse(victim))
+                    victim = i;
+            }
+            return victim;
         }
     }
+}
+
+static void
+ReplaceTlbEntry(unsigned index, TranslationEntry entry)
+{
+    TranslationEntry *tlb = machine->GetMMU()->tlb;
 
-    space->SyncTlbEntry(index);
+#ifdef SWAP
+    if (tlb[index].valid) {
+        // The victim may belong to any address space, not only the running
+        // one.
+        AddressSpace *owner = activeSpaces->Get(tlb[index].asid);
+        ASSERT(owner != nullptr);
+        owner->SyncTlbEntry(index);
+    }
+#endif
     tlb[index] = entry;
 }
 #endif
@@ -503,40 +657,61 @@ PageFaultHandler(ExceptionType et)
     AddressSpace* space = currentThread->space;
 
     unsigned vpn = machine->ReadRegister(BAD_VADDR_REG) / PAGE_SIZE;
+    if (!space->IsValidPage(vpn)) {
+        // Outside the address space, or on the guard page below the stack,
+        // as when the stack overflows.
+        DEBUG('e', "Bad address 0x%X in thread %s.\n",
+              machine->ReadRegister(BAD_VADDR_REG), currentThread->GetName());
+        currentThread->Finish(et);
+    }
 
-    static unsigned tlbSelection = 0;
-    unsigned index = tlbSelection++%TLB_SIZE;
+    unsigned index = ChooseTlbEntry(vpn, machine->GetMMU()->currentAsid);
+    FaultKind kind = FAULT_REFILL;
 
 #ifdef DEMAND_LOADING
+    if (!space->GetPageTableEntry(vpn).valid)
+        kind = space->NeedsIo(vpn) ? FAULT_MAJOR : FAULT_MINOR;
 #ifdef SWAP
-    if(!space->GetPageTableEntry(vpn).valid) {
+    if(!space->GetPageTableEntry(vpn).valid && space->ShareText(vpn)) {
+        kind = FAULT_MINOR;
+        ReplaceTlbEntry(index, space->GetPageTableEntry(vpn));
+        space->TrackFault(vpn);
+    } else if(!space->GetPageTableEntry(vpn).valid) {
         unsigned frame = coreMap->ReplacePage(space);
         DEBUG('v', "Loading %lu %lu \n", vpn, frame);
         if(space->GetPageTableEntry(vpn).isInSwap) {
             DEBUG('v', "Swap Loading %lu %lu \n", vpn, frame);
-            ReplaceTlbEntry(index, space, space->LoadFromSwap(vpn, frame));
+            ReplaceTlbEntry(index, space->LoadFromSwap(vpn, frame));
         } else {
-            ReplaceTlbEntry(index, space, space->LoadPage(vpn, frame));
+            ReplaceTlbEntry(index, space->LoadPage(vpn, frame));
         }
         DEBUG('v', "Loaded page for address %lu \n", vpn);
+        space->TrackFault(vpn);
     } else {
-        ReplaceTlbEntry(index, space, space->GetPageTableEntry(vpn));
+        space->CountPrefetchHit(vpn);
+        stats->numTlbRefills++;
+        ReplaceTlbEntry(index, space->GetPageTableEntry(vpn));
     }
 #else
-    TranslationEntry* tableE = machine->GetMMU()->tlb + index;
     if(!space->GetPageTableEntry(vpn).valid) {
         DEBUG('v', "Demand loading for address %lu \n", vpn);
-        *tableE = space->LoadPage(vpn, pages->Find());
+        ReplaceTlbEntry(index, space->LoadPage(vpn, pages->Find()));
         DEBUG('v', "Loaded page for address %lu \n", vpn);
+        space->TrackFault(vpn);
     } else {
-        *tableE = space->GetPageTableEntry(vpn);
+        space->CountPrefetchHit(vpn);
+        stats->numTlbRefills++;
+        ReplaceTlbEntry(index, space->GetPageTableEntry(vpn));
     }
 #endif
 #else
-    TranslationEntry* tableE = machine->GetMMU()->tlb + index;
-    *tableE = space->GetPageTableEntry(vpn);
+    ReplaceTlbEntry(index, space->GetPageTableEntry(vpn));
+    stats->numTlbRefills++;
 #endif
     DEBUG('v', "Virtual page %lu is loaded in the tlb entry %lu\n", vpn, index); 
+
+    if (space->RecordFault(kind))
+        currentThread->Yield();  // Thrashing: let others make progress.
 #else
     DefaultHandler(et);
 #endif
@@ -545,6 +720,11 @@ PageFaultHandler(ExceptionType et)
 static void
 ReadOnlyHandler(ExceptionType et)
 {
+#ifdef SWAP
+    unsigned vpn = machine->ReadRegister(BAD_VADDR_REG) / PAGE_SIZE;
+    if (currentThread->space->CopyOnWrite(vpn))
+        return;  // Retry the write, now on a private page.
+#endif
 #ifdef USE_TLB
     currentThread->Finish(et);
 #else
@@ -6,6 +6,8 @@
 
 #include "executable.hh"
 #include "machine/endianness.hh"
+#include "machine/mmu.hh"
+#include "threads/system.hh"
 
 
 /// Do little endian to big endian conversion on the bytes in the object file
@@ -28,28 +30,98 @@ SwapHeader(noffHeader *h)
     h->uninitData.inFileAddr  = WordToHost(h->uninitData.inFileAddr);
 }
 
+static void
+SwapPagedHeader(noffPagedHeader *h)
+{
+    ASSERT(h != nullptr);
+
+    h->pageSize        = WordToHost(h->pageSize);
+    h->codeFlags       = WordToHost(h->codeFlags);
+    h->initDataFlags   = WordToHost(h->initDataFlags);
+    h->uninitDataFlags = WordToHost(h->uninitDataFlags);
+}
+
 Executable::Executable(OpenFile *new_file)
 {
     ASSERT(new_file != nullptr);
 
-    file = new_file;
+    file   = new_file;
+    key    = file->GetSector();
+    cached = executableCache->Find(key, file->Length(),
+                                   &header, &pagedHeader);
+    if (cached) {
+        return;
+    }
+
     file->ReadAt((char *) &header, sizeof header, 0);
+
+    pagedHeader.pageSize        = 0;
+    pagedHeader.codeFlags       = NOFF_READ | NOFF_EXEC;
+    pagedHeader.initDataFlags   = NOFF_READ | NOFF_WRITE;
+    pagedHeader.uninitDataFlags = NOFF_READ | NOFF_WRITE;
 }
 
 bool
 Executable::CheckMagic()
 {
-    if (header.noffMagic != NOFF_MAGIC &&
-          WordToHost(header.noffMagic) == NOFF_MAGIC) {
+    if (cached) {
+        return true;
+    }
+
+    if (!CheckHeader()) {
+        return false;
+    }
+    executableCache->Add(key, file, header, pagedHeader);
+    cached = true;
+    return true;
+}
+
+bool
+Executable::CheckHeader()
+{
+    bool swapped = false;
+    if (header.noffMagic != NOFF_MAGIC && header.noffMagic != NOFF_MAGIC_PAGED
+          && (WordToHost(header.noffMagic) == NOFF_MAGIC
+              || WordToHost(header.noffMagic) == NOFF_MAGIC_PAGED)) {
         SwapHeader(&header);
+        swapped = true;
+    }
+
+    if (header.noffMagic == NOFF_MAGIC_PAGED) {
+        file->ReadAt((char *) &pagedHeader, sizeof pagedHeader,
+                     sizeof header);
+        if (swapped) {
+            SwapPagedHeader(&pagedHeader);
+        }
+        // The loader relies on segments not sharing pages.
+        return pagedHeader.pageSize == PAGE_SIZE;
     }
     return header.noffMagic == NOFF_MAGIC;
 }
 
+bool
+Executable::IsPaged() const
+{
+    return header.noffMagic == NOFF_MAGIC_PAGED;
+}
+
+static uint32_t
+SegmentEnd(const noffSegment &s)
+{
+    return s.size == 0 ? 0 : s.virtualAddr + s.size;
+}
+
 uint32_t
 Executable::GetSize() const
 {
-    return header.code.size + header.initData.size + header.uninitData.size;
+    uint32_t size = SegmentEnd(header.code);
+    if (SegmentEnd(header.initData) > size) {
+        size = SegmentEnd(header.initData);
+    }
+    if (SegmentEnd(header.uninitData) > size) {
+        size = SegmentEnd(header.uninitData);
+    }
+    return size;
 }
 
 uint32_t
@@ -82,6 +154,30 @@ Executable::GetInitDataAddr() const
     return header.initData.virtualAddr;
 }
 
+uint32_t
+Executable::GetUninitDataAddr() const
+{
+    return header.uninitData.virtualAddr;
+}
+
+uint32_t
+Executable::GetCodeFlags() const
+{
+    return pagedHeader.codeFlags;
+}
+
+uint32_t
+Executable::GetInitDataFlags() const
+{
+    return pagedHeader.initDataFlags;
+}
+
+uint32_t
+Executable::GetUninitDataFlags() const
+{
+    return pagedHeader.uninitDataFlags;
+}
+
 int
 Executable::ReadCodeBlock(char *dest, uint32_t size, uint32_t offset)
 {
@@ -89,6 +185,9 @@ Executable::ReadCodeBlock(char *dest, uint32_t size, uint32_t offset)
     ASSERT(size != 0);
     ASSERT(offset < header.code.size);
 
+    if (executableCache->ReadCode(key, dest, size, offset)) {
+        return size;
+    }
     return file->ReadAt(dest, size, header.code.inFileAddr + offset);
 }
 
@@ -99,5 +198,8 @@ Executable::ReadDataBlock(char *dest, uint32_t size, uint32_t offset)
     ASSERT(size != 0);
     ASSERT(offset < header.initData.size);
 
+    if (executableCache->ReadData(key, dest, size, offset)) {
+        return size;
+    }
     return file->ReadAt(dest, size, header.initData.inFileAddr + offset);
 }
@@ -31,9 +31,18 @@ public:
     /// the magic number at the beginning of the header.  Also detect if it
     /// is reversed (due to mismatching endianness) and in that case swap the
     /// entire header.
+    ///
+    /// Valid executables are added to `executableCache`, so that running
+    /// them again skips all of this.
     bool CheckMagic();
 
+    /// Check whether the segments are page aligned, each on pages of its
+    /// own (see `noffPagedHeader`).
+    bool IsPaged() const;
+
+    /// Amount of memory spanned by the segments, from address 0.
     uint32_t GetSize() const;
+
     uint32_t GetCodeSize() const;
     uint32_t GetInitDataSize() const;
     uint32_t GetUninitDataSize() const;
@@ -47,6 +56,14 @@ public:
     uint32_t GetInitDataAddr() const;
     uint32_t GetUninitDataAddr() const;
 
+    /// Permissions of each segment: `NOFF_READ`, `NOFF_WRITE` and
+    /// `NOFF_EXEC` combined.  Files that are not page aligned do not record
+    /// them; their code is taken to be read-only and the rest writable.
+
+    uint32_t GetCodeFlags() const;
+    uint32_t GetInitDataFlags() const;
+    uint32_t GetUninitDataFlags() const;
+
     /// The following methods read a block from a given program segment into
     /// memory.  Reads are possible only from the code and the initialized
     /// data segments, because these are the ones that actually encode their
@@ -63,8 +80,19 @@ public:
     int ReadDataBlock(char *dest, uint32_t size, uint32_t offset);
 
 private:
+    /// Check and fix the header read from the file; see `CheckMagic`.
+    bool CheckHeader();
+
     OpenFile *file;
     noffHeader header;
+    noffPagedHeader pagedHeader;
+
+    /// Identifies the file in `executableCache`.
+    int key;
+
+    /// Whether the headers came from `executableCache`, and so are already
+    /// checked.
+    bool cached;
 };
 
 
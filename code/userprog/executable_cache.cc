@@ -0,0 +1,167 @@
+/// Copyright (c) 2019-2021 Docentes de la Universidad Nacional de Rosario.
+/// All rights reserved.  See `copyright.h` for copyright notice and
+/// limitation of liability and disclaimer of warranty provisions.
+
+
+#include "executable_cache.hh"
+#include "threads/system.hh"
+
+#include <string.h>
+
+
+ExecutableCache::ExecutableCache(unsigned aCapacity)
+{
+    capacity = aCapacity;
+    clock    = 0;
+    entries  = new Entry[capacity];
+    for (unsigned i = 0; i < capacity; i++) {
+        entries[i].key      = -1;
+        entries[i].code     = nullptr;
+        entries[i].initData = nullptr;
+    }
+}
+
+ExecutableCache::~ExecutableCache()
+{
+    for (unsigned i = 0; i < capacity; i++) {
+        Free(&entries[i]);
+    }
+    delete [] entries;
+}
+
+ExecutableCache::Entry *
+ExecutableCache::Lookup(int key)
+{
+    for (unsigned i = 0; i < capacity; i++) {
+        if (entries[i].key == key) {
+            entries[i].lastUse = ++clock;
+            return &entries[i];
+        }
+    }
+    return nullptr;
+}
+
+void
+ExecutableCache::Free(Entry *e)
+{
+    ASSERT(e != nullptr);
+
+    e->key = -1;
+    delete [] e->code;
+    delete [] e->initData;
+    e->code     = nullptr;
+    e->initData = nullptr;
+}
+
+bool
+ExecutableCache::Find(int key, unsigned length,
+                      noffHeader *header, noffPagedHeader *pagedHeader)
+{
+    ASSERT(header != nullptr);
+    ASSERT(pagedHeader != nullptr);
+
+    Entry *e = Lookup(key);
+    if (e != nullptr && e->length != length) {
+        // Rewritten behind our back; only possible on the stub file system,
+        // where other host processes may change it.
+        Free(e);
+        e = nullptr;
+    }
+    if (e == nullptr) {
+        stats->numExecCacheMisses++;
+        return false;
+    }
+
+    DEBUG('a', "Executable %d found in the cache\n", key);
+    stats->numExecCacheHits++;
+    *header      = e->header;
+    *pagedHeader = e->pagedHeader;
+    return true;
+}
+
+void
+ExecutableCache::Add(int key, OpenFile *file,
+                     const noffHeader &header,
+                     const noffPagedHeader &pagedHeader)
+{
+    ASSERT(file != nullptr);
+
+    if (capacity == 0) {
+        return;
+    }
+
+    // Read the segments before picking an entry: reading may block, and
+    // meanwhile some other thread may cache this same executable.
+    char *code = nullptr, *initData = nullptr;
+    if (header.code.size > 0) {
+        code = new char [header.code.size];
+        file->ReadAt(code, header.code.size, header.code.inFileAddr);
+    }
+    if (header.initData.size > 0) {
+        initData = new char [header.initData.size];
+        file->ReadAt(initData, header.initData.size,
+                     header.initData.inFileAddr);
+    }
+
+    Entry *e = Lookup(key);
+    if (e == nullptr) {
+        e = &entries[0];
+        for (unsigned i = 1; i < capacity && e->key != -1; i++) {
+            if (entries[i].key == -1 || entries[i].lastUse < e->lastUse) {
+                e = &entries[i];
+            }
+        }
+        if (e->key != -1) {
+            DEBUG('a', "Evicting executable %d from the cache\n", e->key);
+            stats->numExecCacheEvictions++;
+        }
+    }
+    Free(e);
+
+    e->key         = key;
+    e->length      = file->Length();
+    e->header      = header;
+    e->pagedHeader = pagedHeader;
+    e->code        = code;
+    e->initData    = initData;
+    e->lastUse     = ++clock;
+}
+
+bool
+ExecutableCache::ReadCode(int key, char *dest, uint32_t size,
+                          uint32_t offset)
+{
+    ASSERT(dest != nullptr);
+
+    Entry *e = Lookup(key);
+    if (e == nullptr || offset + size > e->header.code.size) {
+        return false;
+    }
+    memcpy(dest, &e->code[offset], size);
+    return true;
+}
+
+bool
+ExecutableCache::ReadData(int key, char *dest, uint32_t size,
+                          uint32_t offset)
+{
+    ASSERT(dest != nullptr);
+
+    Entry *e = Lookup(key);
+    if (e == nullptr || offset + size > e->header.initData.size) {
+        return false;
+    }
+    memcpy(dest, &e->initData[offset], size);
+    return true;
+}
+
+void
+ExecutableCache::Invalidate(int key)
+{
+    for (unsigned i = 0; i < capacity; i++) {
+        if (entries[i].key == key) {
+            DEBUG('a', "Dropping executable %d from the cache\n", key);
+            Free(&entries[i]);
+        }
+    }
+}
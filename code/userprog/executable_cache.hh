@@ -0,0 +1,74 @@
+/// Kernel-side cache of the executables most recently run.
+///
+/// Running the same program over and over would otherwise open it, read
+/// and check its header, and read every page of it from the file system
+/// each time.  The cache keeps the parsed header of each executable and a
+/// copy of its code and initialized data segments in host memory, so that
+/// `Executable` can serve them without touching the file.
+///
+/// Copyright (c) 2019-2021 Docentes de la Universidad Nacional de Rosario.
+/// All rights reserved.  See `copyright.h` for copyright notice and
+/// limitation of liability and disclaimer of warranty provisions.
+
+#ifndef NACHOS_USERPROG_EXECUTABLECACHE__HH
+#define NACHOS_USERPROG_EXECUTABLECACHE__HH
+
+
+#include "bin/noff.h"
+#include "filesys/open_file.hh"
+
+
+/// Executables are identified by the sector of their file header (see
+/// `OpenFile::GetSector`).  When the cache is full, the entry used least
+/// recently is evicted.
+class ExecutableCache {
+public:
+
+    /// Cache up to `capacity` executables; zero disables caching.
+    ExecutableCache(unsigned capacity);
+
+    ~ExecutableCache();
+
+    /// Look up the executable `key`, whose file is `length` bytes long.
+    /// On a hit, copy its headers into `header` and `pagedHeader`.
+    bool Find(int key, unsigned length,
+              noffHeader *header, noffPagedHeader *pagedHeader);
+
+    /// Add the executable `key`, already checked, reading its segments
+    /// from `file`.
+    void Add(int key, OpenFile *file,
+             const noffHeader &header, const noffPagedHeader &pagedHeader);
+
+    /// Copy `size` bytes at `offset` of the code segment of `key`, if it is
+    /// cached, into `dest`.  Return whether it was.
+    bool ReadCode(int key, char *dest, uint32_t size, uint32_t offset);
+
+    /// Likewise, for the initialized data segment.
+    bool ReadData(int key, char *dest, uint32_t size, uint32_t offset);
+
+    /// Forget executable `key`, because its file changed or went away.
+    void Invalidate(int key);
+
+private:
+    struct Entry {
+        int key;  ///< -1 if the entry is free.
+        unsigned length;
+        noffHeader header;
+        noffPagedHeader pagedHeader;
+        char *code;
+        char *initData;
+        unsigned long lastUse;
+    };
+
+    /// Return the entry holding `key`, or null.
+    Entry *Lookup(int key);
+
+    void Free(Entry *e);
+
+    Entry *entries;
+    unsigned capacity;
+    unsigned long clock;  ///< Advances on every use, to order entries.
+};
+
+
+#endif
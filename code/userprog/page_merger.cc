@@ -0,0 +1,123 @@
+/// Copyright (c) 2019-2021 Docentes de la Universidad Nacional de Rosario.
+/// All rights reserved.  See `copyright.h` for copyright notice and
+/// limitation of liability and disclaimer of warranty provisions.
+
+
+#include "page_merger.hh"
+#include "threads/system.hh"
+
+#include <string.h>
+
+
+#ifdef SWAP
+
+PageMerger::PageMerger(unsigned aNumFrames, unsigned anInterval)
+{
+    numFrames = aNumFrames;
+    interval  = anInterval;
+    waiting   = false;
+    wakeUp    = new Semaphore("page merger", 0);
+    lastHash  = new uint32_t [numFrames];
+    known     = new bool [numFrames];
+    stable    = new unsigned [numFrames];
+    for (unsigned i = 0; i < numFrames; i++) {
+        known[i] = false;
+    }
+
+    if (interval > 0) {
+        Thread *t = new Thread("page merger", false);
+        t->Fork(Run, this);
+        // A timer interrupt does not keep an otherwise idle machine
+        // running.
+        interrupt->Schedule(Tick, this, interval, TIMER_INT);
+    }
+}
+
+PageMerger::~PageMerger()
+{
+    delete wakeUp;
+    delete [] lastHash;
+    delete [] known;
+    delete [] stable;
+}
+
+void
+PageMerger::Tick(void *arg)
+{
+    ASSERT(arg != nullptr);
+
+    PageMerger *m = (PageMerger *) arg;
+    interrupt->Schedule(Tick, m, m->interval, TIMER_INT);
+    if (m->waiting) {
+        m->waiting = false;
+        m->wakeUp->V();
+    }
+}
+
+void
+PageMerger::Run(void *arg)
+{
+    ASSERT(arg != nullptr);
+
+    PageMerger *m = (PageMerger *) arg;
+    for (;;) {
+        m->waiting = true;
+        m->wakeUp->P();
+        m->Scan();
+    }
+}
+
+/// FNV-1a.
+uint32_t
+PageMerger::Hash(const char *page)
+{
+    uint32_t h = 2166136261u;
+    for (unsigned i = 0; i < PAGE_SIZE; i++) {
+        h = (h ^ (unsigned char) page[i]) * 16777619u;
+    }
+    return h;
+}
+
+void
+PageMerger::Scan()
+{
+    DEBUG('v', "Scanning memory for identical pages\n");
+    stats->numMergeScans++;
+
+    // Frames are only looked at, or changed, in the kernel, and no step
+    // below blocks, so pages cannot change under our feet.
+    const char *mainMemory = machine->mainMemory;
+    unsigned numStable = 0;
+    for (unsigned f = 0; f < numFrames; f++) {
+        if (!coreMap->CanMerge(f)) {
+            known[f] = false;
+            continue;
+        }
+        uint32_t h = Hash(&mainMemory[f * PAGE_SIZE]);
+        bool unchanged = known[f] && lastHash[f] == h;
+        lastHash[f] = h;
+        known[f]    = true;
+        if (!unchanged)
+            continue;
+
+        bool merged = false;
+        for (unsigned i = 0; i < numStable && !merged; i++) {
+            unsigned g = stable[i];
+            if (lastHash[g] == h && memcmp(&mainMemory[f * PAGE_SIZE],
+                                           &mainMemory[g * PAGE_SIZE],
+                                           PAGE_SIZE) == 0) {
+                DEBUG('v', "Merging frame %u into frame %u\n", f, g);
+                unsigned pages = coreMap->GetRefCount(f);
+                coreMap->Merge(f, g);
+                stats->numMergedPages += pages;
+                stats->numMergedFrames++;
+                known[f] = false;
+                merged   = true;
+            }
+        }
+        if (!merged)
+            stable[numStable++] = f;
+    }
+}
+
+#endif
@@ -0,0 +1,62 @@
+/// Merging of identical pages across address spaces.
+///
+/// Processes often hold pages with the same contents: zeroed stacks and
+/// heaps, or data left alike by running the same program.  A kernel thread
+/// wakes up periodically, hashes the contents of every frame in use, and
+/// makes the pages in frames found identical share a single one,
+/// copy-on-write, freeing the others.  A write to a merged page breaks the
+/// sharing through the read-only exception, as for a forked address space.
+///
+/// Copyright (c) 2019-2021 Docentes de la Universidad Nacional de Rosario.
+/// All rights reserved.  See `copyright.h` for copyright notice and
+/// limitation of liability and disclaimer of warranty provisions.
+
+#ifndef NACHOS_USERPROG_PAGEMERGER__HH
+#define NACHOS_USERPROG_PAGEMERGER__HH
+
+
+#include "threads/semaphore.hh"
+
+#include <stdint.h>
+
+
+/// Only frames whose contents did not change since the previous scan are
+/// merged, so that pages being written to are not merged just to be copied
+/// right back.
+class PageMerger {
+public:
+
+    /// Scan the `numFrames` frames of main memory every `interval` ticks;
+    /// zero disables merging.
+    PageMerger(unsigned numFrames, unsigned interval);
+
+    ~PageMerger();
+
+    /// Merge the frames found identical, and stable since the last scan.
+    void Scan();
+
+private:
+
+    /// Interrupt handler, waking the scanner up.
+    static void Tick(void *arg);
+
+    /// Body of the scanner thread.
+    static void Run(void *arg);
+
+    static uint32_t Hash(const char *page);
+
+    Semaphore *wakeUp;
+    bool waiting;  ///< Whether the scanner is waiting on `wakeUp`.
+    unsigned numFrames;
+    unsigned interval;
+
+    /// Hash of the contents of each frame at the previous scan, if `known`.
+    uint32_t *lastHash;
+    bool *known;
+
+    /// Frames found stable during a scan and not merged away.
+    unsigned *stable;
+};
+
+
+#endif
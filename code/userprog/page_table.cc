@@ -0,0 +1,218 @@
+/// Copyright (c) 2019-2021 Docentes de la Universidad Nacional de Rosario.
+/// All rights reserved.  See `copyright.h` for copyright notice and
+/// limitation of liability and disclaimer of warranty provisions.
+
+
+#include "page_table.hh"
+#include "lib/utility.hh"
+
+#include <limits.h>
+
+
+PageTable::PageTable()
+{
+#ifdef USE_TLB
+    directory = nullptr;
+    numLeaves = 0;
+#else
+    entries    = nullptr;
+    lastSample = nullptr;
+#endif
+    numPages = 0;
+    asid     = 0;
+    InitEntry(&blank, 0);
+}
+
+PageTable::~PageTable()
+{
+    Resize(0);
+}
+
+void
+PageTable::SetAsid(unsigned anAsid)
+{
+    ASSERT(Next(0) == numPages);
+    asid = anAsid;
+}
+
+void
+PageTable::InitEntry(TranslationEntry *e, unsigned vpn) const
+{
+    ASSERT(e != nullptr);
+
+    e->virtualPage  = vpn;
+    e->physicalPage = UINT_MAX;
+    e->asid         = asid;
+    e->valid        = false;
+    e->readOnly     = false;
+    e->use          = false;
+    e->dirty        = false;
+    e->referenced   = false;
+    e->isInSwap     = false;
+    e->copyOnWrite  = false;
+    e->prefetched   = false;
+}
+
+unsigned
+PageTable::Size() const
+{
+    return numPages;
+}
+
+#ifdef USE_TLB
+
+PageTable::Leaf *
+PageTable::GetLeaf(unsigned vpn)
+{
+    ASSERT(vpn < numPages);
+
+    Leaf **leaf = &directory[vpn / LEAF_PAGES];
+    if (*leaf == nullptr) {
+        *leaf = new Leaf;
+        unsigned first = vpn - vpn % LEAF_PAGES;
+        for (unsigned i = 0; i < LEAF_PAGES; i++) {
+            InitEntry(&(*leaf)->entries[i], first + i);
+            (*leaf)->lastSample[i] = 0;
+        }
+    }
+    return *leaf;
+}
+
+TranslationEntry &
+PageTable::operator[](unsigned vpn)
+{
+    return GetLeaf(vpn)->entries[vpn % LEAF_PAGES];
+}
+
+const TranslationEntry &
+PageTable::operator[](unsigned vpn) const
+{
+    ASSERT(vpn < numPages);
+
+    const Leaf *leaf = directory[vpn / LEAF_PAGES];
+    return leaf != nullptr ? leaf->entries[vpn % LEAF_PAGES] : blank;
+}
+
+unsigned
+PageTable::Next(unsigned vpn) const
+{
+    for (unsigned i = vpn / LEAF_PAGES; i < numLeaves; i++) {
+        if (directory[i] != nullptr)
+            return vpn > i * LEAF_PAGES ? vpn : i * LEAF_PAGES;
+    }
+    return numPages;
+}
+
+void
+PageTable::Resize(unsigned newNumPages)
+{
+    unsigned newNumLeaves = DivRoundUp(newNumPages, LEAF_PAGES);
+    for (unsigned i = newNumLeaves; i < numLeaves; i++) {
+        delete directory[i];
+    }
+
+    Leaf **newDirectory = newNumLeaves > 0 ? new Leaf *[newNumLeaves]
+                                           : nullptr;
+    for (unsigned i = 0; i < newNumLeaves; i++) {
+        newDirectory[i] = i < numLeaves ? directory[i] : nullptr;
+    }
+    delete [] directory;
+    directory = newDirectory;
+    numLeaves = newNumLeaves;
+
+    // The last leaf may keep entries past the end; make them new again.
+    if (newNumPages < numPages && newNumPages % LEAF_PAGES != 0
+          && directory[newNumLeaves - 1] != nullptr) {
+        Leaf *leaf = directory[newNumLeaves - 1];
+        for (unsigned i = newNumPages; i < newNumLeaves * LEAF_PAGES; i++) {
+            InitEntry(&leaf->entries[i % LEAF_PAGES], i);
+            leaf->lastSample[i % LEAF_PAGES] = 0;
+        }
+    }
+    numPages = newNumPages;
+}
+
+unsigned &
+PageTable::LastSample(unsigned vpn)
+{
+    return GetLeaf(vpn)->lastSample[vpn % LEAF_PAGES];
+}
+
+unsigned long
+PageTable::Footprint() const
+{
+    unsigned long bytes = numLeaves * sizeof *directory;
+    for (unsigned i = 0; i < numLeaves; i++) {
+        if (directory[i] != nullptr)
+            bytes += sizeof (Leaf);
+    }
+    return bytes;
+}
+
+#else
+
+TranslationEntry &
+PageTable::operator[](unsigned vpn)
+{
+    ASSERT(vpn < numPages);
+    return entries[vpn];
+}
+
+const TranslationEntry &
+PageTable::operator[](unsigned vpn) const
+{
+    ASSERT(vpn < numPages);
+    return entries[vpn];
+}
+
+unsigned
+PageTable::Next(unsigned vpn) const
+{
+    return vpn < numPages ? vpn : numPages;
+}
+
+void
+PageTable::Resize(unsigned newNumPages)
+{
+    TranslationEntry *newEntries = nullptr;
+    unsigned *newSample = nullptr;
+    if (newNumPages > 0) {
+        newEntries = new TranslationEntry[newNumPages];
+        newSample  = new unsigned[newNumPages];
+    }
+    for (unsigned i = 0; i < newNumPages; i++) {
+        if (i < numPages) {
+            newEntries[i] = entries[i];
+            newSample[i]  = lastSample[i];
+        } else {
+            InitEntry(&newEntries[i], i);
+            newSample[i] = 0;
+        }
+    }
+    delete [] entries;
+    delete [] lastSample;
+    entries    = newEntries;
+    lastSample = newSample;
+    numPages   = newNumPages;
+}
+
+unsigned &
+PageTable::LastSample(unsigned vpn)
+{
+    ASSERT(vpn < numPages);
+    return lastSample[vpn];
+}
+
+unsigned long
+PageTable::Footprint() const
+{
+    return numPages * (sizeof *entries + sizeof *lastSample);
+}
+
+TranslationEntry *
+PageTable::GetEntries()
+{
+    return entries;
+}
+
+#endif
@@ -0,0 +1,98 @@
+/// Page table of an address space.
+///
+/// With a TLB, the machine never looks at the page table: the kernel
+/// refills the TLB from it on each miss.  The table is kept in two levels
+/// then, a directory pointing to leaves of `LEAF_PAGES` entries, and a leaf
+/// is only allocated when one of its entries is first written to.  A large
+/// and sparse address space, with a big heap or files mapped far above it,
+/// only costs memory for the stretches of it actually in use, and going
+/// over the table skips the rest.
+///
+/// Without a TLB, the machine walks a linear table by itself, which is
+/// what the table is then.
+///
+/// Copyright (c) 2019-2021 Docentes de la Universidad Nacional de Rosario.
+/// All rights reserved.  See `copyright.h` for copyright notice and
+/// limitation of liability and disclaimer of warranty provisions.
+
+#ifndef NACHOS_USERPROG_PAGETABLE__HH
+#define NACHOS_USERPROG_PAGETABLE__HH
+
+
+#include "machine/translation_entry.hh"
+
+
+class PageTable {
+public:
+
+    /// Create an empty table.
+    PageTable();
+
+    ~PageTable();
+
+    /// Set the address space identifier entries are tagged with, before
+    /// any of them is allocated.
+    void SetAsid(unsigned asid);
+
+    /// Entry of virtual page `vpn`, allocating it if needed.  Only for
+    /// writing it: merely looking should go through the `const` version.
+    TranslationEntry &operator[](unsigned vpn);
+
+    /// Entry of virtual page `vpn`; an invalid one if it was never
+    /// allocated, which this does not do.
+    const TranslationEntry &operator[](unsigned vpn) const;
+
+    /// First page from `vpn` on whose entry may have been allocated, or
+    /// `Size` if there is none.  Loops over the table use it to step over
+    /// unallocated stretches.
+    unsigned Next(unsigned vpn) const;
+
+    /// Number of entries.
+    unsigned Size() const;
+
+    /// Grow or shrink the table to `numPages` entries.  New entries are
+    /// invalid, and pages dropped must have been released already.
+    void Resize(unsigned numPages);
+
+    /// Sample of the working set estimation each page was last seen
+    /// referenced in, 0 if never.
+    unsigned &LastSample(unsigned vpn);
+
+    /// Bytes of host memory taken by the table.
+    unsigned long Footprint() const;
+
+#ifndef USE_TLB
+    /// The entries, for the machine to walk.
+    TranslationEntry *GetEntries();
+#endif
+
+private:
+
+    /// Set up the entry of a page never used.
+    void InitEntry(TranslationEntry *e, unsigned vpn) const;
+
+#ifdef USE_TLB
+    static const unsigned LEAF_PAGES = 32;
+
+    struct Leaf {
+        TranslationEntry entries[LEAF_PAGES];
+        unsigned lastSample[LEAF_PAGES];
+    };
+
+    /// Leaf holding `vpn`, allocated if needed.
+    Leaf *GetLeaf(unsigned vpn);
+
+    Leaf **directory;  ///< Null where no leaf was allocated.
+    unsigned numLeaves;
+#else
+    TranslationEntry *entries;
+    unsigned *lastSample;
+#endif
+
+    unsigned numPages;
+    unsigned asid;
+    TranslationEntry blank;  ///< Returned for unallocated entries.
+};
+
+
+#endif
@@ -0,0 +1,320 @@
+/// Copyright (c) 2019-2021 Docentes de la Universidad Nacional de Rosario.
+/// All rights reserved.  See `copyright.h` for copyright notice and
+/// limitation of liability and disclaimer of warranty provisions.
+
+
+#include "swap_cache.hh"
+#include "threads/system.hh"
+
+#include <stdint.h>
+#include <string.h>
+
+
+#ifdef SWAP
+
+/// Compressed pages are a sequence of runs, each starting with a control
+/// byte.  Below `MATCH_FLAG`, it is followed by that many plus one literal
+/// bytes; otherwise its low bits plus `MIN_MATCH` give the length of a copy
+/// of earlier output, and the following byte its distance minus one.
+static const unsigned MATCH_FLAG = 0x80;
+static const unsigned MIN_MATCH  = 3;
+static const unsigned MAX_MATCH  = MIN_MATCH + 0x7F;
+static const unsigned MAX_DIST   = 0x100;
+static const unsigned MAX_RUN    = 0x80;
+
+SwapCache::SwapCache(unsigned aCapacity)
+{
+    capacity = aCapacity;
+    used     = 0;
+    oldest   = nullptr;
+    newest   = nullptr;
+    for (unsigned i = 0; i < NUM_BUCKETS; i++) {
+        buckets[i] = nullptr;
+    }
+}
+
+SwapCache::~SwapCache()
+{
+    while (oldest != nullptr) {
+        Remove(oldest);
+    }
+}
+
+unsigned
+SwapCache::Hash(const AddressSpace *owner, unsigned vpn)
+{
+    return ((uintptr_t) owner / sizeof (void *) + vpn) % NUM_BUCKETS;
+}
+
+SwapCache::Entry *
+SwapCache::Lookup(const AddressSpace *owner, unsigned vpn) const
+{
+    for (Entry *e = buckets[Hash(owner, vpn)]; e != nullptr; e = e->hashNext) {
+        if (e->owner == owner && e->vpn == vpn) {
+            return e;
+        }
+    }
+    return nullptr;
+}
+
+void
+SwapCache::Remove(Entry *e)
+{
+    ASSERT(e != nullptr);
+
+    Entry **link = &buckets[Hash(e->owner, e->vpn)];
+    while (*link != e) {
+        link = &(*link)->hashNext;
+    }
+    *link = e->hashNext;
+
+    if (e->prev != nullptr) {
+        e->prev->next = e->next;
+    } else {
+        oldest = e->next;
+    }
+    if (e->next != nullptr) {
+        e->next->prev = e->prev;
+    } else {
+        newest = e->prev;
+    }
+
+    used -= e->size == 0 ? sizeof e->fill : e->size;
+    delete [] e->data;
+    delete e;
+}
+
+void
+SwapCache::Evict()
+{
+    ASSERT(oldest != nullptr);
+
+    char page[PAGE_SIZE];
+    AddressSpace *owner = oldest->owner;
+    unsigned vpn = oldest->vpn;
+    Unpack(oldest, page);
+    Remove(oldest);
+
+    DEBUG('v', "Swap cache full, writing back page %u\n", vpn);
+    stats->numSwapCacheWritebacks++;
+    owner->WriteSwap(vpn, page);
+}
+
+unsigned
+SwapCache::Compress(const char *page, char *out)
+{
+    const unsigned char *in = (const unsigned char *) page;
+    unsigned size = 0;
+    unsigned literals = 0;  // Pending literal bytes, ending at `i`.
+
+    for (unsigned i = 0; i <= PAGE_SIZE; ) {
+        // Find the longest earlier match of what follows.
+        unsigned bestLength = 0, bestDist = 0;
+        for (unsigned j = i > MAX_DIST ? i - MAX_DIST : 0;
+             j < i && i < PAGE_SIZE; j++) {
+            unsigned length = 0;
+            while (i + length < PAGE_SIZE && length < MAX_MATCH
+                     && in[j + length] == in[i + length]) {
+                length++;
+            }
+            if (length > bestLength) {
+                bestLength = length;
+                bestDist   = i - j;
+            }
+        }
+
+        bool flush = i == PAGE_SIZE || bestLength >= MIN_MATCH
+                     || literals == MAX_RUN;
+        if (flush && literals > 0) {
+            if (size + 1 + literals >= PAGE_SIZE) {
+                return 0;
+            }
+            out[size++] = literals - 1;
+            memcpy(&out[size], &in[i - literals], literals);
+            size += literals;
+            literals = 0;
+        }
+        if (i == PAGE_SIZE) {
+            break;
+        }
+
+        if (bestLength >= MIN_MATCH) {
+            if (size + 2 >= PAGE_SIZE) {
+                return 0;
+            }
+            out[size++] = MATCH_FLAG | (bestLength - MIN_MATCH);
+            out[size++] = bestDist - 1;
+            i += bestLength;
+        } else {
+            literals++;
+            i++;
+        }
+    }
+    return size;
+}
+
+void
+SwapCache::Decompress(const char *in, unsigned size, char *page)
+{
+    unsigned o = 0;
+    for (unsigned i = 0; i < size; ) {
+        unsigned char control = in[i++];
+        if (control < MATCH_FLAG) {
+            unsigned length = control + 1;
+            ASSERT(o + length <= PAGE_SIZE);
+            memcpy(&page[o], &in[i], length);
+            i += length;
+            o += length;
+        } else {
+            unsigned length = (control & ~MATCH_FLAG) + MIN_MATCH;
+            unsigned dist   = (unsigned char) in[i++] + 1;
+            ASSERT(dist <= o && o + length <= PAGE_SIZE);
+            for (unsigned k = 0; k < length; k++, o++) {
+                page[o] = page[o - dist];  // May overlap itself.
+            }
+        }
+    }
+    ASSERT(o == PAGE_SIZE);
+}
+
+void
+SwapCache::Unpack(const Entry *e, char *page)
+{
+    ASSERT(e != nullptr);
+
+    if (e->size == 0) {
+        for (unsigned i = 0; i < PAGE_SIZE; i += sizeof e->fill) {
+            memcpy(&page[i], &e->fill, sizeof e->fill);
+        }
+    } else {
+        Decompress(e->data, e->size, page);
+    }
+}
+
+bool
+SwapCache::Store(AddressSpace *owner, unsigned vpn, const char *page)
+{
+    ASSERT(owner != nullptr);
+    ASSERT(page != nullptr);
+
+    Drop(owner, vpn);
+    if (capacity == 0) {
+        return false;
+    }
+
+    Entry *e = new Entry;
+    e->owner = owner;
+    e->vpn   = vpn;
+    e->size  = 0;
+    e->data  = nullptr;
+    memcpy(&e->fill, page, sizeof e->fill);
+    for (unsigned i = sizeof e->fill; i < PAGE_SIZE; i += sizeof e->fill) {
+        if (memcmp(&page[i], &e->fill, sizeof e->fill) != 0) {
+            char packed[PAGE_SIZE];
+            e->size = Compress(page, packed);
+            if (e->size == 0) {
+                stats->numSwapCacheRejects++;
+                delete e;
+                return false;
+            }
+            e->data = new char [e->size];
+            memcpy(e->data, packed, e->size);
+            break;
+        }
+    }
+
+    unsigned cost = e->size == 0 ? sizeof e->fill : e->size;
+    if (cost > capacity) {
+        delete [] e->data;
+        delete e;
+        return false;
+    }
+    while (used + cost > capacity) {
+        Evict();
+    }
+
+    // Writing back may have blocked, and somebody else may have stored
+    // this page meanwhile.
+    Drop(owner, vpn);
+
+    unsigned bucket = Hash(owner, vpn);
+    e->hashNext     = buckets[bucket];
+    buckets[bucket] = e;
+    e->prev = newest;
+    e->next = nullptr;
+    if (newest != nullptr) {
+        newest->next = e;
+    } else {
+        oldest = e;
+    }
+    newest = e;
+    used += cost;
+
+    DEBUG('v', "Swap cache stored page %u in %u bytes\n", vpn, cost);
+    stats->numSwapCacheStores++;
+    stats->numSwapCacheBytesIn  += PAGE_SIZE;
+    stats->numSwapCacheBytesOut += cost;
+    if (e->size == 0) {
+        stats->numSwapCacheSameFilled++;
+    }
+    return true;
+}
+
+bool
+SwapCache::Load(AddressSpace *owner, unsigned vpn, char *page)
+{
+    ASSERT(page != nullptr);
+
+    Entry *e = Lookup(owner, vpn);
+    if (e == nullptr) {
+        stats->numSwapCacheMisses++;
+        return false;
+    }
+
+    Unpack(e, page);
+    Remove(e);
+    stats->numSwapCacheHits++;
+    return true;
+}
+
+bool
+SwapCache::Peek(const AddressSpace *owner, unsigned vpn, char *page) const
+{
+    ASSERT(page != nullptr);
+
+    const Entry *e = Lookup(owner, vpn);
+    if (e == nullptr) {
+        return false;
+    }
+    Unpack(e, page);
+    return true;
+}
+
+bool
+SwapCache::Has(const AddressSpace *owner, unsigned vpn) const
+{
+    return Lookup(owner, vpn) != nullptr;
+}
+
+void
+SwapCache::Drop(const AddressSpace *owner, unsigned vpn)
+{
+    Entry *e = Lookup(owner, vpn);
+    if (e != nullptr) {
+        Remove(e);
+    }
+}
+
+void
+SwapCache::DropAll(const AddressSpace *owner)
+{
+    for (Entry *e = oldest; e != nullptr; ) {
+        Entry *next = e->next;
+        if (e->owner == owner) {
+            Remove(e);
+        }
+        e = next;
+    }
+}
+
+#endif
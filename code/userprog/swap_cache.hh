@@ -0,0 +1,96 @@
+/// Compressed cache of pages on their way to the swap files.
+///
+/// Evicting a dirty page would otherwise write it to the swap file of its
+/// address space, and faulting it back in would read it again, both paying
+/// the full latency of the simulated disk.  The cache keeps evicted pages
+/// compressed in a bounded pool of host memory instead: a page filled with
+/// a single repeated word takes just that word, and any other page is
+/// packed with a small LZ77 variant.  Only pages that do not compress, and
+/// those pushed out of a full pool, reach the swap file.
+///
+/// Copyright (c) 2019-2021 Docentes de la Universidad Nacional de Rosario.
+/// All rights reserved.  See `copyright.h` for copyright notice and
+/// limitation of liability and disclaimer of warranty provisions.
+
+#ifndef NACHOS_USERPROG_SWAPCACHE__HH
+#define NACHOS_USERPROG_SWAPCACHE__HH
+
+
+class AddressSpace;
+
+/// Pages are identified by their address space and virtual page number.
+/// The cache is exclusive: loading a page takes it out of the pool, and
+/// the page has to be stored again when it is next evicted.  When the pool
+/// is full, the pages stored least recently are written to the swap file
+/// of their address space.
+class SwapCache {
+public:
+
+    /// Keep up to `capacity` bytes of compressed pages; zero disables the
+    /// cache.
+    SwapCache(unsigned capacity);
+
+    ~SwapCache();
+
+    /// Keep page `vpn` of `owner`, whose contents are at `page`.  Return
+    /// whether it was kept; otherwise it has to go to the swap file.
+    bool Store(AddressSpace *owner, unsigned vpn, const char *page);
+
+    /// Take page `vpn` of `owner` out of the cache, copying its contents
+    /// into `page`.  Return whether it was cached.
+    bool Load(AddressSpace *owner, unsigned vpn, char *page);
+
+    /// Like `Load`, but leave the page in the cache.
+    bool Peek(const AddressSpace *owner, unsigned vpn, char *page) const;
+
+    /// Check whether page `vpn` of `owner` is cached.
+    bool Has(const AddressSpace *owner, unsigned vpn) const;
+
+    /// Forget page `vpn` of `owner`, which is not needed anymore.
+    void Drop(const AddressSpace *owner, unsigned vpn);
+
+    /// Forget every page of `owner`.
+    void DropAll(const AddressSpace *owner);
+
+private:
+    struct Entry {
+        AddressSpace *owner;
+        unsigned vpn;
+        unsigned size;     ///< Compressed size; 0 for a same filled page.
+        unsigned fill;     ///< Word repeated all over a same filled page.
+        char *data;        ///< Compressed contents, unless same filled.
+        Entry *hashNext;
+        Entry *prev;       ///< Neighbours in store order, oldest first.
+        Entry *next;
+    };
+
+    static const unsigned NUM_BUCKETS = 64;
+
+    static unsigned Hash(const AddressSpace *owner, unsigned vpn);
+
+    Entry *Lookup(const AddressSpace *owner, unsigned vpn) const;
+
+    /// Unlink `e` from the table and the store order, and free it.
+    void Remove(Entry *e);
+
+    /// Write the oldest page to the swap file of its address space.
+    void Evict();
+
+    /// Pack `page` into `out`, which has room for `PAGE_SIZE` bytes.
+    /// Return the packed size, or 0 if it would not be smaller.
+    static unsigned Compress(const char *page, char *out);
+
+    static void Decompress(const char *in, unsigned size, char *page);
+
+    /// Copy the contents of the page held by `e` into `page`.
+    static void Unpack(const Entry *e, char *page);
+
+    Entry *buckets[NUM_BUCKETS];
+    Entry *oldest;
+    Entry *newest;
+    unsigned capacity;
+    unsigned used;  ///< Bytes of compressed data in the pool.
+};
+
+
+#endif
@@ -26,6 +26,9 @@
 #define SC_FORK     4
 #define SC_YIELD    5
 #define SC_EXEC2    6
+#define SC_SBRK     7
+#define SC_MMAP     8
+#define SC_MUNMAP   9
 #define SC_CREATE  10
 #define SC_REMOVE  11
 #define SC_OPEN    12
@@ -69,18 +72,31 @@ SpaceId Exec2(char *name, char **argv, int joinable);
 int Join(SpaceId id);
 
 
-/// User-level thread operations: `Fork` and `Yield`.  To allow multiple
-/// threads to run within a user program.
+/// Process and thread operations: `Fork` and `Yield`.
 
-/// Fork a thread to run a procedure (`func`) in the *same* address space as
-/// the current thread.
-int Fork(void (*func)(void));
+/// Create a new process running a copy of the current one, starting with
+/// the same registers, right after the call.
+///
+/// Return the address space identifier of the new process to the caller,
+/// 0 to the new process.  Open files are not inherited.
+SpaceId Fork(void);
 
 /// Yield the CPU to another runnable thread, whether in this address space
 /// or not.
 void Yield();
 
 
+/// Memory management: `Sbrk`.
+
+/// Move the end of the heap `increment` bytes up (or down, if negative).
+///
+/// Return the previous end of the heap, which is the start of the memory
+/// added, or -1 (as a pointer) if the heap cannot grow or shrink that much.
+/// Memory added reads as zero.  The page between the stack and the heap is
+/// never mapped: a stack overflowing into it ends the process.
+void *Sbrk(int increment);
+
+
 /// File system operations: `Create`, `Open`, `Read`, `Write`, `Close`.
 ///
 /// These functions are patterned after UNIX -- files represent both files
@@ -125,6 +141,20 @@ int Read(char *buffer, int size, OpenFileId id);
 /// Close the file, we are done reading and writing to it.
 int Close(OpenFileId id);
 
+/// Map `length` bytes of the open file, from `offset` on, into memory.
+///
+/// `offset` must be a multiple of the page size, and the range is clipped
+/// to the end of the file, which the mapping cannot extend.  Pages are read
+/// from the file as they are referenced, and changes are written back to it
+/// at the latest when unmapped.  Mappings are not inherited by `Fork`, and
+/// a mapped file cannot be closed.
+///
+/// Return the address of the mapping, or -1 (as a pointer) on error.
+void *Mmap(OpenFileId id, int offset, int length);
+
+/// Remove the mapping starting at `addr`, returned by `Mmap`.
+int Munmap(void *addr);
+
 
 #endif
 